@@ -18,16 +18,9 @@
 static const char rcsid_zlocate_c[] = "$Id$";
 #endif
 
-int numusers=0, numleft=0, parallel=0, oneline=0;
+int numusers=0, parallel=0, oneline=0;
 char *whoami;
 
-static RETSIGTYPE
-timeout(int sig)
-{
-  fprintf (stderr, "%s: no response from server\n", whoami);
-  exit(1);
-}
-
 static void
 usage(void)
 {
@@ -35,34 +28,32 @@ usage(void)
    exit(1);
 }
 
+/* A blank line follows unless last is set. */
 static void
-print_locs(char *user,
-	   int nlocs)
+print_locs(ZLocateResult_t *result,
+	   int last)
 {
-   int one = 1, retval;
-   ZLocations_t locations;
+   ZLocations_t *locations;
+   int i;
 
    if ((!oneline) && (numusers>1))
-     printf("\t%s:\n",user);
+     printf("\t%s:\n",result->user);
 
-   if ((!oneline) && (nlocs == 0))
+   if ((!oneline) && (result->nlocs == 0))
       printf("Hidden or not logged-in\n");
 
-   for (;nlocs;nlocs--) {
-      if ((retval = ZGetLocations(&locations,&one)) != ZERR_NONE) {
-	 com_err(whoami,retval,"while getting location");
-	 exit(1);
-      }
- 
+   for (i = 0; i < result->nlocs; i++) {
+      locations = &result->locs[i];
       if (oneline) {
-	 printf("%s:\t%s\t%s\t%s\n",user,locations.host,locations.tty,
-		locations.time);
+	 printf("%s:\t%s\t%s\t%s\n",result->user,locations->host,
+		locations->tty,locations->time);
       } else {
-	 printf("%-42s %-7s %s\n",locations.host, locations.tty, locations.time);
+	 printf("%-42s %-7s %s\n",locations->host, locations->tty,
+		locations->time);
       }
    }
 
-   if ((!oneline) && (numusers > 1) && (numleft > 0))
+   if ((!oneline) && (numusers > 1) && !last)
      printf("\n");
 }
 
@@ -71,14 +62,10 @@ int
 main(int argc,
      char *argv[])
 {
-    char user[BUFSIZ],*whichuser;
-    ZAsyncLocateData_t ald;
-    int retval,i,numlocs,numfound,loc,auth,rlen;
-    ZNotice_t notice;
-#ifdef _POSIX_VERSION
-    struct sigaction sa;
-#endif
-   
+    char **users;
+    ZLocateResult_t *results;
+    int retval,i,numfound,loc,auth,rlen;
+
     whoami = argv[0];
     auth = -1;
 
@@ -119,64 +106,55 @@ main(int argc,
 	exit(1);
     } 
 
-    numleft = numusers;
-    numfound = 0;
+    users = (char **) malloc(numusers * sizeof(char *));
+    results = (ZLocateResult_t *) malloc(numusers * sizeof(ZLocateResult_t));
+    if (!users || !results) {
+	com_err(whoami,ENOMEM,"while locating users");
+	exit(1);
+    }
+
     rlen = strlen(ZGetRealm());
 
     i = 0;
     for (loc = 0; loc < argc; loc++) {
 	if (argv[loc][0] == '-') continue;
 
-	(void) strncpy(user,argv[loc],sizeof(user) - rlen - 2);
-	user[sizeof(user) - rlen - 2] = '\0';
-	if (!strchr(user,'@')) {
-	    (void) strcat(user,"@");
-	    (void) strcat(user,ZGetRealm());
-	} 
-	if (parallel) {
-	    if ((retval = ZRequestLocations(user, &ald, i ? UNSAFE : UNACKED,
-					    auth?ZAUTH:ZNOAUTH)) != ZERR_NONE) {
-		com_err(whoami,retval,"requesting location of %s",user);
-		exit(1);
-	    }
-	    i = 1;
-	} else {
-	    if ((retval = ZLocateUser(user,&numlocs,auth?ZAUTH:ZNOAUTH)) != ZERR_NONE) {
-		com_err(whoami,retval,"while locating user %s",user);
-		exit(1);
-	    }
-	    print_locs(user,numlocs);
-	    numfound += numlocs;
+	users[i] = malloc(strlen(argv[loc]) + rlen + 2);
+	if (!users[i]) {
+	    com_err(whoami,ENOMEM,"while locating users");
+	    exit(1);
 	}
+	(void) strcpy(users[i],argv[loc]);
+	if (!strchr(users[i],'@')) {
+	    (void) strcat(users[i],"@");
+	    (void) strcat(users[i],ZGetRealm());
+	} 
+	i++;
     }
 
-    if (parallel) {
-#ifdef _POSIX_VERSION
-	sigemptyset(&sa.sa_mask);
-	sa.sa_flags = 0;
-	sa.sa_handler = timeout;
-	sigaction(SIGALRM, &sa, (struct sigaction *)0);
-#else
-	signal (SIGALRM, timeout);
-#endif
-	while (numleft-- > 0) {
-	    alarm(SRV_TIMEOUT);
-	    if ((retval = ZReceiveNotice(&notice, NULL)) != ZERR_NONE) {
-		com_err(whoami,retval,"while searching notice queue");
-		continue;
-	    }
-	    if ((retval = ZParseLocations(&notice, (ZAsyncLocateData_t *)NULL,
-					  &numlocs, &whichuser)) != ZERR_NONE) {
-		com_err(whoami,retval,"while parsing locations");
-		continue;
-	    }
-	    if (numlocs >= 0) {
-		print_locs(whichuser,numlocs);
-		free(whichuser);
-		numfound += numlocs;
-	    }
-	    ZFreeNotice(&notice);
+    /* The lookups always go out in parallel; -p is kept for
+       compatibility. */
+    if ((retval = ZLocateUsers(users,numusers,results,
+			       auth?ZAUTH:ZNOAUTH,SRV_TIMEOUT)) != ZERR_NONE) {
+	com_err(whoami,retval,"while locating users");
+	exit(1);
+    }
+
+    numfound = 0;
+    for (i = 0; i < numusers; i++) {
+	if (results[i].result == ETIMEDOUT) {
+	    fprintf (stderr, "%s: no response from server\n", whoami);
+	    exit(1);
+	}
+	if (results[i].result != ZERR_NONE) {
+	    com_err(whoami,results[i].result,"while locating user %s",
+		    results[i].user);
+	    exit(1);
 	}
+	/* As before, only -p left out the blank line after the last. */
+	print_locs(&results[i], parallel && i == numusers - 1);
+	numfound += results[i].nlocs;
     }
+    ZFreeLocateResults(results,numusers);
     return((numfound > 0) ? 0 : 1);
 }
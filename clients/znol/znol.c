@@ -29,14 +29,16 @@ main(int argc, char *argv[])
 	register char *cp;
 	char *realm;
 	ZSubscription_t subs[SUBSATONCE];
-	ZLocations_t locations;
+	ZLocateResult_t *results;
 	FILE *fp = NULL;
 	struct passwd *pwd;
 	char anyonename[BUFSIZ],name[BUFSIZ],cleanname[BUFSIZ],*envptr;
 	char *comment_ptr;
 	int onoff = ON,quiet = 0,justlist = 0,useronly = 0, filenamed = 0;
-	int retval,arg,ind,one,numlocs,i;
+	int retval,arg,ind,i,j;
 	int wgport = 0;
+	char **users = NULL, **cleannames = NULL;
+	int numusers = 0, maxusers = 0;
 
 	if ((retval = ZInitialize()) != ZERR_NONE) {
 		com_err(argv[0],retval,"initializing");
@@ -188,32 +190,26 @@ main(int argc, char *argv[])
 		    subs[ind++].zsub_recipient = "";
 		}
 
+		/* Look everyone up at once, below. */
 		if (!quiet && onoff == ON) {
-			if ((retval = ZLocateUser(name,&numlocs,ZAUTH))
-			    != ZERR_NONE) {
-				com_err(argv[0],retval,"locating user");
-				exit(1);
-			}
-			one = 1;
-			if (numlocs) {
-				for (i=0;i<numlocs;i++) {
-					if ((retval =
-					     ZGetLocations(&locations,&one))
-					    != ZERR_NONE) {
-						com_err(argv[0],retval,
-							"getting location");
-						continue;
-					}
-					if (one != 1) {
-						printf("%s: internal failure while getting location\n",argv[0]);
-						exit(1);
-					}
-					printf("%s: %s\t%s\t%s\n",cleanname,
-					       locations.host,
-					       locations.tty,
-					       locations.time);
+			if (numusers == maxusers) {
+				maxusers = maxusers ? maxusers * 2 : 64;
+				users = (char **) realloc(users,
+				    maxusers * sizeof(char *));
+				cleannames = (char **) realloc(cleannames,
+				    maxusers * sizeof(char *));
+				if (!users || !cleannames) {
+					fprintf (stderr, "znol: out of memory");
+					exit (1);
 				}
 			}
+			users[numusers] = strdup(name);
+			cleannames[numusers] = strdup(cleanname);
+			if (!users[numusers] || !cleannames[numusers]) {
+				fprintf (stderr, "znol: out of memory");
+				exit (1);
+			}
+			numusers++;
 		}
 		
 		if (ind == SUBSATONCE) {
@@ -238,6 +234,34 @@ main(int argc, char *argv[])
 		}
 	}
 
+	if (numusers) {
+		results = (ZLocateResult_t *)
+		    malloc(numusers * sizeof(ZLocateResult_t));
+		if (!results) {
+			fprintf (stderr, "znol: out of memory");
+			exit (1);
+		}
+		if ((retval = ZLocateUsers(users,numusers,results,ZAUTH,
+					   SRV_TIMEOUT)) != ZERR_NONE) {
+			com_err(argv[0],retval,"locating users");
+			exit(1);
+		}
+		for (i=0;i<numusers;i++) {
+			if (results[i].result != ZERR_NONE) {
+				com_err(argv[0],results[i].result,
+					"locating user");
+				exit(1);
+			}
+			for (j=0;j<results[i].nlocs;j++)
+				printf("%s: %s\t%s\t%s\n",cleannames[i],
+				       results[i].locs[j].host,
+				       results[i].locs[j].tty,
+				       results[i].locs[j].time);
+		}
+		ZFreeLocateResults(results,numusers);
+		free(results);
+	}
+
 	if (ind && !justlist)
 		if ((retval = (onoff==ON)?
 		     ZSubscribeToSansDefaults(subs,ind,(u_short)wgport):
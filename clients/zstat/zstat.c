@@ -34,7 +34,12 @@ const char *hm_head[] = {
     "Looking for a new server:",
     "Time running:",
     "Size:",
-    "Machine type:"
+    "Machine type:",
+    "Queue memory:",
+    "Most items queued:",
+    "Local deliveries:",
+    "Hedged notices:",
+    "Spurious retransmits:"
 };
 #define	HM_SIZE	(sizeof(hm_head) / sizeof (char *))
 const char *srv_head[] = {
@@ -47,13 +52,14 @@ const char *srv_head[] = {
 
 int outoftime = 0;
 
-int serveronly = 0,hmonly = 0;
+int serveronly = 0,hmonly = 0,detail = 0;
 u_short srv_port;
 
 void usage(char *);
 void do_stat(char *);
 int srv_stat(char *);
 int hm_stat(char *, char *);
+int hm_detail(char *);
 
 static RETSIGTYPE
 timeout(int ignored)
@@ -80,8 +86,11 @@ main(int argc,
 		exit(-1);
 	}
 
-	while ((optchar = getopt(argc, argv, "sh")) != EOF) {
+	while ((optchar = getopt(argc, argv, "shd")) != EOF) {
 		switch(optchar) {
+		case 'd':
+			detail++;
+			break;
 		case 's':
 			serveronly++;
 			break;
@@ -99,6 +108,10 @@ main(int argc,
 		fprintf(stderr,"Only one of -s and -h may be specified\n");
 		exit(1);
 	}
+	if (detail && serveronly) {
+		fprintf(stderr,"Only one of -s and -d may be specified\n");
+		exit(1);
+	}
 
 	sp = getservbyname(SERVER_SVCNAME,"udp");
 	srv_port = (sp) ? sp->s_port : SERVER_SVC_FALLBACK;
@@ -119,6 +132,11 @@ do_stat(char *host)
 {
 	char srv_host[NS_MAXDNAME];
 
+	if (detail) {
+		(void) hm_detail(host);
+		return;
+	}
+
 	if (serveronly) {
 		(void) srv_stat(host);
 		return;
@@ -192,6 +210,39 @@ hm_stat(char *host,
 	return(0);
 }
 
+/* Dump the detailed HostManager stats, one "name=value" line each. */
+int
+hm_detail(char *host)
+{
+	struct in_addr inaddr;
+	struct hostent *hp;
+	ZNotice_t notice;
+	Code_t code;
+	char *mp, *end;
+
+	if ((inaddr.s_addr = inet_addr(host)) == (unsigned)(-1)) {
+	    if ((hp = gethostbyname(host)) == NULL) {
+		fprintf(stderr,"Unknown host: %s\n",host);
+		exit(-1);
+	    }
+	    (void) memcpy((char *) &inaddr, hp->h_addr, hp->h_length);
+	}
+
+	if ((code = ZhmStatDetail(&inaddr, &notice)) != ZERR_NONE) {
+	    com_err("zstat", code, "getting hostmanager status");
+	    exit(-1);
+	}
+
+	printf("host=%s\n", host);
+	end = notice.z_message + notice.z_message_len;
+	for (mp = notice.z_message; mp < end; mp += strlen(mp) + 1)
+		printf("%.*s\n", (int) (end - mp), mp);
+	printf("\n");
+
+	ZFreeNotice(&notice);
+	return(0);
+}
+
 int
 srv_stat(char *host)
 {
@@ -307,6 +358,6 @@ srv_stat(char *host)
 void
 usage(char *s)
 {
-	fprintf(stderr,"usage: %s [-s] [-h] [host ...]\n",s);
+	fprintf(stderr,"usage: %s [-s] [-h] [-d] [host ...]\n",s);
 	exit(1);
 }
@@ -40,6 +40,8 @@
 #define Z_MAXQUEUESIZE		1500000	/* Max size of input queue notices */
 #define Z_FRAGFUDGE		13	/* Room to for multinotice field */
 #define Z_NOTICETIMELIMIT	30	/* Time to wait for fragments */
+#define Z_QHASHSIZE		256	/* Buckets in input queue index */
+#define Z_SENDBUFLEN		8192	/* Notices sent from the stack */
 #define Z_INITFILTERSIZE	30	/* Starting size of uid filter */
 #define Z_FILTERTIMELIMIT	900	/* Max time to cache packet ids */
 
@@ -51,7 +53,6 @@
 #define Z_KEYUSAGE_SRV_CKSUM  1029    /* server->client notice checksum */
 
 struct _Z_Hole {
-    struct _Z_Hole	*next;
     int			first;
     int			last;
 };
@@ -59,13 +60,23 @@ struct _Z_Hole {
 struct _Z_InputQ {
     struct _Z_InputQ	*next;
     struct _Z_InputQ	*prev;
+    struct _Z_InputQ	*hash_next;	/* same (uid, kind) hash bucket */
+    struct _Z_InputQ	*exp_next;	/* expiry list, while timep != 0 */
+    struct _Z_InputQ	*exp_prev;
+    struct _Z_InputQ	*ready_next;	/* completed, not yet dispatched */
+    struct _Z_InputQ	*ready_prev;
+    int			ready;
     ZNotice_Kind_t	kind;
     unsigned ZEPHYR_INT32 timep;
     int			packet_len;
     char		*packet;
     int			complete;
     struct sockaddr_in	from;
-    struct _Z_Hole	*holelist;
+    struct _Z_Hole	*holes;		/* sorted, disjoint */
+    int			nholes;
+    int			holes_size;
+    int			parsed;		/* notice is valid */
+    ZNotice_t		notice;		/* parsed from packet */
     ZUnique_Id_t	uid;
     int			auth;
     int			header_len;
@@ -125,9 +136,13 @@ typedef Code_t (*Z_SendProc) (ZNotice_t *, char *, int, int);
 struct _Z_InputQ *Z_GetFirstComplete (void);
 struct _Z_InputQ *Z_GetNextComplete (struct _Z_InputQ *);
 struct _Z_InputQ *Z_SearchQueue (ZUnique_Id_t *, ZNotice_Kind_t);
+void Z_InitQueue (void);
 Code_t Z_XmitFragment (ZNotice_t*, char *,int,int);
 void Z_RemQueue (struct _Z_InputQ *);
 Code_t Z_AddNoticeToEntry (struct _Z_InputQ*, ZNotice_t*, int);
+Code_t Z_ParseQueued (struct _Z_InputQ *);
+Code_t Z_TakeQueued (struct _Z_InputQ *, ZNotice_t *, struct sockaddr_in *);
+struct _Z_InputQ *Z_GetReady (void);
 Code_t Z_FormatAuthHeader (ZNotice_t *, char *, int, int *, Z_AuthProc);
 Code_t Z_FormatAuthHeaderWithASCIIAddress (ZNotice_t *, char *, int, int *);
 Code_t Z_FormatHeader (ZNotice_t *, char *, int, int *, Z_AuthProc);
@@ -154,6 +169,8 @@ Code_t Z_AsciiFormatRawHeader (ZNotice_t *, char *, int, int *, char **,
                                  int *, char **, char **);
 
 void Z_gettimeofday(struct _ZTimeval *ztv, struct timezone *tz);
+void Z_RttSample(long *srtt, long *rttvar, long rtt);
+long Z_Rto(long srtt, long rttvar, long min_ms, long max_ms, int retries);
 
 Code_t Z_MakeAuthenticationSaveKey(ZNotice_t*, char *,int, int*);
 
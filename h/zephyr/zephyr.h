@@ -141,6 +141,17 @@ typedef struct _ZAsyncLocateData_t {
     char		*version;
 } ZAsyncLocateData_t;
 
+/* Result for one user from ZLocateUsers */
+typedef struct _ZLocateResult_t {
+    char		*user;
+    Code_t		result;		/* ZERR_NONE, or why not found */
+    int			nlocs;
+    ZLocations_t	*locs;
+} ZLocateResult_t;
+
+/* Handler for notices picked up by ZDispatch */
+typedef void (*Z_HandlerProc)(ZNotice_t *, struct sockaddr_in *, void *);
+
 /* for ZSetDebug */
 #ifdef Z_DEBUG
 void (*__Z_debug_print)(const char *fmt, va_list args, void *closure);
@@ -182,6 +193,12 @@ Code_t ZNewFormatNotice(ZNotice_t*, char**, int*, Z_AuthProc);
 Code_t ZFormatNoticeList(ZNotice_t*, char**, int,
 			 char **, int*, Z_AuthProc);
 Code_t ZFormatRawNoticeList(ZNotice_t *, char *[], int, char **, int *);
+Code_t ZFormatNoticeInto(ZNotice_t *, char *, int, int *, Z_AuthProc);
+Code_t ZFormatRawNoticeInto(ZNotice_t *, char *, int, int *);
+Code_t ZFormatNoticeListInto(ZNotice_t *, char **, int, char *, int, int *,
+			     Z_AuthProc);
+Code_t ZFormatRawNoticeListInto(ZNotice_t *, char *[], int, char *, int,
+				int *);
 Code_t ZFormatSmallNotice(ZNotice_t*, ZPacket_t, int*, Z_AuthProc);
 Code_t ZFormatSmallRawNotice(ZNotice_t *, ZPacket_t, int *);
 Code_t ZNewFormatSmallRawNotice(ZNotice_t *, ZPacket_t, int *);
@@ -190,6 +207,7 @@ Code_t ZLocateUser(char *, int *, Z_AuthProc);
 Code_t ZRequestLocations(char *, ZAsyncLocateData_t *,
 			 ZNotice_Kind_t, Z_AuthProc);
 Code_t ZhmStat(struct in_addr *, ZNotice_t *);
+Code_t ZhmStatDetail(struct in_addr *, ZNotice_t *);
 Code_t ZInitialize(void);
 Code_t ZSetServerState(int);
 Code_t ZSetFD(int);
@@ -226,6 +244,9 @@ Code_t ZParseLocations(register ZNotice_t *notice,
 		       char **user);
 int ZCompareALDPred(ZNotice_t *notice, void *zald);
 void ZFreeALD(register ZAsyncLocateData_t *zald);
+Code_t ZLocateUsers(char **users, int nusers, ZLocateResult_t *results,
+		    Z_AuthProc auth, int timeout);
+void ZFreeLocateResults(ZLocateResult_t *results, int nusers);
 Code_t ZCheckIfNotice(ZNotice_t *notice, struct sockaddr_in *from,
 		      register int (*predicate)(ZNotice_t *,void *),
 		      void *args);
@@ -251,6 +272,13 @@ Code_t ZCancelSubscriptions(unsigned int port);
 Code_t ZFlushUserSubscriptions(char *recip);
 int ZPending(void);
 Code_t ZReceiveNotice(ZNotice_t *notice, struct sockaddr_in *from);
+Code_t ZHandleKind(ZNotice_Kind_t kind, Z_HandlerProc proc, void *arg);
+Code_t ZHandleUID(ZUnique_Id_t *uid, Z_HandlerProc proc, void *arg);
+Code_t ZHandleClass(char *class, char *inst, Z_HandlerProc proc, void *arg);
+/* Returns the number of notices handled.  Like ZPending(), it fails with
+   -1 and leaves the Code_t in errno (ZERR_NOPORT with no port open), so
+   use error_message(errno) or com_err(whoami, errno, ...) to report it. */
+int ZDispatch(void);
 const char *ZGetCharsetString(char *charset);
 unsigned short ZGetCharset(char *charset);
 const char *ZCharsetToString(unsigned short charset);
@@ -330,6 +358,7 @@ void Z_debug_stderr(const char *format, va_list args, void *closure);
 #define HM_FLUSH		"FLUSH"		/* Opcode: Flush me */
 #define HM_DETACH		"DETACH"	/* Opcode: Detach me */
 #define HM_ATTACH		"ATTACH"	/* Opcode: Attach me */
+#define HM_PING			"PING"		/* Opcode: Just ack me */
 
 /* Control codes send to a HostManager */
 #define	HM_CTL_CLASS		"HM_CTL"	/* Class */
@@ -347,6 +376,7 @@ void Z_debug_stderr(const char *format, va_list args, void *closure);
 
 #define HM_STAT_CLIENT		"HMST_CLIENT"	/* Inst: From client */
 #define HM_GIMMESTATS		"GIMMESTATS"	/* Opcode: get stats */
+#define HM_GIMMEDETAIL		"GIMMEDETAIL"	/* Opcode: get detailed stats */
 
 /* Login class messages */
 #define LOGIN_CLASS		"LOGIN"		/* Class */
@@ -166,3 +166,135 @@ ZFreeALD(register ZAsyncLocateData_t *zald)
    if (zald->version) free(zald->version);
    (void) memset(zald, 0, sizeof(*zald));
 }
+
+struct _Z_LocateBatch {
+    ZAsyncLocateData_t *zald;	/* user is null once answered */
+    int n;
+};
+
+static int
+Z_LocateBatchPred(ZNotice_t *notice,
+		  void *arg)
+{
+    struct _Z_LocateBatch *batch = (struct _Z_LocateBatch *) arg;
+    int i;
+
+    for (i = 0; i < batch->n; i++)
+	if (batch->zald[i].user && ZCompareALDPred(notice, &batch->zald[i]))
+	    return (1);
+    return (0);
+}
+
+/*
+ * Locate several users at once.  All the requests go out before any
+ * reply is waited for, and the replies are matched up as they arrive,
+ * so the batch costs about one round trip to the server rather than
+ * one per user.  results must have room for nusers entries.  Each gets
+ * a copy of the user's name and either ZERR_NONE and the locations, or
+ * the reason there are none: ETIMEDOUT if no reply came within timeout
+ * seconds.  Free them with ZFreeLocateResults().
+ */
+
+Code_t
+ZLocateUsers(char **users,
+	     int nusers,
+	     ZLocateResult_t *results,
+	     Z_AuthProc auth,
+	     int timeout)
+{
+    ZAsyncLocateData_t *zald;
+    struct _Z_LocateBatch batch;
+    ZNotice_t notice;
+    Code_t retval = ZERR_NONE;
+    time_t deadline, now;
+    int i, left = 0, nlocs;
+
+    (void) memset((char *)results, 0, nusers * sizeof(ZLocateResult_t));
+    zald = (ZAsyncLocateData_t *) calloc(nusers ? nusers : 1,
+					 sizeof(ZAsyncLocateData_t));
+    if (!zald)
+	return (ENOMEM);
+
+    for (i = 0; i < nusers; i++) {
+	if ((results[i].user = (char *) malloc(strlen(users[i])+1)) == NULL) {
+	    retval = ENOMEM;
+	    break;
+	}
+	strcpy(results[i].user, users[i]);
+	results[i].result = ZRequestLocations(users[i], &zald[i], UNACKED,
+					      auth);
+	if (results[i].result == ZERR_NONE)
+	    left++;
+	else
+	    (void) memset((char *)&zald[i], 0, sizeof(zald[i]));
+    }
+    if (retval != ZERR_NONE) {
+	for (i = 0; i < nusers; i++)
+	    ZFreeALD(&zald[i]);
+	free((char *)zald);
+	ZFreeLocateResults(results, nusers);
+	return (retval);
+    }
+
+    batch.zald = zald;
+    batch.n = nusers;
+    deadline = time((time_t *)0) + timeout;
+    while (left) {
+	now = time((time_t *)0);
+	if (now >= deadline) {
+	    retval = ETIMEDOUT;
+	    break;
+	}
+	retval = Z_WaitForNotice(&notice, Z_LocateBatchPred, &batch,
+				 deadline - now);
+	if (retval != ZERR_NONE)
+	    break;
+
+	for (i = 0; i < nusers; i++)
+	    if (zald[i].user && ZCompareALDPred(&notice, &zald[i]))
+		break;
+	results[i].result = ZParseLocations(&notice, &zald[i], &nlocs, NULL);
+	ZFreeNotice(&notice);
+	if (results[i].result == ZERR_NONE) {
+	    if (nlocs < 0)
+		continue;	/* just the ack; the locations follow */
+	    /* Take the list ZParseLocations() left for ZGetLocations(). */
+	    results[i].nlocs = nlocs;
+	    results[i].locs = __locate_list;
+	    __locate_list = 0;
+	    __locate_num = 0;
+	    __locate_next = 0;
+	}
+	ZFreeALD(&zald[i]);
+	left--;
+    }
+
+    for (i = 0; i < nusers; i++) {
+	if (zald[i].user) {
+	    results[i].result = retval;
+	    ZFreeALD(&zald[i]);
+	}
+    }
+    free((char *)zald);
+    return (ZERR_NONE);
+}
+
+void
+ZFreeLocateResults(ZLocateResult_t *results,
+		   int nusers)
+{
+    int i, j;
+
+    for (i = 0; i < nusers; i++) {
+	if (results[i].user)
+	    free(results[i].user);
+	for (j = 0; j < results[i].nlocs; j++) {
+	    free(results[i].locs[j].host);
+	    free(results[i].locs[j].time);
+	    free(results[i].locs[j].tty);
+	}
+	if (results[i].locs)
+	    free((char *)results[i].locs);
+    }
+    (void) memset((char *)results, 0, nusers * sizeof(ZLocateResult_t));
+}
@@ -22,9 +22,7 @@ ZCheckIfNotice(ZNotice_t *notice,
 	       register int (*predicate)(ZNotice_t *, void *),
 	       void *args)
 {
-    ZNotice_t tmpnotice;
     Code_t retval;
-    register char *buffer;
     register struct _Z_InputQ *qptr;
 
     if ((retval = Z_ReadEnqueue()) != ZERR_NONE)
@@ -33,23 +31,10 @@ ZCheckIfNotice(ZNotice_t *notice,
     qptr = Z_GetFirstComplete();
     
     while (qptr) {
-	if ((retval = ZParseNotice(qptr->packet, qptr->packet_len, 
-				   &tmpnotice)) != ZERR_NONE)
+	if ((retval = Z_ParseQueued(qptr)) != ZERR_NONE)
 	    return (retval);
-	if ((*predicate)(&tmpnotice, args)) {
-	    if (!(buffer = (char *) malloc((unsigned) qptr->packet_len)))
-		return (ENOMEM);
-	    (void) memcpy(buffer, qptr->packet, qptr->packet_len);
-	    if (from)
-		*from = qptr->from;
-	    if ((retval = ZParseNotice(buffer, qptr->packet_len, 
-				       notice)) != ZERR_NONE) {
-		free(buffer);
-		return (retval);
-	    }
-	    Z_RemQueue(qptr);
-	    return (ZERR_NONE);
-	} 
+	if ((*predicate)(&qptr->notice, args))
+	    return (Z_TakeQueued(qptr, notice, from));
 	qptr = Z_GetNextComplete(qptr);
     }
 
@@ -0,0 +1,261 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It contains source for ZDispatch and the functions that install
+ * notice handlers for it.
+ *
+ *	$Id$
+ *
+ *	Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *	For copying and distribution information, see the file
+ *	"mit-copyright.h".
+ */
+
+#ifndef lint
+static const char rcsid_ZDispatch_c[] = "$Id$";
+#endif
+
+#include <internal.h>
+#include <ctype.h>
+
+/*
+ * A client that would rather be called than poll installs handlers,
+ * keyed by the UID of a notice, by its class and instance, or by its
+ * kind, and calls ZDispatch() whenever ZGetFD() is readable.  Each
+ * notice completed since the last call goes to the first handler that
+ * matches it, trying the UID, then the class and instance, then the
+ * class with any instance, then the kind.  A UID handler is used only
+ * once, since it is normally waiting for the reply to one notice.
+ * Notices no handler wants stay in the queue for ZReceiveNotice() and
+ * friends.
+ *
+ * Handlers get a notice that is freed when they return.  Passing a
+ * null proc removes the handler for that key.
+ */
+
+#define HANDLER_HASHSIZE	64
+
+struct handler {
+    struct handler *next;
+    unsigned long hash;
+    int has_uid;			/* else keyed by class */
+    ZUnique_Id_t uid;
+    char *class;
+    char *inst;				/* NULL for any instance */
+    Z_HandlerProc proc;
+    void *arg;
+};
+
+static struct handler *handlers[HANDLER_HASHSIZE];
+static struct {
+    Z_HandlerProc proc;
+    void *arg;
+} kind_handlers[STAT+1];
+
+static unsigned long
+hash_bytes(unsigned long h,
+	   unsigned char *p,
+	   int len)
+{
+    while (len--)
+	h = h * 31 + *p++;
+    return h;
+}
+
+static unsigned long
+hash_string(unsigned long h,
+	    char *s)
+{
+    for (; *s; s++)
+	h = h * 31 + tolower((unsigned char) *s);
+    return h * 31;
+}
+
+static unsigned long
+class_hash(char *class,
+	   char *inst)
+{
+    return hash_string(hash_string(1, class), inst ? inst : "*");
+}
+
+/* Find where the handler with this key is, or would go. */
+static struct handler **
+find_handler(unsigned long hash,
+	     ZUnique_Id_t *uid,
+	     char *class,
+	     char *inst)
+{
+    struct handler **hp;
+
+    for (hp = &handlers[hash % HANDLER_HASHSIZE]; *hp; hp = &(*hp)->next) {
+	if ((*hp)->hash != hash)
+	    continue;
+	if (uid) {
+	    if ((*hp)->has_uid && ZCompareUID(uid, &(*hp)->uid))
+		break;
+	} else if (!(*hp)->has_uid && !strcasecmp((*hp)->class, class)) {
+	    if (inst ? ((*hp)->inst && !strcasecmp((*hp)->inst, inst))
+		: !(*hp)->inst)
+		break;
+	}
+    }
+    return hp;
+}
+
+static void
+free_handler(struct handler **hp)
+{
+    struct handler *h = *hp;
+
+    *hp = h->next;
+    free(h->class);
+    free(h->inst);
+    free(h);
+}
+
+static Code_t
+set_handler(unsigned long hash,
+	    ZUnique_Id_t *uid,
+	    char *class,
+	    char *inst,
+	    Z_HandlerProc proc,
+	    void *arg)
+{
+    struct handler **hp, *h;
+
+    hp = find_handler(hash, uid, class, inst);
+    if (!proc) {
+	if (*hp)
+	    free_handler(hp);
+	return (ZERR_NONE);
+    }
+    if (!*hp) {
+	h = (struct handler *) malloc(sizeof(struct handler));
+	if (!h)
+	    return (ENOMEM);
+	(void) memset((char *)h, 0, sizeof(struct handler));
+	h->hash = hash;
+	if (uid) {
+	    h->has_uid = 1;
+	    h->uid = *uid;
+	} else {
+	    h->class = strdup(class);
+	    h->inst = inst ? strdup(inst) : NULL;
+	    if (!h->class || (inst && !h->inst)) {
+		free(h->class);
+		free(h);
+		return (ENOMEM);
+	    }
+	}
+	*hp = h;
+    }
+    (*hp)->proc = proc;
+    (*hp)->arg = arg;
+    return (ZERR_NONE);
+}
+
+Code_t
+ZHandleKind(ZNotice_Kind_t kind,
+	    Z_HandlerProc proc,
+	    void *arg)
+{
+    if ((int) kind < 0 || kind > STAT)
+	return (ZERR_ILLVAL);
+    kind_handlers[kind].proc = proc;
+    kind_handlers[kind].arg = arg;
+    return (ZERR_NONE);
+}
+
+Code_t
+ZHandleUID(ZUnique_Id_t *uid,
+	   Z_HandlerProc proc,
+	   void *arg)
+{
+    return (set_handler(hash_bytes(0, (unsigned char *) uid, sizeof(*uid)),
+			uid, NULL, NULL, proc, arg));
+}
+
+Code_t
+ZHandleClass(char *class,
+	     char *inst,
+	     Z_HandlerProc proc,
+	     void *arg)
+{
+    if (!class)
+	return (ZERR_ILLVAL);
+    if (inst && !strcmp(inst, "*"))
+	inst = NULL;
+    return (set_handler(class_hash(class, inst), NULL, class, inst,
+			proc, arg));
+}
+
+/*
+ * Read whatever is waiting on the socket and hand each newly completed
+ * notice to its handler.  Returns the number of notices handled, or -1
+ * with errno set to the Code_t if there is no port or reading failed, as
+ * ZPending() does; notices that were already complete are handled
+ * either way.  Never blocks.
+ */
+
+int
+ZDispatch(void)
+{
+    struct _Z_InputQ *qptr;
+    struct handler **hp;
+    Z_HandlerProc proc;
+    void *arg;
+    ZNotice_t notice, *n;
+    struct sockaddr_in from;
+    Code_t readerr;
+    int count = 0;
+
+    if (ZGetFD() < 0) {
+	errno = ZERR_NOPORT;
+	return (-1);
+    }
+
+    readerr = Z_ReadEnqueue();
+
+    while ((qptr = Z_GetReady())) {
+	if (Z_ParseQueued(qptr) != ZERR_NONE)
+	    continue;
+	n = &qptr->notice;
+
+	proc = NULL;
+	hp = find_handler(hash_bytes(0, (unsigned char *) &n->z_uid,
+				     sizeof(n->z_uid)),
+			  &n->z_uid, NULL, NULL);
+	if (*hp) {
+	    proc = (*hp)->proc;
+	    arg = (*hp)->arg;
+	    free_handler(hp);
+	}
+	if (!proc) {
+	    hp = find_handler(class_hash(n->z_class, n->z_class_inst), NULL,
+			      n->z_class, n->z_class_inst);
+	    if (!*hp)
+		hp = find_handler(class_hash(n->z_class, NULL), NULL,
+				  n->z_class, NULL);
+	    if (*hp) {
+		proc = (*hp)->proc;
+		arg = (*hp)->arg;
+	    }
+	}
+	if (!proc && (int) n->z_kind >= 0 && n->z_kind <= STAT) {
+	    proc = kind_handlers[n->z_kind].proc;
+	    arg = kind_handlers[n->z_kind].arg;
+	}
+	if (!proc)
+	    continue;
+
+	if (Z_TakeQueued(qptr, &notice, &from) != ZERR_NONE)
+	    continue;
+	(*proc)(&notice, &from, arg);
+	(void) ZFreeNotice(&notice);
+	count++;
+    }
+
+    if (readerr != ZERR_NONE) {
+	errno = readerr;
+	return (-1);
+    }
+    return (count);
+}
@@ -17,6 +17,50 @@ static const char rcsid_ZFormatNoticeList_c[] =
     "$Id$";
 #endif
 
+/* Like ZFormatNoticeInto(), with the message made from the list. */
+
+Code_t
+ZFormatNoticeListInto(ZNotice_t *notice,
+		      char **list,
+		      int nitems,
+		      char *buffer,
+		      int buffer_len,
+		      int *ret_len,
+		      Z_AuthProc cert_routine)
+{
+    char header[Z_MAXHEADERLEN];
+    char *hdrbuf = (buffer_len < Z_MAXHEADERLEN) ? header : buffer;
+    register int i;
+    int hdrlen, size;
+    char *ptr;
+    Code_t retval;
+
+    if ((retval = Z_FormatHeader(notice, hdrbuf, Z_MAXHEADERLEN, &hdrlen,
+				 cert_routine)) != ZERR_NONE)
+	return (retval);
+
+    size = 0;
+    for (i=0;i<nitems;i++)
+	size += strlen(list[i])+1;
+
+    *ret_len = hdrlen+size;
+
+    if (*ret_len > buffer_len)
+	return (ZERR_PKTLEN);
+
+    if (hdrbuf != buffer)
+	(void) memcpy(buffer, header, hdrlen);
+    ptr = buffer+hdrlen;
+
+    for (;nitems;nitems--, list++) {
+	i = strlen(*list)+1;
+	(void) memcpy(ptr, *list, i);
+	ptr += i;
+    }
+
+    return (ZERR_NONE);
+}
+
 Code_t
 ZFormatNoticeList(ZNotice_t *notice,
 		  register char **list,
@@ -16,6 +16,42 @@ static const char rcsid_ZFormatNotice_c[] = "$Id$";
 
 #include <internal.h>
 
+/*
+ * Format the notice into a buffer the caller owns, so that sending does
+ * not have to go through malloc().  Returns ZERR_PKTLEN, with *ret_len
+ * set to the length needed, if the notice does not fit.
+ */
+
+Code_t
+ZFormatNoticeInto(register ZNotice_t *notice,
+		  char *buffer,
+		  int buffer_len,
+		  int *ret_len,
+		  Z_AuthProc cert_routine)
+{
+    char header[Z_MAXHEADERLEN];
+    char *hdrbuf = (buffer_len < Z_MAXHEADERLEN) ? header : buffer;
+    int hdrlen;
+    Code_t retval;
+
+    /* A buffer that might not hold the header gets it by way of header[],
+       so that we can still say how long the notice is. */
+    if ((retval = Z_FormatHeader(notice, hdrbuf, Z_MAXHEADERLEN, &hdrlen,
+				 cert_routine)) != ZERR_NONE)
+	return (retval);
+
+    *ret_len = hdrlen+notice->z_message_len;
+
+    if (*ret_len > buffer_len)
+	return (ZERR_PKTLEN);
+
+    if (hdrbuf != buffer)
+	(void) memcpy(buffer, header, hdrlen);
+    (void) memcpy(buffer+hdrlen, notice->z_message, notice->z_message_len);
+
+    return (ZERR_NONE);
+}
+
 Code_t
 ZFormatNotice(register ZNotice_t *notice,
 	      char **buffer,
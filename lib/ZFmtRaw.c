@@ -16,6 +16,35 @@ static const char rcsid_ZFormatRawNotice_c[] = "$Id$";
 
 #include <internal.h>
 
+/* Like ZFormatNoticeInto(), for a notice that is not to be authenticated. */
+
+Code_t
+ZFormatRawNoticeInto(register ZNotice_t *notice,
+		     char *buffer,
+		     int buffer_len,
+		     int *ret_len)
+{
+    char header[Z_MAXHEADERLEN];
+    char *hdrbuf = (buffer_len < Z_MAXHEADERLEN) ? header : buffer;
+    int hdrlen;
+    Code_t retval;
+
+    if ((retval = Z_FormatRawHeader(notice, hdrbuf, Z_MAXHEADERLEN,
+				    &hdrlen, NULL, NULL)) != ZERR_NONE)
+	return (retval);
+
+    *ret_len = hdrlen+notice->z_message_len;
+
+    if (*ret_len > buffer_len)
+	return (ZERR_PKTLEN);
+
+    if (hdrbuf != buffer)
+	(void) memcpy(buffer, header, hdrlen);
+    (void) memcpy(buffer+hdrlen, notice->z_message, notice->z_message_len);
+
+    return (ZERR_NONE);
+}
+
 Code_t
 ZFormatRawNotice(register ZNotice_t *notice,
 		 char **buffer,
@@ -16,6 +16,48 @@ static const char rcsid_ZFormatRawNoticeList_c[] = "$Id$";
 
 #include <internal.h>
 
+/* Like ZFormatRawNoticeInto(), with the message made from the list. */
+
+Code_t
+ZFormatRawNoticeListInto(ZNotice_t *notice,
+			 char *list[],
+			 int nitems,
+			 char *buffer,
+			 int buffer_len,
+			 int *ret_len)
+{
+    char header[Z_MAXHEADERLEN];
+    char *hdrbuf = (buffer_len < Z_MAXHEADERLEN) ? header : buffer;
+    int hdrlen, i, size;
+    char *ptr;
+    Code_t retval;
+
+    if ((retval = Z_FormatRawHeader(notice, hdrbuf, Z_MAXHEADERLEN,
+				    &hdrlen, NULL, NULL)) != ZERR_NONE)
+	return (retval);
+
+    size = 0;
+    for (i=0;i<nitems;i++)
+	size += strlen(list[i])+1;
+
+    *ret_len = hdrlen+size;
+
+    if (*ret_len > buffer_len)
+	return (ZERR_PKTLEN);
+
+    if (hdrbuf != buffer)
+	(void) memcpy(buffer, header, hdrlen);
+    ptr = buffer+hdrlen;
+
+    for (;nitems;nitems--, list++) {
+	i = strlen(*list)+1;
+	(void) memcpy(ptr, *list, i);
+	ptr += i;
+    }
+
+    return (ZERR_NONE);
+}
+
 Code_t
 ZFormatRawNoticeList(ZNotice_t *notice,
 		     char *list[],
@@ -22,9 +22,7 @@ ZIfNotice(ZNotice_t *notice,
 	  int (*predicate)(ZNotice_t *, void *),
 	  void *args)
 {
-    ZNotice_t tmpnotice;
     Code_t retval;
-    char *buffer;
     struct _Z_InputQ *qptr;
 
     if ((retval = Z_WaitForComplete()) != ZERR_NONE)
@@ -34,23 +32,10 @@ ZIfNotice(ZNotice_t *notice,
     
     for (;;) {
 	while (qptr) {
-	    if ((retval = ZParseNotice(qptr->packet, qptr->packet_len, 
-				       &tmpnotice)) != ZERR_NONE)
+	    if ((retval = Z_ParseQueued(qptr)) != ZERR_NONE)
 		return (retval);
-	    if ((*predicate)(&tmpnotice, args)) {
-		if (!(buffer = (char *) malloc((unsigned) qptr->packet_len)))
-		    return (ENOMEM);
-		(void) memcpy(buffer, qptr->packet, qptr->packet_len);
-		if (from)
-		    *from = qptr->from;
-		if ((retval = ZParseNotice(buffer, qptr->packet_len, 
-					   notice)) != ZERR_NONE) {
-		    free(buffer);
-		    return (retval);
-		}
-		Z_RemQueue(qptr);
-		return (ZERR_NONE);
-	    }
+	    if ((*predicate)(&qptr->notice, args))
+		return (Z_TakeQueued(qptr, notice, from));
 	    qptr = Z_GetNextComplete(qptr);
 	}
 	if ((retval = Z_ReadWait()) != ZERR_NONE)
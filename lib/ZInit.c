@@ -100,8 +100,7 @@ ZInitialize(void)
     __HM_set = 0;
 
     /* Initialize the input queue */
-    __Q_Tail = NULL;
-    __Q_Head = NULL;
+    Z_InitQueue();
 
 #ifdef HAVE_KRB5
     if ((code = krb5_init_context(&Z_krb5_ctx)))
@@ -17,7 +17,26 @@
 static const char rcsid_ZMakeAscii_c[] = "$Id$";
 #endif
 
-static char *itox_chars = "0123456789ABCDEF";
+/* The two hex digits for each byte value. */
+static const char hex_pairs[513] =
+    "000102030405060708090A0B0C0D0E0F"
+    "101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F"
+    "303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F"
+    "505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F"
+    "707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F"
+    "909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+    "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+    "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+    "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+#define PUT_HEX(ptr, byte)	memcpy((ptr), &hex_pairs[2 * (byte)], 2)
 
 Code_t
 ZMakeAscii(register char *ptr,
@@ -43,8 +62,8 @@ ZMakeAscii(register char *ptr,
 	} 
 	if (len < 3)
 	    return ZERR_FIELDLEN;
-	*ptr++ = itox_chars[(int) (field[i] >> 4)];
-	*ptr++ = itox_chars[(int) (field[i] & 0xf)];
+	PUT_HEX(ptr, field[i]);
+	ptr += 2;
 	len -= 2;
     }
 
@@ -59,17 +78,13 @@ ZMakeAscii32(register char *ptr,
 {
     if (len < 11)
 	return ZERR_FIELDLEN;
-    *ptr++ = '0';
-    *ptr++ = 'x';
-    *ptr++ = itox_chars[(value >> 28) & 0xf];
-    *ptr++ = itox_chars[(value >> 24) & 0xf];
-    *ptr++ = itox_chars[(value >> 20) & 0xf];
-    *ptr++ = itox_chars[(value >> 16) & 0xf];
-    *ptr++ = itox_chars[(value >> 12) & 0xf];
-    *ptr++ = itox_chars[(value >>  8) & 0xf];
-    *ptr++ = itox_chars[(value >>  4) & 0xf];
-    *ptr++ = itox_chars[(value >>  0) & 0xf];
-    *ptr = 0;
+    ptr[0] = '0';
+    ptr[1] = 'x';
+    PUT_HEX(ptr + 2, (value >> 24) & 0xff);
+    PUT_HEX(ptr + 4, (value >> 16) & 0xff);
+    PUT_HEX(ptr + 6, (value >>  8) & 0xff);
+    PUT_HEX(ptr + 8, value & 0xff);
+    ptr[10] = 0;
     return ZERR_NONE;
 }
 
@@ -80,13 +95,11 @@ ZMakeAscii16(register char *ptr,
 {
     if (len < 7)
 	return ZERR_FIELDLEN;
-    *ptr++ = '0';
-    *ptr++ = 'x';
-    *ptr++ = itox_chars[(value >> 12) & 0xf];
-    *ptr++ = itox_chars[(value >>  8) & 0xf];
-    *ptr++ = itox_chars[(value >>  4) & 0xf];
-    *ptr++ = itox_chars[(value >>  0) & 0xf];
-    *ptr = 0;
+    ptr[0] = '0';
+    ptr[1] = 'x';
+    PUT_HEX(ptr + 2, (value >> 8) & 0xff);
+    PUT_HEX(ptr + 4, value & 0xff);
+    ptr[6] = 0;
     return ZERR_NONE;
 }
 
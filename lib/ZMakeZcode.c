@@ -37,6 +37,7 @@ ZMakeZcode(register char *ptr,
 	   int num)
 {
     int i;
+    unsigned char c;
 
     /*
      * This optimistic check lets us discover quickly if the buffer
@@ -49,6 +50,26 @@ ZMakeZcode(register char *ptr,
       return ZERR_FIELDLEN;
     *ptr++ = 'Z';
     --len;
+
+    /*
+     * If there is room for every byte to be escaped, which there is
+     * for the usual callers, skip the checks; this loop has just one
+     * rarely taken branch per byte.
+     */
+    if (len > 2 * num) {
+	for (i = 0; i < num; i++) {
+	    c = field[i];
+	    if ((unsigned char) (c + 1) > 1) {
+		*ptr++ = c;
+	    } else {
+		*(unsigned char *)ptr++ = 0xff;
+		*(unsigned char *)ptr++ = c ? 0xf1 : 0xf0;
+	    }
+	}
+	*ptr = '\0';
+	return ZERR_NONE;
+    }
+
     for (i=0;i<num;i++) {
         switch (field[i]) {
             case 0x00:
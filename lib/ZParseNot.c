@@ -20,6 +20,7 @@ static const char rcsid_ZParseNotice_c[] =
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <stddef.h>
 
 inline static int
 _bad_packet(int line, char *where, ZNotice_t *notice, char *what) {
@@ -41,21 +42,34 @@ inline static char *
 next_field(char *ptr,
 	   char *end)
 {
-    while (ptr < end && *ptr != '\0')
-	ptr++;
-    if (ptr < end)
-	ptr++;
-    return (ptr);
+    char *nul;
+
+    if (ptr >= end)
+	return (ptr);
+    nul = memchr(ptr, '\0', end - ptr);
+    return (nul ? nul + 1 : end);
 }
 
+/* The plain string fields, in the order they appear in the header. */
+static const size_t string_fields[] = {
+    offsetof(ZNotice_t, z_class),
+    offsetof(ZNotice_t, z_class_inst),
+    offsetof(ZNotice_t, z_opcode),
+    offsetof(ZNotice_t, z_sender),
+    offsetof(ZNotice_t, z_recipient),
+    offsetof(ZNotice_t, z_default_format),
+};
+#define NUM_STRING_FIELDS (sizeof(string_fields) / sizeof(string_fields[0]))
+
 Code_t
 ZParseNotice(char *buffer,
 	     int len,
 	     ZNotice_t *notice)
 {
-    char *ptr, *end;
+    char *ptr, *end, **fieldp;
     unsigned long temp;
     int maj, numfields, i;
+    size_t f;
 
 #ifndef __LINE__
 #define __LINE__ -1
@@ -153,54 +167,17 @@ ZParseNotice(char *buffer,
     else
 	BAD_PACKET("missing authenticator field");
 
-    if (numfields && ptr < end) {
-	notice->z_class = ptr;
-	numfields--;
-	ptr = next_field(ptr, end);
-    }
-    else
-	notice->z_class = "";
-	
-    if (numfields && ptr < end) {
-	notice->z_class_inst = ptr;
-	numfields--;
-	ptr = next_field(ptr, end);
-    }
-    else
-	notice->z_class_inst = "";
-
-    if (numfields && ptr < end) {
-	notice->z_opcode = ptr;
-	numfields--;
-	ptr = next_field(ptr, end);
-    }
-    else
-	notice->z_opcode = "";
-
-    if (numfields && ptr < end) {
-	notice->z_sender = ptr;
-	numfields--;
-	ptr = next_field(ptr, end);
-    }
-    else
-	notice->z_sender = "";
-
-    if (numfields && ptr < end) {
-	notice->z_recipient = ptr;
-	numfields--;
-	ptr = next_field(ptr, end);
+    for (f = 0; f < NUM_STRING_FIELDS; f++) {
+	fieldp = (char **) ((char *) notice + string_fields[f]);
+	if (numfields && ptr < end) {
+	    *fieldp = ptr;
+	    numfields--;
+	    ptr = next_field(ptr, end);
+	}
+	else
+	    *fieldp = "";
     }
-    else
-	notice->z_recipient = "";
 
-    if (numfields && ptr < end) {
-	notice->z_default_format = ptr;
-	numfields--;
-	ptr = next_field(ptr, end);
-    }
-    else
-	notice->z_default_format = "";
-	
     if (numfields && ptr < end) {
       notice->z_ascii_checksum = ptr;
 
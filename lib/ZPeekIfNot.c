@@ -22,7 +22,6 @@ ZPeekIfNotice(ZNotice_t *notice,
 	      int (*predicate)(ZNotice_t *, char *),
 	      char *args)
 {
-    ZNotice_t tmpnotice;
     Code_t retval;
     char *buffer;
     struct _Z_InputQ *qptr;
@@ -33,10 +32,9 @@ ZPeekIfNotice(ZNotice_t *notice,
     for (;;) {
 	qptr = Z_GetFirstComplete();
 	while (qptr) {
-	    if ((retval = ZParseNotice(qptr->packet, qptr->packet_len, 
-				       &tmpnotice)) != ZERR_NONE)
+	    if ((retval = Z_ParseQueued(qptr)) != ZERR_NONE)
 		return (retval);
-	    if ((*predicate)(&tmpnotice, args)) {
+	    if ((*predicate)(&qptr->notice, args)) {
 		if (!(buffer = (char *) malloc((unsigned) qptr->packet_len)))
 		    return (ENOMEM);
 		(void) memcpy(buffer, qptr->packet, qptr->packet_len);
@@ -17,7 +17,29 @@ static const char rcsid_ZReadAscii_c[] = "$Id$";
 #include <internal.h>
 #include <assert.h>
 
-#define Z_cnvt_xtoi(c)  ((temp=(c)-'0'),(temp<10)?temp:((temp-='A'-'9'-1),(temp<16)?temp:-1))
+/*
+ * The value of each hex digit, or -1.  This keeps the quirks of the
+ * arithmetic it replaced: lower case is not accepted, and ':' through
+ * '@' read as 3 through 9.
+ */
+static const signed char xtoi[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  3,  4,  5,  6,  7,  8,
+     9, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
 
 Code_t
 ZReadAscii(char *ptr,
@@ -26,9 +48,7 @@ ZReadAscii(char *ptr,
 	   int num)
 {
     int i;
-    unsigned int hexbyte;
     register int c1, c2;
-    register int temp;
 
     for (i=0;i<num;i++) {
 	if (len >= 1 && *ptr == ' ') {
@@ -41,14 +61,11 @@ ZReadAscii(char *ptr,
 	}
 	if (len < 2)
 	    return ZERR_BADFIELD;
-	c1 = Z_cnvt_xtoi(ptr[0]);
-	if (c1 < 0)
-		return ZERR_BADFIELD;
-	c2 = Z_cnvt_xtoi(ptr[1]);
-	if (c2 < 0)
-		return ZERR_BADFIELD;
-	hexbyte = (c1 << 4) | c2;
-	field[i] = hexbyte;
+	c1 = xtoi[(unsigned char) ptr[0]];
+	c2 = xtoi[(unsigned char) ptr[1]];
+	if ((c1 | c2) < 0)
+	    return ZERR_BADFIELD;
+	field[i] = (c1 << 4) | c2;
 	ptr += 2;
 	len -= 2;
     }
@@ -56,6 +73,33 @@ ZReadAscii(char *ptr,
     return *ptr ? ZERR_BADFIELD : ZERR_NONE;
 }
 
+/*
+ * Read num bytes from a field that is exactly "0x" and their digits
+ * followed by a NUL, which is how ZMakeAscii32() and ZMakeAscii16()
+ * write it.  Returns -1 if the field is in any other form, and
+ * ZReadAscii() must sort it out.
+ */
+static inline int
+read_plain_hex(char *ptr,
+	       int len,
+	       unsigned char *field,
+	       int num)
+{
+    int i, c1, c2, bad = 0;
+
+    if (len < 2 * num + 3 || ptr[0] != '0' || ptr[1] != 'x'
+	|| ptr[2 * num + 2] != '\0')
+	return -1;
+    ptr += 2;
+    for (i = 0; i < num; i++, ptr += 2) {
+	c1 = xtoi[(unsigned char) ptr[0]];
+	c2 = xtoi[(unsigned char) ptr[1]];
+	bad |= c1 | c2;
+	field[i] = (c1 << 4) | (c2 & 0xf);
+    }
+    return bad < 0 ? -1 : 0;
+}
+
 Code_t
 ZReadAscii32(char *ptr,
 	     int len,
@@ -64,9 +108,11 @@ ZReadAscii32(char *ptr,
     unsigned char buf[4];
     Code_t retval;
 
-    retval = ZReadAscii(ptr, len, buf, 4);
-    if (retval != ZERR_NONE)
-	return retval;
+    if (read_plain_hex(ptr, len, buf, 4) < 0) {
+	retval = ZReadAscii(ptr, len, buf, 4);
+	if (retval != ZERR_NONE)
+	    return retval;
+    }
     *value_ptr = (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
     return ZERR_NONE;
 }
@@ -79,9 +125,11 @@ ZReadAscii16(char *ptr,
     unsigned char buf[2];
     Code_t retval;
 
-    retval = ZReadAscii(ptr, len, buf, 2);
-    if (retval != ZERR_NONE)
-	return retval;
+    if (read_plain_hex(ptr, len, buf, 2) < 0) {
+	retval = ZReadAscii(ptr, len, buf, 2);
+	if (retval != ZERR_NONE)
+	    return retval;
+    }
     *value_ptr = (buf[0] << 8) | buf[1];
     return ZERR_NONE;
 }
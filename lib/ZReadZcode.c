@@ -24,7 +24,7 @@ ZReadZcode(unsigned char *ptr,
 	   int max,
 	   int *len)
 {
-    int n = 0;
+    int n = 0, run;
 
     if (*ptr++ != 'Z')
         return ZERR_BADFIELD;
@@ -38,7 +38,13 @@ ZReadZcode(unsigned char *ptr,
                 default:   return ZERR_BADFIELD;
             }
         } else {
-            field[n++] = *ptr++;
+            /* Copy everything up to the next escape or the end. */
+            run = strcspn((char *)ptr, "\377");
+            if (run > max - n)
+                run = max - n;
+            (void) memcpy(field + n, ptr, run);
+            n += run;
+            ptr += run;
         }
     }
     if (*ptr)
@@ -20,9 +20,7 @@ Code_t
 ZReceiveNotice(ZNotice_t *notice,
 	       struct sockaddr_in *from)
 {
-    char *buffer;
     struct _Z_InputQ *nextq;
-    int len, auth;
     Code_t retval;
 
     if ((retval = Z_WaitForComplete()) != ZERR_NONE)
@@ -32,21 +30,5 @@ ZReceiveNotice(ZNotice_t *notice,
     if (!nextq)
       return (ENOMEM);
 
-    len = nextq->packet_len;
-    
-    if (!(buffer = (char *) malloc((unsigned) len)))
-	return (ENOMEM);
-
-    if (from)
-	*from = nextq->from;
-    
-    (void) memcpy(buffer, nextq->packet, len);
-
-    auth = nextq->auth;
-    Z_RemQueue(nextq);
-    
-    if ((retval = ZParseNotice(buffer, len, notice)) != ZERR_NONE)
-	return (retval);
-    notice->z_checked_auth = auth;
-    return ZERR_NONE;
+    return (Z_TakeQueued(nextq, notice, from));
 }
@@ -33,20 +33,28 @@ ZSrvSendList(ZNotice_t *notice,
 {
     Code_t retval;
     ZNotice_t newnotice;
-    char *buffer;
-    int len;
-
-    if ((retval = ZFormatNoticeList(notice, list, nitems, &buffer, 
-				    &len, cert_routine)) != ZERR_NONE)
-	return (retval);
-
-    if ((retval = ZParseNotice(buffer, len, &newnotice)) != ZERR_NONE)
-	return (retval);
-    
-    retval = Z_SendFragmentedNotice(&newnotice, len, cert_routine,
-				    send_routine);
-
-    free(buffer);
+    char stackbuf[Z_SENDBUFLEN], *buffer = stackbuf;
+    int i, buflen, len;
+
+    /* As in ZSrvSendNotice(), size the buffer before formatting. */
+    buflen = Z_MAXHEADERLEN;
+    for (i = 0; i < nitems; i++)
+	buflen += strlen(list[i]) + 1;
+    if (buflen <= (int) sizeof(stackbuf))
+	buflen = sizeof(stackbuf);
+    else if (!(buffer = (char *) malloc((unsigned) buflen)))
+	return (ENOMEM);
+
+    retval = ZFormatNoticeListInto(notice, list, nitems, buffer, buflen,
+				   &len, cert_routine);
+    if (retval == ZERR_NONE)
+	retval = ZParseNotice(buffer, len, &newnotice);
+    if (retval == ZERR_NONE)
+	retval = Z_SendFragmentedNotice(&newnotice, len, cert_routine,
+					send_routine);
+
+    if (buffer != stackbuf)
+	free(buffer);
 
     return (retval);
 }
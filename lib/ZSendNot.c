@@ -31,23 +31,27 @@ ZSrvSendNotice(ZNotice_t *notice,
 {    
     Code_t retval;
     ZNotice_t newnotice;
-    char *buffer;
-    int len;
-
-    if ((retval = ZFormatNotice(notice, &buffer, &len, 
-				cert_routine)) != ZERR_NONE)
-	return (retval);
-
-    if ((retval = ZParseNotice(buffer, len, &newnotice)) != ZERR_NONE) {
+    char stackbuf[Z_SENDBUFLEN], *buffer = stackbuf;
+    int buflen, len;
+
+    /* Only a notice too big for the stack buffer costs a malloc().  Size
+       the buffer up front, so that the header and any authenticator are
+       made just once. */
+    buflen = Z_MAXHEADERLEN + notice->z_message_len;
+    if (buflen <= (int) sizeof(stackbuf))
+	buflen = sizeof(stackbuf);
+    else if (!(buffer = (char *) malloc((unsigned) buflen)))
+	return (ENOMEM);
+
+    retval = ZFormatNoticeInto(notice, buffer, buflen, &len, cert_routine);
+    if (retval == ZERR_NONE)
+	retval = ZParseNotice(buffer, len, &newnotice);
+    if (retval == ZERR_NONE)
+	retval = Z_SendFragmentedNotice(&newnotice, len, cert_routine,
+					send_routine);
+
+    if (buffer != stackbuf)
 	free(buffer);
-	return (retval);
-    }
-
-    
-    retval = Z_SendFragmentedNotice(&newnotice, len, cert_routine,
-				    send_routine);
-
-    free(buffer);
 
     return (retval);
 }
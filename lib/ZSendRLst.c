@@ -30,19 +30,26 @@ Code_t ZSrvSendRawList(ZNotice_t *notice,
 {
     Code_t retval;
     ZNotice_t newnotice;
-    char *buffer;
-    int len;
-
-    if ((retval = ZFormatRawNoticeList(notice, list, nitems, &buffer, 
-				       &len)) != ZERR_NONE)
-	return (retval);
-
-    if ((retval = ZParseNotice(buffer, len, &newnotice)) != ZERR_NONE)
-	return (retval);
-    
-    retval = Z_SendFragmentedNotice(&newnotice, len, NULL, send_routine);
-
-    free(buffer);
+    char stackbuf[Z_SENDBUFLEN], *buffer = stackbuf;
+    int i, buflen, len;
+
+    buflen = Z_MAXHEADERLEN;
+    for (i = 0; i < nitems; i++)
+	buflen += strlen(list[i]) + 1;
+    if (buflen <= (int) sizeof(stackbuf))
+	buflen = sizeof(stackbuf);
+    else if (!(buffer = (char *) malloc((unsigned) buflen)))
+	return (ENOMEM);
+
+    retval = ZFormatRawNoticeListInto(notice, list, nitems, buffer, buflen,
+				      &len);
+    if (retval == ZERR_NONE)
+	retval = ZParseNotice(buffer, len, &newnotice);
+    if (retval == ZERR_NONE)
+	retval = Z_SendFragmentedNotice(&newnotice, len, NULL, send_routine);
+
+    if (buffer != stackbuf)
+	free(buffer);
 
     return (retval);
 }
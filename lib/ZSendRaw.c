@@ -21,19 +21,24 @@ ZSendRawNotice(ZNotice_t *notice)
 {
     Code_t retval;
     ZNotice_t newnotice;
-    char *buffer;
-    int len;
+    char stackbuf[Z_SENDBUFLEN], *buffer = stackbuf;
+    int buflen, len;
 
-    if ((retval = ZFormatRawNotice(notice, &buffer, &len)) !=
-	ZERR_NONE)
-	return (retval);
+    buflen = Z_MAXHEADERLEN + notice->z_message_len;
+    if (buflen <= (int) sizeof(stackbuf))
+	buflen = sizeof(stackbuf);
+    else if (!(buffer = (char *) malloc((unsigned) buflen)))
+	return (ENOMEM);
 
-    if ((retval = ZParseNotice(buffer, len, &newnotice)) != ZERR_NONE)
-	return (retval);
-    
-    retval = Z_SendFragmentedNotice(&newnotice, len, NULL, Z_XmitFragment);
+    retval = ZFormatRawNoticeInto(notice, buffer, buflen, &len);
+    if (retval == ZERR_NONE)
+	retval = ZParseNotice(buffer, len, &newnotice);
+    if (retval == ZERR_NONE)
+	retval = Z_SendFragmentedNotice(&newnotice, len, NULL,
+					Z_XmitFragment);
 
-    free(buffer);
+    if (buffer != stackbuf)
+	free(buffer);
 
     return (retval);
 }
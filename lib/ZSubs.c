@@ -17,8 +17,21 @@
 static const char rcsid_ZSubscriptions_c[] = "$Id$";
 #endif
 
+/* Number of subscription packets sent ahead of the server's acks. */
+#define Z_SUBS_WINDOW	8
+
+typedef struct _Z_SubsWindow {
+    ZUnique_Id_t uids[Z_SUBS_WINDOW];	/* packets awaiting the server */
+    int n;
+} Z_SubsWindow;
+
 static Code_t Z_SendAndWaitForServer(ZNotice_t *notice, char *buf, int len,
 				     int waitforack);
+static Code_t Z_SubsSend(ZNotice_t *notice, char **list, int nitems,
+			 Z_AuthProc cert_routine, Z_SendProc send_routine,
+			 Z_SubsWindow *window);
+static Code_t Z_SubsWait(Z_SubsWindow *window);
+static int Z_SubsPred(ZNotice_t *notice, void *window);
 
 #ifdef CMU_ZCTL_PUNT
 Code_t
@@ -69,6 +82,14 @@ ZCancelSubscriptions(unsigned int port)
  * This routine must do its own fragmentation.  Subscriptions must
  * not be broken across packet boundaries, or else the server will
  * mis-interpret them.
+ *
+ * With the library's own send routine, up to Z_SUBS_WINDOW packets
+ * are sent before waiting for the server to ack the oldest of them,
+ * rather than one round trip per packet.  Each packet is still acked
+ * by the hostmanager before the next one goes, and the hostmanager
+ * retransmits each one to the server on its own.  The first error
+ * stops any further packets from being sent; the acks for those
+ * already sent are collected before it is returned.
  */
 
 Code_t
@@ -92,6 +113,8 @@ ZSubscriptions(register ZSubscription_t *sublist,
     int size_avail = Z_MAXPKTLEN-Z_FRAGFUDGE-Z_FRAGFUDGE;
     int size, start, numok;
     Z_AuthProc cert_routine;
+    Z_SubsWindow window;
+    Code_t waitret;
 
     /* nitems = 0 means cancel all subscriptions; still need to allocate a */
     /* array for one item so we can cancel, however. */
@@ -145,6 +168,7 @@ ZSubscriptions(register ZSubscription_t *sublist,
     start = -1;
     i = 0;
     numok = 0;
+    window.n = 0;
     if (!nitems) {
 	/* there aren't really any, but we need to xmit anyway */
 	retval = ZSrvSendList(&notice, list, 0, cert_routine, send_routine);
@@ -168,24 +192,112 @@ ZSubscriptions(register ZSubscription_t *sublist,
 	}
 	if (!numok) {			/* a single subscription won't
 					   fit into one packet */
-	    free((char *)list);
-	    return(ZERR_FIELDLEN);
-	}
-	retval = ZSrvSendList(&notice, &list[start*3], numok * 3,
-			      cert_routine, send_routine);
-	if (retval) {
-	    free((char *)list);
-	    return(retval);
+	    retval = ZERR_FIELDLEN;
+	    break;
 	}
+	retval = Z_SubsSend(&notice, &list[start*3], numok * 3,
+			    cert_routine, send_routine, &window);
+	if (retval)
+	    break;
 	start = -1;
     }
-    if (numok)
-	retval = ZSrvSendList(&notice, &list[start*3], numok * 3,
-			      cert_routine, send_routine);
+    if (i == nitems && numok)
+	retval = Z_SubsSend(&notice, &list[start*3], numok * 3,
+			    cert_routine, send_routine, &window);
     free((char *)list);
+
+    /* Collect the outstanding acks, keeping the first error. */
+    while (window.n) {
+	waitret = Z_SubsWait(&window);
+	if (waitret != ZERR_NONE && retval == ZERR_NONE)
+	    retval = waitret;
+    }
     return(retval);
 }
 
+/*
+ * Send one packet's worth of subscriptions.  With the default send
+ * routine, don't wait for the server's ack unless the window is full.
+ */
+
+static Code_t
+Z_SubsSend(ZNotice_t *notice,
+	   char **list,
+	   int nitems,
+	   Z_AuthProc cert_routine,
+	   Z_SendProc send_routine,
+	   Z_SubsWindow *window)
+{
+    Code_t retval;
+
+    if (send_routine != Z_SendAndWaitForServer)
+	return (ZSrvSendList(notice, list, nitems, cert_routine,
+			     send_routine));
+
+    if (window->n == Z_SUBS_WINDOW) {
+	retval = Z_SubsWait(window);
+	if (retval != ZERR_NONE)
+	    return (retval);
+    }
+    /* This waits for the hostmanager's ack, but not the server's. */
+    retval = ZSrvSendList(notice, list, nitems, cert_routine,
+			  Z_XmitFragment);
+    if (retval != ZERR_NONE)
+	return (retval);
+    /* ZSrvSendList() left the uid of the packet it sent in notice. */
+    window->uids[window->n++] = notice->z_uid;
+    return (ZERR_NONE);
+}
+
+/*
+ * Wait for the server to ack or nak any packet in the window, and take
+ * it out.
+ */
+
+static Code_t
+Z_SubsWait(Z_SubsWindow *window)
+{
+    Code_t retval;
+    ZNotice_t retnotice;
+    int i;
+
+    if ((retval = ZIfNotice(&retnotice, (struct sockaddr_in *)0,
+			    Z_SubsPred, (char *)window)) != ZERR_NONE) {
+	/* Nothing more can be expected for the rest. */
+	window->n = 0;
+	return (retval);
+    }
+    for (i = 0; i < window->n; i++) {
+	if (ZCompareUID(&retnotice.z_uid, &window->uids[i])) {
+	    window->uids[i] = window->uids[--window->n];
+	    break;
+	}
+    }
+    if (retnotice.z_kind == SERVNAK) {
+	ZFreeNotice(&retnotice);
+	return (ZERR_SERVNAK);
+    }
+    if (retnotice.z_kind != SERVACK) {
+	ZFreeNotice(&retnotice);
+	return (ZERR_INTERNAL);
+    }
+    ZFreeNotice(&retnotice);
+    return (ZERR_NONE);
+}
+
+static int
+Z_SubsPred(ZNotice_t *notice,
+	   void *arg)
+{
+    Z_SubsWindow *window = (Z_SubsWindow *)arg;
+    int i;
+
+    for (i = 0; i < window->n; i++)
+	if (ZCompareUID(&notice->z_uid, &window->uids[i]))
+	    return (1);
+    return (0);
+}
+
 static Code_t
 Z_SendAndWaitForServer(ZNotice_t *notice,
 		       char *buf, int len,
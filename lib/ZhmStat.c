@@ -1,5 +1,5 @@
 /* This file is part of the Project Athena Zephyr Notification System.
- * It contains the ZhmStat() function.
+ * It contains the ZhmStat() and ZhmStatDetail() functions.
  *
  *      Created by:     Marc Horowitz
  *
@@ -17,9 +17,31 @@
 #define INADDR_LOOPBACK 0x7f000001
 #endif
 
+static Code_t hm_stat_request(struct in_addr *, char *, ZNotice_t *);
+
 Code_t
 ZhmStat(struct in_addr *hostaddr,
 	ZNotice_t *notice)
+{
+    return (hm_stat_request(hostaddr, HM_GIMMESTATS, notice));
+}
+
+/*
+ * Ask for the hostmanager's detailed statistics, one "name=value"
+ * line per field.  A hostmanager that doesn't know the request sends
+ * its ordinary statistics instead.
+ */
+Code_t
+ZhmStatDetail(struct in_addr *hostaddr,
+	      ZNotice_t *notice)
+{
+    return (hm_stat_request(hostaddr, HM_GIMMEDETAIL, notice));
+}
+
+static Code_t
+hm_stat_request(struct in_addr *hostaddr,
+		char *opcode,
+		ZNotice_t *notice)
 {
     struct servent *sp;
     struct sockaddr_in sin;
@@ -27,6 +49,7 @@ ZhmStat(struct in_addr *hostaddr,
     Code_t code;
     struct timeval tv;
     fd_set readers;
+    time_t deadline;
 
     (void) memset((char *)&sin, 0, sizeof(struct sockaddr_in));
 
@@ -45,7 +68,7 @@ ZhmStat(struct in_addr *hostaddr,
     req.z_port = 0;
     req.z_class = HM_STAT_CLASS;
     req.z_class_inst = HM_STAT_CLIENT;
-    req.z_opcode = HM_GIMMESTATS;
+    req.z_opcode = opcode;
     req.z_sender = "";
     req.z_recipient = "";
     req.z_default_format = "";
@@ -57,16 +80,25 @@ ZhmStat(struct in_addr *hostaddr,
     if ((code = ZSendNotice(&req, ZNOAUTH)) != ZERR_NONE)
 	return(code);
 
-    /* Wait up to ten seconds for a response. */
-    FD_ZERO(&readers);
-    FD_SET(ZGetFD(), &readers);
-    tv.tv_sec = 10;
-    tv.tv_usec = 0;
-    code = select(ZGetFD() + 1, &readers, NULL, NULL, &tv);
-    if (code < 0 && errno != EINTR)
-	return(errno);
-    if (code == 0 || (code < 0 && errno == EINTR) || ZPending() == 0)
-	return(ZERR_HMDEAD);
+    /* Wait up to ten seconds for a response, which may come in
+       several fragments. */
+    deadline = time(NULL) + 10;
+    do {
+	FD_ZERO(&readers);
+	FD_SET(ZGetFD(), &readers);
+	tv.tv_sec = deadline - time(NULL);
+	tv.tv_usec = 0;
+	if (tv.tv_sec <= 0)
+	    return(ZERR_HMDEAD);
+	code = select(ZGetFD() + 1, &readers, NULL, NULL, &tv);
+	if (code < 0 && errno != EINTR)
+	    return(errno);
+	if (code == 0 || (code < 0 && errno == EINTR))
+	    return(ZERR_HMDEAD);
+	code = ZPending();
+	if (code < 0)
+	    return(errno);
+    } while (code == 0);
 
     return(ZReceiveNotice(notice, (struct sockaddr_in *) 0));
 }
@@ -11,6 +11,7 @@
  *	"mit-copyright.h".
  */
 
+#define _GNU_SOURCE		/* for recvmmsg() */
 #include <internal.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
@@ -112,81 +113,163 @@ void *__Z_debug_print_closure;
 
 static int Z_AddField(char **ptr, char *field, char *end);
 static int find_or_insert_uid(ZUnique_Id_t *uid, ZNotice_Kind_t kind);
+static Code_t Z_ReadPacket(char *packet, int packet_len,
+			   struct sockaddr_in *from);
 static Code_t Z_ZcodeFormatRawHeader(ZNotice_t *, char *, int, int *, char **,
 				     int *, char **, char **, int cksumstyle,
 				     int addrstyle);
 
-/* Find or insert uid in the old uids buffer.  The buffer is a sorted
- * circular queue.  We make the assumption that most packets arrive in
- * order, so we can usually search for a uid or just tack it onto the end.
- * The first entry at at buffer[start], the last is at
- * buffer[(start + num - 1) % size] */
+/* The old uids filter.  The uids are kept in arrival order in a
+ * circular queue, so that they can be aged off the front, and are
+ * chained by hash through the queue so that a lookup doesn't have to
+ * scan it.  Entries are numbered by sequence rather than slot: the
+ * first is sequence number start, the last start + num - 1, and
+ * sequence number n lives in buffer[n % size].  An entry that is found
+ * again is marked dead and a fresh copy added at the end, rather than
+ * moving everything behind it up; dead entries are simply dropped
+ * when they reach the front. */
+
+static struct _filter {
+    ZUnique_Id_t	uid;
+    ZNotice_Kind_t	kind;
+    time_t		t;
+    long		next;		/* next in hash chain, or -1 */
+    int			live;		/* on a hash chain */
+} *filter_buffer;
+static long filter_size;
+static long filter_start;
+static long filter_num;
+static long *filter_heads;		/* hash chain heads, or -1 */
+static unsigned long filter_mask;	/* hash table size - 1 */
+
+static unsigned long
+uid_hash(ZUnique_Id_t *uid,
+	 ZNotice_Kind_t kind)
+{
+    unsigned char *p = (unsigned char *) uid;
+    unsigned long h = kind;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(*uid); i++)
+	h = h * 31 + p[i];
+    return h ^ (h >> 16);
+}
+
+static unsigned long
+filter_hash(ZUnique_Id_t *uid,
+	    ZNotice_Kind_t kind)
+{
+    return uid_hash(uid, kind) & filter_mask;
+}
+
+/* Take a live entry off its hash chain. */
+static void
+filter_unlink(long seq)
+{
+    struct _filter *f = &filter_buffer[seq % filter_size];
+    long *linkp = &filter_heads[filter_hash(&f->uid, f->kind)];
+
+    while (*linkp != seq)
+	linkp = &filter_buffer[*linkp % filter_size].next;
+    *linkp = f->next;
+    f->live = 0;
+}
+
+/* Size the filter for at least new_size uids, rebuilding the chains. */
+static int
+filter_resize(long new_size)
+{
+    struct _filter *new;
+    long *heads, seq;
+    unsigned long hsize;
+
+    new = (struct _filter *) malloc(new_size * sizeof(*new));
+    if (!new)
+	return 0;
+    for (hsize = 1; hsize < (unsigned long) new_size; hsize <<= 1)
+	;
+    heads = (long *) malloc(hsize * sizeof(*heads));
+    if (!heads) {
+	free(new);
+	return 0;
+    }
+    memset(heads, 0xff, hsize * sizeof(*heads));	/* all -1 */
+
+    for (seq = filter_start; seq < filter_start + filter_num; seq++)
+	new[seq % new_size] = filter_buffer[seq % filter_size];
+    free(filter_buffer);
+    free(filter_heads);
+    filter_buffer = new;
+    filter_size = new_size;
+    filter_heads = heads;
+    filter_mask = hsize - 1;
+
+    for (seq = filter_start; seq < filter_start + filter_num; seq++) {
+	struct _filter *f = &filter_buffer[seq % filter_size];
+	unsigned long h;
+
+	if (!f->live)
+	    continue;
+	h = filter_hash(&f->uid, f->kind);
+	f->next = filter_heads[h];
+	filter_heads[h] = seq;
+    }
+    return 1;
+}
+
+/* Find or insert uid in the old uids filter.  Returns 1 if it was
+ * there already; either way it is added afresh at the end. */
 static int
 find_or_insert_uid(ZUnique_Id_t *uid,
 		   ZNotice_Kind_t kind)
 {
-    static struct _filter {
-	ZUnique_Id_t	uid;
-	ZNotice_Kind_t	kind;
-	time_t		t;
-    } *buffer;
-    static long size;
-    static long start;
-    static long num;
-
+    struct _filter *f;
     time_t now;
-    struct _filter *new;
-    long i, j, new_size;
-    int result, found = 0;
+    unsigned long h;
+    long seq, *linkp;
+    int found = 0;
 
     /* Initialize the uid buffer if it hasn't been done already. */
-    if (!buffer) {
-	size = Z_INITFILTERSIZE;
-	buffer = (struct _filter *) malloc(size * sizeof(*buffer));
-	if (!buffer)
-	    return 0;
-    }
+    if (!filter_buffer && !filter_resize(Z_INITFILTERSIZE))
+	return 0;
 
     /* Age the uid buffer, discarding any uids older than the time limit. */
     time(&now);
-    while (num && (now - buffer[start % size].t) > Z_FILTERTIMELIMIT)
-	start++, num--;
-    start %= size;
-
-    /* Make room for a new uid, since we'll probably have to insert one. */
-    if (num == size) {
-	new_size = size * 2 + 2;
-	new = (struct _filter *) malloc(new_size * sizeof(*new));
-	if (!new)
-	    return 0;
-	for (i = 0; i < num; i++)
-	    new[i] = buffer[(start + i) % size];
-	free(buffer);
-	buffer = new;
-	size = new_size;
-	start = 0;
+    while (filter_num) {
+	f = &filter_buffer[filter_start % filter_size];
+	if ((now - f->t) <= Z_FILTERTIMELIMIT)
+	    break;
+	if (f->live)
+	    filter_unlink(filter_start);
+	filter_start++, filter_num--;
     }
 
-    /* Search for this uid in the buffer, starting from the end. */
-    for (i = start + num - 1; i >= start; i--) {
-	result = memcmp(uid, &buffer[i % size].uid, sizeof(*uid));
-	if (result == 0 && buffer[i % size].kind == kind) {
-	    /* Remove it from the buffer. We'll re-add it at the end. */
-	    for (j = i; j < start + num - 1; j++) {
-		buffer[j % size] = buffer[(j + 1) % size];
-	    }
-	    num--;
+    /* Make room for a new uid, since we'll have to insert one. */
+    if (filter_num == filter_size && !filter_resize(filter_size * 2 + 2))
+	return 0;
+
+    /* Look for this uid, and retire the old entry if it's there. */
+    h = filter_hash(uid, kind);
+    for (linkp = &filter_heads[h]; *linkp != -1; linkp = &f->next) {
+	f = &filter_buffer[*linkp % filter_size];
+	if (f->kind == kind && memcmp(uid, &f->uid, sizeof(*uid)) == 0) {
+	    *linkp = f->next;
+	    f->live = 0;
 	    found = 1;
 	    break;
-        }
+	}
     }
 
     /* Whether or not we found it, stick it at the end. */
-    i = start + num;
-    buffer[i % size].uid = *uid;
-    buffer[i % size].kind = kind;
-    buffer[i % size].t = now;
-    num++;
+    seq = filter_start + filter_num;
+    f = &filter_buffer[seq % filter_size];
+    f->uid = *uid;
+    f->kind = kind;
+    f->t = now;
+    f->live = 1;
+    f->next = filter_heads[h];
+    filter_heads[h] = seq;
+    filter_num++;
 
     return found;
 }
@@ -225,24 +308,215 @@ Z_WaitForComplete(void)
 }
 
 
-/* Read any available packets and enqueue them */
+/*
+ * Read any available packets and enqueue them.  Rather than select()
+ * before each packet, read with MSG_DONTWAIT until the socket is
+ * empty, several packets at a time where recvmmsg() is available.
+ */
+
+#define Z_READBATCH	16	/* packets per recvmmsg() */
 
 Code_t
 Z_ReadEnqueue(void)
 {
     Code_t retval;
+#ifdef MSG_DONTWAIT
+#ifdef HAVE_RECVMMSG
+    ZPacket_t packets[Z_READBATCH];
+    struct sockaddr_in from[Z_READBATCH];
+    struct mmsghdr msgs[Z_READBATCH];
+    struct iovec iov[Z_READBATCH];
+    Code_t firsterr;
+    int i, n;
+#else
+    ZPacket_t packet;
+    struct sockaddr_in from;
+    unsigned int from_len;
+    int packet_len;
+#endif
+#endif
 
     if (ZGetFD() < 0)
 	return (ZERR_NOPORT);
 
+#ifdef MSG_DONTWAIT
+#ifdef HAVE_RECVMMSG
+    for (;;) {
+	(void) memset((char *)msgs, 0, sizeof(msgs));
+	for (i = 0; i < Z_READBATCH; i++) {
+	    iov[i].iov_base = packets[i];
+	    iov[i].iov_len = sizeof(packets[i]);
+	    msgs[i].msg_hdr.msg_iov = &iov[i];
+	    msgs[i].msg_hdr.msg_iovlen = 1;
+	    msgs[i].msg_hdr.msg_name = &from[i];
+	    msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+	}
+	n = recvmmsg(ZGetFD(), msgs, Z_READBATCH, MSG_DONTWAIT, NULL);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return (ZERR_NONE);
+	    return (errno);
+	}
+
+	/* The packets are off the socket now; don't drop the rest of
+	   the batch because one of them was bad. */
+	firsterr = ZERR_NONE;
+	for (i = 0; i < n; i++) {
+	    if (msgs[i].msg_len == 0)
+		retval = ZERR_EOF;
+	    else
+		retval = Z_ReadPacket(packets[i], msgs[i].msg_len, &from[i]);
+	    if (retval != ZERR_NONE && firsterr == ZERR_NONE)
+		firsterr = retval;
+	}
+	if (firsterr != ZERR_NONE)
+	    return (firsterr);
+
+	/* A short batch means we emptied the socket. */
+	if (n < Z_READBATCH)
+	    return (ZERR_NONE);
+    }
+#else /* HAVE_RECVMMSG */
+    for (;;) {
+	from_len = sizeof(struct sockaddr_in);
+	packet_len = recvfrom(ZGetFD(), packet, sizeof(packet), MSG_DONTWAIT,
+			      (struct sockaddr *)&from, &from_len);
+	if (packet_len < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return (ZERR_NONE);
+	    return (errno);
+	}
+	if (!packet_len)
+	    return (ZERR_EOF);
+	if ((retval = Z_ReadPacket(packet, packet_len, &from)) != ZERR_NONE)
+	    return (retval);
+    }
+#endif /* HAVE_RECVMMSG */
+#else /* MSG_DONTWAIT */
     while (Z_PacketWaiting())
 	if ((retval = Z_ReadWait()) != ZERR_NONE)
 	    return (retval);
 
     return (ZERR_NONE);
+#endif /* MSG_DONTWAIT */
 }
 
 
+/*
+ * Besides the __Q_Head list, which is in arrival order, every queue
+ * entry is in a hash table by (uid, kind), and entries still waiting
+ * for fragments (those with timep set) are on an expiry list in the
+ * order they were last touched.  Entries are also put on a ready list
+ * in the order they are completed, from which ZDispatch() takes them.
+ */
+
+static struct _Z_InputQ *Q_Hash[Z_QHASHSIZE];
+static struct _Z_InputQ *Q_ExpHead, *Q_ExpTail;
+static struct _Z_InputQ *Q_ReadyHead, *Q_ReadyTail;
+
+#define Q_HASH(uid, kind)	(uid_hash(uid, kind) % Z_QHASHSIZE)
+
+void
+Z_InitQueue(void)
+{
+    __Q_Head = __Q_Tail = NULL;
+    Q_ExpHead = Q_ExpTail = NULL;
+    Q_ReadyHead = Q_ReadyTail = NULL;
+    (void) memset((char *)Q_Hash, 0, sizeof(Q_Hash));
+}
+
+/* Mark an entry as touched now, moving it to the end of the expiry list. */
+static void
+Q_Touch(struct _Z_InputQ *qptr,
+	unsigned long now)
+{
+    if (qptr->timep) {
+	if (qptr == Q_ExpTail) {
+	    qptr->timep = now;
+	    return;
+	}
+	if (qptr->exp_prev)
+	    qptr->exp_prev->exp_next = qptr->exp_next;
+	else
+	    Q_ExpHead = qptr->exp_next;
+	qptr->exp_next->exp_prev = qptr->exp_prev;
+    }
+    qptr->timep = now;
+    qptr->exp_next = NULL;
+    qptr->exp_prev = Q_ExpTail;
+    if (Q_ExpTail)
+	Q_ExpTail->exp_next = qptr;
+    else
+	Q_ExpHead = qptr;
+    Q_ExpTail = qptr;
+}
+
+/* Take an entry off the expiry list; it won't time out anymore. */
+static void
+Q_Untouch(struct _Z_InputQ *qptr)
+{
+    if (!qptr->timep)
+	return;
+    if (qptr->exp_prev)
+	qptr->exp_prev->exp_next = qptr->exp_next;
+    else
+	Q_ExpHead = qptr->exp_next;
+    if (qptr->exp_next)
+	qptr->exp_next->exp_prev = qptr->exp_prev;
+    else
+	Q_ExpTail = qptr->exp_prev;
+    qptr->timep = 0;
+}
+
+/* Put a newly completed entry on the end of the ready list. */
+static void
+Q_Ready(struct _Z_InputQ *qptr)
+{
+    qptr->ready = 1;
+    qptr->ready_next = NULL;
+    qptr->ready_prev = Q_ReadyTail;
+    if (Q_ReadyTail)
+	Q_ReadyTail->ready_next = qptr;
+    else
+	Q_ReadyHead = qptr;
+    Q_ReadyTail = qptr;
+}
+
+static void
+Q_Unready(struct _Z_InputQ *qptr)
+{
+    if (!qptr->ready)
+	return;
+    if (qptr->ready_prev)
+	qptr->ready_prev->ready_next = qptr->ready_next;
+    else
+	Q_ReadyHead = qptr->ready_next;
+    if (qptr->ready_next)
+	qptr->ready_next->ready_prev = qptr->ready_prev;
+    else
+	Q_ReadyTail = qptr->ready_prev;
+    qptr->ready = 0;
+}
+
+/*
+ * Take the oldest entry off the ready list.  It stays in the queue,
+ * but won't be returned here again.
+ */
+
+struct _Z_InputQ *
+Z_GetReady(void)
+{
+    struct _Z_InputQ *qptr = Q_ReadyHead;
+
+    if (qptr)
+	Q_Unready(qptr);
+    return (qptr);
+}
+
 /*
  * Search the queue for a notice with the proper multiuid - remove any
  * notices that haven't been touched in a while
@@ -253,21 +527,17 @@ Z_SearchQueue(ZUnique_Id_t *uid,
 	      ZNotice_Kind_t kind)
 {
     register struct _Z_InputQ *qptr;
-    struct _Z_InputQ *next;
     struct timeval tv;
 
     (void) gettimeofday(&tv, (struct timezone *)0);
 
-    qptr = __Q_Head;
+    while (Q_ExpHead &&
+	   Q_ExpHead->timep+Z_NOTICETIMELIMIT < (unsigned long)tv.tv_sec)
+	Z_RemQueue(Q_ExpHead);
 
-    while (qptr) {
+    for (qptr = Q_Hash[Q_HASH(uid, kind)]; qptr; qptr = qptr->hash_next) {
 	if (ZCompareUID(uid, &qptr->uid) && qptr->kind == kind)
 	    return (qptr);
-	next = qptr->next;
-	if (qptr->timep &&
-            (qptr->timep+Z_NOTICETIMELIMIT < (unsigned long)tv.tv_sec))
-	    Z_RemQueue(qptr);
-	qptr = next;
     }
     return (NULL);
 }
@@ -284,17 +554,12 @@ Z_SearchQueue(ZUnique_Id_t *uid,
 Code_t
 Z_ReadWait(void)
 {
-    register struct _Z_InputQ *qptr;
-    ZNotice_t notice;
     ZPacket_t packet;
-    struct sockaddr_in olddest, from;
+    struct sockaddr_in from;
     unsigned int from_len;
-    int packet_len, zvlen, part, partof;
-    char *slash;
-    Code_t retval;
+    int packet_len;
     fd_set fds;
     struct timeval tv;
-    ZUnique_Id_t *multiuid;
 
     if (ZGetFD() < 0)
 	return (ZERR_NOPORT);
@@ -320,6 +585,25 @@ Z_ReadWait(void)
     if (!packet_len)
 	return (ZERR_EOF);
 
+    return (Z_ReadPacket(packet, packet_len, &from));
+}
+
+/* Parse a packet just read from the socket and add it to the queue. */
+
+static Code_t
+Z_ReadPacket(char *packet,
+	     int packet_len,
+	     struct sockaddr_in *from)
+{
+    register struct _Z_InputQ *qptr;
+    ZNotice_t notice;
+    struct sockaddr_in olddest;
+    int zvlen, part, partof;
+    char *slash;
+    Code_t retval;
+    ZUnique_Id_t *multiuid;
+    unsigned long hashval;
+
     /* Ignore obviously non-Zephyr packets. */
     zvlen = sizeof(ZVERSIONHDR) - 1;
     if (packet_len < zvlen || memcmp(packet, ZVERSIONHDR, zvlen) != 0) {
@@ -346,7 +630,7 @@ Z_ReadWait(void)
 	    tmpnotice.z_kind = CLIENTACK;
 	    tmpnotice.z_message_len = 0;
 	    olddest = __HM_addr;
-	    __HM_addr = from;
+	    __HM_addr = *from;
 	    retval = ZFormatSmallRawNotice(&tmpnotice, pkt, &len);
 	    if (retval == ZERR_NONE)
 		retval = ZSendPacket(pkt, len, 0);
@@ -358,7 +642,7 @@ Z_ReadWait(void)
 	    return(ZERR_NONE);
 
 	/* Check authentication on the notice. */
-	notice.z_checked_auth = ZCheckAuthentication(&notice, &from);
+	notice.z_checked_auth = ZCheckAuthentication(&notice, from);
     }
 
 
@@ -463,11 +747,16 @@ Z_ReadWait(void)
 
 
     /* Copy the from field, multiuid, kind, and checked authentication. */
-    qptr->from = from;
+    qptr->from = *from;
     qptr->uid = *multiuid;
     qptr->kind = notice.z_kind;
     qptr->auth = notice.z_checked_auth;
 
+    /* Index it, so that further fragments can find it. */
+    hashval = Q_HASH(&qptr->uid, qptr->kind);
+    qptr->hash_next = Q_Hash[hashval];
+    Q_Hash[hashval] = qptr;
+
     /*
      * If this is the first part of the notice, we take the header
      * from it.  We only take it if this is the first fragment so that
@@ -490,7 +779,6 @@ Z_ReadWait(void)
      */
     if (__Zephyr_server || (part == 0 && notice.z_message_len == partof)) {
 	__Q_CompleteLength++;
-	qptr->holelist = (struct _Z_Hole *) 0;
 	qptr->complete = 1;
 	/* allocate a msg buf for this piece */
 	if (notice.z_message_len == 0)
@@ -508,6 +796,11 @@ Z_ReadWait(void)
 	if(qptr->msg)
 	    (void) memcpy(qptr->packet+qptr->header_len, qptr->msg,
 			   qptr->msg_len);
+	if (!__Zephyr_server && (retval = Z_ParseQueued(qptr)) != ZERR_NONE) {
+	    Z_RemQueue(qptr);
+	    return (retval);
+	}
+	Q_Ready(qptr);
 	return (ZERR_NONE);
     }
 
@@ -525,12 +818,13 @@ Z_ReadWait(void)
      * initialize it to the full packet size.  Then insert the
      * current fragment.
      */
-    if (!(qptr->holelist = (struct _Z_Hole *)
-	  malloc(sizeof(struct _Z_Hole))))
+    qptr->holes_size = 4;
+    if (!(qptr->holes = (struct _Z_Hole *)
+	  malloc(qptr->holes_size * sizeof(struct _Z_Hole))))
 	return (ENOMEM);
-    qptr->holelist->next = (struct _Z_Hole *) 0;
-    qptr->holelist->first = 0;
-    qptr->holelist->last = partof-1;
+    qptr->nholes = 1;
+    qptr->holes[0].first = 0;
+    qptr->holes[0].last = partof-1;
     return (Z_AddNoticeToEntry(qptr, &notice, part));
 }
 
@@ -542,13 +836,14 @@ Z_AddNoticeToEntry(struct _Z_InputQ *qptr,
 		   ZNotice_t *notice,
 		   int part)
 {
-    int last, oldfirst, oldlast;
-    struct _Z_Hole *hole, *lasthole;
+    int last, lo, hi, mid, nnew;
+    struct _Z_Hole pieces[2], *new;
+    Code_t retval;
     struct timeval tv;
 
     /* Make sure this notice is expirable */
     (void) gettimeofday(&tv, (struct timezone *)0);
-    qptr->timep = tv.tv_sec;
+    Q_Touch(qptr, tv.tv_sec);
 
     /* Bounds check. */
     if (part < 0 || notice->z_message_len < 0 || part > qptr->msg_len
@@ -563,71 +858,122 @@ Z_AddNoticeToEntry(struct _Z_InputQ *qptr,
 
     last = part+notice->z_message_len-1;
 
-    hole = qptr->holelist;
-    lasthole = (struct _Z_Hole *) 0;
-
     /* copy in the message body */
     (void) memcpy(qptr->msg+part, notice->z_message, notice->z_message_len);
 
-    /* Search for a hole that overlaps with the current fragment */
-    while (hole) {
-	if (part <= hole->last && last >= hole->first)
-	    break;
-	lasthole = hole;
-	hole = hole->next;
+    /* Find the first hole that ends at or after this fragment starts. */
+    lo = 0;
+    hi = qptr->nholes;
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (qptr->holes[mid].last < part)
+	    lo = mid + 1;
+	else
+	    hi = mid;
     }
 
-    /* If we found one, delete it and reconstruct a new hole */
-    if (hole) {
-	oldfirst = hole->first;
-	oldlast = hole->last;
-	if (lasthole)
-	    lasthole->next = hole->next;
-	else
-	    qptr->holelist = hole->next;
-	free((char *)hole);
-	/*
-	 * Now create new hole(s) that are the original hole without
-	 * the current fragment.
-	 */
-	if (part > oldfirst) {
-	    hole = (struct _Z_Hole *)malloc(sizeof(struct _Z_Hole));
-	    if (hole == NULL)
-		return ENOMEM;
-	    hole->first = oldfirst;
-	    hole->last = part-1;
-	    /* Prepend to the list; holelist is unordered. */
-	    hole->next = qptr->holelist;
-	    qptr->holelist = hole;
+    /*
+     * Holes lo through hi-1 overlap the fragment.  Replace them with
+     * what is left of them outside it: perhaps the front of the first
+     * and the back of the last.
+     */
+    for (hi = lo; hi < qptr->nholes && qptr->holes[hi].first <= last; hi++)
+	;
+    if (hi > lo) {
+	nnew = 0;
+	if (part > qptr->holes[lo].first) {
+	    pieces[nnew].first = qptr->holes[lo].first;
+	    pieces[nnew++].last = part-1;
+	}
+	if (last < qptr->holes[hi-1].last) {
+	    pieces[nnew].first = last+1;
+	    pieces[nnew++].last = qptr->holes[hi-1].last;
 	}
-	if (last < oldlast) {
-	    hole = (struct _Z_Hole *)malloc(sizeof(struct _Z_Hole));
-	    if (hole == NULL)
+	if (qptr->nholes - (hi - lo) + nnew > qptr->holes_size) {
+	    new = (struct _Z_Hole *) realloc(qptr->holes,
+					     qptr->holes_size * 2 *
+					     sizeof(struct _Z_Hole));
+	    if (new == NULL)
 		return ENOMEM;
-	    hole->first = last+1;
-	    hole->last = oldlast;
-	    /* Prepend to the list; holelist is unordered. */
-	    hole->next = qptr->holelist;
-	    qptr->holelist = hole;
+	    qptr->holes = new;
+	    qptr->holes_size *= 2;
 	}
+	(void) memmove(&qptr->holes[lo + nnew], &qptr->holes[hi],
+		       (qptr->nholes - hi) * sizeof(struct _Z_Hole));
+	(void) memcpy(&qptr->holes[lo], pieces, nnew * sizeof(struct _Z_Hole));
+	qptr->nholes += nnew - (hi - lo);
     }
 
-    if (!qptr->holelist) {
-	if (!qptr->complete)
-	    __Q_CompleteLength++;
+    /* A duplicate fragment of a complete notice changes nothing. */
+    if (!qptr->nholes && !qptr->complete) {
+	__Q_CompleteLength++;
 	qptr->complete = 1;
-	qptr->timep = 0;		/* don't time out anymore */
+	Q_Untouch(qptr);		/* don't time out anymore */
 	qptr->packet_len = qptr->header_len+qptr->msg_len;
 	if (!(qptr->packet = (char *) malloc((unsigned) qptr->packet_len)))
 	    return (ENOMEM);
 	(void) memcpy(qptr->packet, qptr->header, qptr->header_len);
 	(void) memcpy(qptr->packet+qptr->header_len, qptr->msg,
 		       qptr->msg_len);
+	if (!__Zephyr_server && (retval = Z_ParseQueued(qptr)) != ZERR_NONE) {
+	    Z_RemQueue(qptr);
+	    return (retval);
+	}
+	Q_Ready(qptr);
     }
 
     return (ZERR_NONE);
 }
 
+/*
+ * Parse the packet of a complete queue entry into qptr->notice, unless
+ * that has been done already.  Clients have this done as each notice
+ * is completed, so that predicates can look at it without reparsing.
+ * The notice points into qptr->packet.
+ */
+
+Code_t
+Z_ParseQueued(struct _Z_InputQ *qptr)
+{
+    Code_t retval;
+
+    if (qptr->parsed)
+	return (ZERR_NONE);
+    retval = ZParseNotice(qptr->packet, qptr->packet_len, &qptr->notice);
+    if (retval != ZERR_NONE)
+	return (retval);
+    qptr->notice.z_checked_auth = qptr->auth;
+    qptr->parsed = 1;
+    return (ZERR_NONE);
+}
+
+/*
+ * Remove a complete entry from the queue and give its notice to the
+ * caller.  The packet buffer goes along with it rather than being
+ * copied; the caller frees it with ZFreeNotice().  The entry is
+ * removed even if it can't be parsed, so that it won't get in the way
+ * again.
+ */
+
+Code_t
+Z_TakeQueued(struct _Z_InputQ *qptr,
+	     ZNotice_t *notice,
+	     struct sockaddr_in *from)
+{
+    Code_t retval;
+
+    if ((retval = Z_ParseQueued(qptr)) != ZERR_NONE) {
+	Z_RemQueue(qptr);
+	return (retval);
+    }
+    *notice = qptr->notice;
+    if (from)
+	*from = qptr->from;
+    qptr->packet = NULL;
+    Z_RemQueue(qptr);
+    return (ZERR_NONE);
+}
+
 void
 Z_gettimeofday(struct _ZTimeval *ztv,
 	       struct timezone *tz)
@@ -638,6 +984,57 @@ Z_gettimeofday(struct _ZTimeval *ztv,
         ztv->tv_usec=tv.tv_usec;
 }
 
+/*
+ * Round trip estimation for retransmit timers, as TCP does it (Jacobson
+ * and Karels): srtt follows the samples with a gain of 1/8 and rttvar
+ * their mean deviation with a gain of 1/4, both in usec.  An srtt of 0
+ * means there have been no samples.
+ */
+void
+Z_RttSample(long *srtt,
+	    long *rttvar,
+	    long rtt)
+{
+    long delta;
+
+    if (!*srtt) {
+	*srtt = (rtt > 0) ? rtt : 1;
+	*rttvar = rtt / 2;
+	return;
+    }
+    delta = rtt - *srtt;
+    *srtt += delta / 8;
+    if (delta < 0)
+	delta = -delta;
+    *rttvar += (delta - *rttvar) / 4;
+}
+
+/*
+ * The timeout, in msec, after a transmission that has already been
+ * retransmitted retries times: the smoothed RTT plus four mean
+ * deviations, at least min_ms and doubling with each retransmission,
+ * but never more than max_ms, which is also the timeout until there
+ * have been samples.
+ */
+long
+Z_Rto(long srtt,
+      long rttvar,
+      long min_ms,
+      long max_ms,
+      int retries)
+{
+    long rto;
+
+    if (!srtt)
+	return max_ms;
+    rto = (srtt + 4 * rttvar) / 1000;
+    if (rto < min_ms)
+	rto = min_ms;
+    while (retries-- > 0 && rto < max_ms)
+	rto *= 2;
+    return (rto < max_ms) ? rto : max_ms;
+}
+
 Code_t
 Z_FormatHeader(ZNotice_t *notice,
 	       char *buffer,
@@ -1058,7 +1455,14 @@ Z_GetNextComplete(struct _Z_InputQ *qptr)
 void
 Z_RemQueue(struct _Z_InputQ *qptr)
 {
-    struct _Z_Hole *hole, *nexthole;
+    struct _Z_InputQ **hashp;
+
+    hashp = &Q_Hash[Q_HASH(&qptr->uid, qptr->kind)];
+    while (*hashp != qptr)
+	hashp = &(*hashp)->hash_next;
+    *hashp = qptr->hash_next;
+    Q_Untouch(qptr);
+    Q_Unready(qptr);
 
     if (qptr->complete)
 	__Q_CompleteLength--;
@@ -1072,12 +1476,8 @@ Z_RemQueue(struct _Z_InputQ *qptr)
     if (qptr->packet)
 	free(qptr->packet);
 
-    hole = qptr->holelist;
-    while (hole) {
-	nexthole = hole->next;
-	free((char *)hole);
-	hole = nexthole;
-    }
+    if (qptr->holes)
+	free((char *)qptr->holes);
 
     if (qptr == __Q_Head && __Q_Head == __Q_Tail) {
 	free ((char *)qptr);
@@ -0,0 +1,554 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It contains microbenchmarks for the libzephyr encode/decode primitives.
+ *
+ *	Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *	For copying and distribution information, see the file
+ *	"mit-copyright.h".
+ */
+
+/*
+ * bench_lib times the header formatting and parsing routines and the
+ * field codecs over a fixed corpus of representative notices, and
+ * prints ns/op and bytes/op for each.  With -o the results are saved
+ * as a baseline; with -b a previous baseline is read back and each
+ * benchmark is compared against it, and the exit status is nonzero if
+ * any of them got slower by more than the -x threshold.
+ *
+ * Any non-option arguments restrict the run to benchmarks whose names
+ * contain one of them.
+ */
+
+#include <zephyr/mit-copyright.h>
+#include <internal.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_MIN_TIME	200	/* msecs per measurement */
+#define DEFAULT_REPEAT		3	/* measurements per benchmark */
+#define DEFAULT_THRESHOLD	10	/* percent slowdown that fails -b */
+#define MAX_BENCH		64
+
+struct corpus {
+    char *name;
+    ZNotice_t notice;
+    ZPacket_t pkt;
+    int len;
+};
+
+struct bench {
+    char name[48];
+    void (*fn)(void *, long);
+    void *arg;
+    int bytes;			/* bytes processed per op */
+    double ns;			/* best ns/op measured */
+};
+
+struct field {
+    unsigned char *data;
+    int len;
+    char enc[Z_MAXPKTLEN];
+};
+
+static struct corpus corpora[5];
+static int ncorpora;
+static struct bench benches[MAX_BENCH];
+static int nbenches;
+static int min_time = DEFAULT_MIN_TIME;
+static int repeat = DEFAULT_REPEAT;
+
+static void usage(char *);
+static void init_corpora(void);
+static void add_bench(char *, char *, void (*)(void *, long), void *, int);
+static void run_bench(struct bench *);
+static int selected(struct bench *, int, char **);
+static int compare_baseline(char *, double);
+static void save_baseline(char *);
+
+int
+main(int argc,
+     char **argv)
+{
+    char *baseline = NULL, *output = NULL;
+    double threshold = DEFAULT_THRESHOLD;
+    int optchar, i, status = 0;
+
+    while ((optchar = getopt(argc, argv, "T:r:b:o:x:")) != EOF) {
+	switch (optchar) {
+	  case 'T':
+	    min_time = atoi(optarg);
+	    break;
+	  case 'r':
+	    repeat = atoi(optarg);
+	    break;
+	  case 'b':
+	    baseline = optarg;
+	    break;
+	  case 'o':
+	    output = optarg;
+	    break;
+	  case 'x':
+	    threshold = atof(optarg);
+	    break;
+	  default:
+	    usage(argv[0]);
+	}
+    }
+    if (min_time < 1 || repeat < 1 || threshold < 0)
+	usage(argv[0]);
+
+    init_corpora();
+
+    printf("%-28s %12s %10s %10s\n", "benchmark", "ns/op", "bytes/op",
+	   "MB/s");
+    for (i = 0; i < nbenches; i++) {
+	if (!selected(&benches[i], argc - optind, argv + optind)) {
+	    benches[i].ns = -1;
+	    continue;
+	}
+	run_bench(&benches[i]);
+	printf("%-28s %12.1f %10d %10.1f\n", benches[i].name, benches[i].ns,
+	       benches[i].bytes, benches[i].bytes
+	       ? benches[i].bytes * 1000.0 / benches[i].ns : 0.0);
+	fflush(stdout);
+    }
+
+    if (output)
+	save_baseline(output);
+    if (baseline)
+	status = compare_baseline(baseline, threshold);
+    return status;
+}
+
+static void
+usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-T msecs] [-r repeat] [-o save-baseline] "
+	    "[-b baseline] [-x pct]\n\t[benchmark ...]\n", prog);
+    exit(1);
+}
+
+/*
+ * The primitives under test.  Each runs its operation n times.
+ */
+
+static void
+bench_parse(void *arg,
+	    long n)
+{
+    struct corpus *c = (struct corpus *) arg;
+    ZNotice_t notice;
+
+    while (n--) {
+	if (ZParseNotice(c->pkt, c->len, &notice) != ZERR_NONE)
+	    abort();
+    }
+}
+
+static void
+bench_format_header(void *arg,
+		    long n)
+{
+    struct corpus *c = (struct corpus *) arg;
+    ZPacket_t pkt;
+    int len;
+
+    while (n--) {
+	if (Z_FormatRawHeader(&c->notice, pkt, sizeof(pkt), &len,
+			      NULL, NULL) != ZERR_NONE)
+	    abort();
+    }
+}
+
+static void
+bench_format_notice(void *arg,
+		    long n)
+{
+    struct corpus *c = (struct corpus *) arg;
+    ZPacket_t pkt;
+    int len;
+
+    while (n--) {
+	if (ZFormatSmallRawNotice(&c->notice, pkt, &len) != ZERR_NONE)
+	    abort();
+    }
+}
+
+static void
+bench_make_ascii(void *arg,
+		 long n)
+{
+    struct field *f = (struct field *) arg;
+
+    while (n--) {
+	if (ZMakeAscii(f->enc, sizeof(f->enc), f->data, f->len) != ZERR_NONE)
+	    abort();
+    }
+}
+
+static void
+bench_read_ascii(void *arg,
+		 long n)
+{
+    struct field *f = (struct field *) arg;
+    unsigned char out[Z_MAXPKTLEN];
+
+    while (n--) {
+	if (ZReadAscii(f->enc, strlen(f->enc) + 1, out, f->len) != ZERR_NONE)
+	    abort();
+    }
+}
+
+static void
+bench_make_ascii32(void *arg,
+		   long n)
+{
+    char buf[16];
+
+    while (n--) {
+	if (ZMakeAscii32(buf, sizeof(buf), 0xdeadbeef ^ n) != ZERR_NONE)
+	    abort();
+    }
+}
+
+static void
+bench_read_ascii32(void *arg,
+		   long n)
+{
+    unsigned long val;
+
+    while (n--) {
+	if (ZReadAscii32("0xDEADBEEF", 11, &val) != ZERR_NONE)
+	    abort();
+    }
+}
+
+static void
+bench_make_zcode(void *arg,
+		 long n)
+{
+    struct field *f = (struct field *) arg;
+
+    while (n--) {
+	if (ZMakeZcode(f->enc, sizeof(f->enc), f->data, f->len) != ZERR_NONE)
+	    abort();
+    }
+}
+
+static void
+bench_read_zcode(void *arg,
+		 long n)
+{
+    struct field *f = (struct field *) arg;
+    unsigned char out[Z_MAXPKTLEN];
+    int len;
+
+    while (n--) {
+	if (ZReadZcode((unsigned char *) f->enc, out, sizeof(out), &len)
+	    != ZERR_NONE)
+	    abort();
+    }
+}
+
+#ifdef HAVE_KRB5
+static void
+bench_quad_cksum(void *arg,
+		 long n)
+{
+    struct field *f = (struct field *) arg;
+    static unsigned char seed[8] = "zephyr!";
+
+    while (n--)
+	(void) z_quad_cksum(f->data, NULL, f->len, 0, seed);
+}
+#endif
+
+static void
+bench_get_charset(void *arg,
+		  long n)
+{
+    while (n--) {
+	if (ZGetCharset("utf-8") != ZCHARSET_UTF_8)
+	    abort();
+    }
+}
+
+static void
+bench_transliterate(void *arg,
+		    long n)
+{
+    struct field *f = (struct field *) arg;
+    char *out;
+    int outlen;
+
+    while (n--) {
+	if (ZTransliterate((char *) f->data, f->len, "UTF-8", "ISO-8859-1",
+			   &out, &outlen) != ZERR_NONE)
+	    abort();
+	free(out);
+    }
+}
+
+/*
+ * Build the corpus: a personal message, a class message, a login, a
+ * subscription request and a class message that fills most of a
+ * packet, each the way a client would send it.
+ */
+static void
+make_corpus(char *name,
+	    char *class,
+	    char *inst,
+	    char *recip,
+	    char *opcode,
+	    char *msg,
+	    int msglen)
+{
+    struct corpus *c = &corpora[ncorpora++];
+    ZNotice_t *notice = &c->notice;
+
+    c->name = name;
+    memset(notice, 0, sizeof(*notice));
+    notice->z_kind = ACKED;
+    notice->z_port = htons(32769);
+    notice->z_uid.zuid_addr.s_addr = htonl(0x12001a2b);
+    notice->z_uid.tv.tv_sec = htonl(1760000000);
+    notice->z_uid.tv.tv_usec = htonl(123456);
+    notice->z_multiuid = notice->z_uid;
+    notice->z_multinotice = "";
+    notice->z_sender_sockaddr.ip4.sin_family = AF_INET;
+    notice->z_sender_sockaddr.ip4.sin_addr.s_addr = htonl(0x12001a2b);
+    notice->z_auth = 0;
+    notice->z_authent_len = 0;
+    notice->z_ascii_authent = "";
+    notice->z_class = class;
+    notice->z_class_inst = inst;
+    notice->z_opcode = opcode;
+    notice->z_sender = "jruser@ATHENA.MIT.EDU";
+    notice->z_recipient = recip;
+    notice->z_default_format = "Class $class, Instance $instance:\n"
+	"To: @bold($recipient) at $time $date\n"
+	"From: @bold{$1 <$sender>}\n\n$2";
+    notice->z_charset = ZCHARSET_UTF_8;
+    notice->z_message = msg;
+    notice->z_message_len = msglen;
+    if (ZFormatSmallRawNotice(notice, c->pkt, &c->len) != ZERR_NONE) {
+	fprintf(stderr, "bench_lib: can't format corpus notice %s\n", name);
+	exit(1);
+    }
+}
+
+static void
+init_corpora(void)
+{
+    static char personal[] = "Jane Random User\0"
+	"Are you coming to the meeting at 3?  I booked the usual room.";
+    static char login[] = "jruser-laptop.mit.edu\0"
+	"Mon Oct 19 14:00:00 2026\0pts/3";
+    static char subs[] = "message\0personal\0jruser@ATHENA.MIT.EDU\0"
+	"help\0*\0\0sipb\0*\0\0white-magic\0*\0\0zephyr-dev\0*\0\0"
+	"mail\0POP\0jruser@ATHENA.MIT.EDU\0login\0jruser@ATHENA.MIT.EDU\0*\0"
+	"filsrv\0*\0\0athena-ops\0*\0\0-c\0*\0\0";
+    static char classmsg[256], bigmsg[600];
+    static unsigned char binary[256], text[512], uid[sizeof(ZUnique_Id_t)];
+    static struct field f_uid, f_binary, f_text;
+    char *sig = "Jane Random User";
+    int i;
+
+    strcpy(classmsg, sig);
+    for (i = strlen(sig) + 1; i < sizeof(classmsg); i++)
+	classmsg[i] = "the quick brown fox jumps over the lazy dog. "[i % 45];
+    strcpy(bigmsg, sig);
+    for (i = strlen(sig) + 1; i < sizeof(bigmsg); i++)
+	bigmsg[i] = (i % 73) ? "lorem ipsum dolor sit amet "[i % 27] : '\n';
+
+    make_corpus("personal", "message", "personal",
+		"jruser@ATHENA.MIT.EDU", "", personal, sizeof(personal));
+    make_corpus("class", "help", "linux", "", "", classmsg,
+		sizeof(classmsg));
+    make_corpus("login", LOGIN_CLASS, "jruser@ATHENA.MIT.EDU", "",
+		EXPOSE_NETVIS, login, sizeof(login));
+    make_corpus("subscribe", ZEPHYR_CTL_CLASS, ZEPHYR_CTL_CLIENT, "",
+		CLIENT_SUBSCRIBE, subs, sizeof(subs));
+    make_corpus("large", "sipb", "zephyr.discuss", "", "", bigmsg,
+		sizeof(bigmsg));
+
+    for (i = 0; i < ncorpora; i++)
+	add_bench("parse", corpora[i].name, bench_parse, &corpora[i],
+		  corpora[i].len);
+    for (i = 0; i < ncorpora; i++)
+	add_bench("format_header", corpora[i].name, bench_format_header,
+		  &corpora[i], corpora[i].len - corpora[i].notice.z_message_len);
+    for (i = 0; i < ncorpora; i++)
+	add_bench("format_notice", corpora[i].name, bench_format_notice,
+		  &corpora[i], corpora[i].len);
+
+    /* A UID is the most common ZMakeAscii field; the binary blob has
+       plenty of bytes Zcode has to escape. */
+    memcpy(uid, &corpora[0].notice.z_uid, sizeof(uid));
+    for (i = 0; i < sizeof(binary); i++)
+	binary[i] = (i % 16 == 0) ? 0x00 : (i % 16 == 1) ? 0xff : i;
+    for (i = 0; i < sizeof(text) - 1; i++)
+	text[i] = (i % 8 == 7) ? 0xc3 : (i % 8 == 0 && i) ? 0xa9 : 'a' + i % 26;
+    text[sizeof(text) - 1] = 0;
+    f_uid.data = uid;
+    f_uid.len = sizeof(uid);
+    f_binary.data = binary;
+    f_binary.len = sizeof(binary);
+    f_text.data = text;
+    f_text.len = sizeof(text) - 1;
+    ZMakeAscii(f_uid.enc, sizeof(f_uid.enc), f_uid.data, f_uid.len);
+
+    add_bench("make_ascii", "uid", bench_make_ascii, &f_uid, f_uid.len);
+    add_bench("read_ascii", "uid", bench_read_ascii, &f_uid, f_uid.len);
+    add_bench("make_ascii32", NULL, bench_make_ascii32, NULL, 4);
+    add_bench("read_ascii32", NULL, bench_read_ascii32, NULL, 4);
+    ZMakeZcode(f_binary.enc, sizeof(f_binary.enc), f_binary.data,
+	       f_binary.len);
+    add_bench("make_zcode", "binary", bench_make_zcode, &f_binary,
+	      f_binary.len);
+    add_bench("read_zcode", "binary", bench_read_zcode, &f_binary,
+	      f_binary.len);
+#ifdef HAVE_KRB5
+    add_bench("quad_cksum", "binary", bench_quad_cksum, &f_binary,
+	      f_binary.len);
+#endif
+    add_bench("get_charset", NULL, bench_get_charset, NULL, 0);
+    add_bench("transliterate", "utf8", bench_transliterate, &f_text,
+	      f_text.len);
+}
+
+static void
+add_bench(char *op,
+	  char *variant,
+	  void (*fn)(void *, long),
+	  void *arg,
+	  int bytes)
+{
+    struct bench *b;
+
+    if (nbenches == MAX_BENCH)
+	abort();
+    b = &benches[nbenches++];
+    if (variant)
+	sprintf(b->name, "%s/%s", op, variant);
+    else
+	strcpy(b->name, op);
+    b->fn = fn;
+    b->arg = arg;
+    b->bytes = bytes;
+}
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Double the iteration count until one run takes at least min_time,
+ * then keep the best of repeat such runs.
+ */
+static void
+run_bench(struct bench *b)
+{
+    double start, elapsed, ns;
+    long n = 1;
+    int i;
+
+    for (;;) {
+	start = now_ns();
+	(*b->fn)(b->arg, n);
+	elapsed = now_ns() - start;
+	if (elapsed >= min_time * 1e6)
+	    break;
+	n *= 2;
+    }
+    b->ns = elapsed / n;
+    for (i = 1; i < repeat; i++) {
+	start = now_ns();
+	(*b->fn)(b->arg, n);
+	ns = (now_ns() - start) / n;
+	if (ns < b->ns)
+	    b->ns = ns;
+    }
+}
+
+static int
+selected(struct bench *b,
+	 int nnames,
+	 char **names)
+{
+    int i;
+
+    if (!nnames)
+	return 1;
+    for (i = 0; i < nnames; i++) {
+	if (strstr(b->name, names[i]))
+	    return 1;
+    }
+    return 0;
+}
+
+/*
+ * Baselines are text: one "name ns/op bytes/op" line per benchmark.
+ */
+static void
+save_baseline(char *fname)
+{
+    FILE *fp;
+    int i;
+
+    fp = fopen(fname, "w");
+    if (!fp) {
+	perror(fname);
+	exit(1);
+    }
+    for (i = 0; i < nbenches; i++) {
+	if (benches[i].ns >= 0)
+	    fprintf(fp, "%s %.2f %d\n", benches[i].name, benches[i].ns,
+		    benches[i].bytes);
+    }
+    fclose(fp);
+}
+
+static int
+compare_baseline(char *fname,
+		 double threshold)
+{
+    char line[256], name[64];
+    double ns, change;
+    int i, bytes, regressions = 0;
+    FILE *fp;
+
+    fp = fopen(fname, "r");
+    if (!fp) {
+	perror(fname);
+	return 1;
+    }
+    printf("\n%-28s %12s %12s %8s\n", "benchmark", "baseline", "current",
+	   "change");
+    while (fgets(line, sizeof(line), fp)) {
+	if (sscanf(line, "%63s %lf %d", name, &ns, &bytes) != 3)
+	    continue;
+	for (i = 0; i < nbenches; i++) {
+	    if (!strcmp(benches[i].name, name))
+		break;
+	}
+	if (i == nbenches || benches[i].ns < 0)
+	    continue;
+	change = (benches[i].ns - ns) * 100.0 / ns;
+	printf("%-28s %12.1f %12.1f %+7.1f%%%s\n", name, ns, benches[i].ns,
+	       change, (change > threshold) ? "  REGRESSION" : "");
+	if (change > threshold)
+	    regressions++;
+    }
+    fclose(fp);
+    if (regressions)
+	printf("%d benchmark%s slower than baseline by more than %.0f%%\n",
+	       regressions, (regressions == 1) ? "" : "s", threshold);
+    return regressions ? 1 : 0;
+}
@@ -14,7 +14,9 @@ import socket
 import ctypes
 import ctypes.util
 import time
+import random
 from ctypes import c_int, c_char, POINTER, c_char_p, sizeof
+from ctypes import c_ulong, c_ushort, c_void_p, create_string_buffer
 
 from zephyr_ctypes import *
 
@@ -62,6 +64,162 @@ def py_make_zcode(input):
     """reference ZMakeZcode expressed as python..."""
     return "Z" + input.replace("\xff", "\xff\xf1").replace("\0", "\xff\xf0")
 
+# The encoders below fill a buffer exactly as the C did, including what
+# they leave behind when it is too small, and return (ok, buffer).
+# SLOP bytes past the length given the C are checked as well.
+SLOP = 16
+FILL = "\xaa"
+
+def py_make_ascii_into(size, field):
+    """reference ZMakeAscii into a size byte buffer"""
+    buf = [FILL] * (size + SLOP)
+    ptr = 0
+    left = size
+    for i in range(len(field)):
+        if (i & 3) == 0:
+            if left < (i and 4 or 3):
+                return False, "".join(buf)
+            if i:
+                buf[ptr] = " "
+                ptr += 1
+                left -= 1
+            buf[ptr:ptr + 2] = "0x"
+            ptr += 2
+            left -= 2
+        if left < 3:
+            return False, "".join(buf)
+        buf[ptr:ptr + 2] = "%02X" % ord(field[i])
+        ptr += 2
+        left -= 2
+    buf[ptr] = "\0"
+    return True, "".join(buf)
+
+def py_make_ascii_n_into(size, value, digits):
+    """reference ZMakeAscii32 (8 digits) and ZMakeAscii16 (4 digits)"""
+    buf = [FILL] * (size + SLOP)
+    if size < digits + 3:
+        return False, "".join(buf)
+    text = "0x%0*X\0" % (digits, value & ((1 << (4 * digits)) - 1))
+    buf[:len(text)] = text
+    return True, "".join(buf)
+
+def py_make_zcode_into(size, field):
+    """reference ZMakeZcode into a size byte buffer"""
+    buf = [FILL] * (size + SLOP)
+    if size < len(field) + 2:
+        return False, "".join(buf)
+    buf[0] = "Z"
+    ptr = 1
+    left = size - 1
+    for ch in field:
+        if ch in "\0\xff":
+            if left < 3:
+                return False, "".join(buf)
+            buf[ptr:ptr + 2] = ch == "\0" and "\xff\xf0" or "\xff\xf1"
+            ptr += 2
+            left -= 2
+        else:
+            if left < 2:
+                return False, "".join(buf)
+            buf[ptr] = ch
+            ptr += 1
+            left -= 1
+    buf[ptr] = "\0"
+    return True, "".join(buf)
+
+def py_read_zcode_into(input, room):
+    """reference ZReadZcode: (ok, field buffer, length)"""
+    buf = [FILL] * (room + SLOP)
+    input += "\0"
+    if input[0] != "Z":
+        return False, "".join(buf), None
+    ptr = 1
+    n = 0
+    while input[ptr] != "\0" and n < room:
+        if input[ptr] == "\xff":
+            escape = input[ptr + 1]
+            ptr += 2
+            if escape == "\xf0":
+                buf[n] = "\0"
+            elif escape == "\xf1":
+                buf[n] = "\xff"
+            else:
+                return False, "".join(buf), None
+        else:
+            buf[n] = input[ptr]
+            ptr += 1
+        n += 1
+    if input[ptr] != "\0":
+        return False, "".join(buf), None
+    return True, "".join(buf), n
+
+def py_xtoi(ch):
+    """reference Z_cnvt_xtoi, signed char and all"""
+    c = ord(ch)
+    if c >= 128:
+        c -= 256
+    c -= ord('0')
+    if c < 10:
+        return c
+    c -= ord('A') - ord('9') - 1
+    if c < 16:
+        return c
+    return -1
+
+def py_read_ascii(input, length, num):
+    """reference ZReadAscii expressed as python: the bytes read, or
+    None for ZERR_BADFIELD.  Reads input past length the way the C
+    does, and treats the end of input as the NUL after it."""
+    def at(i):
+        if i < len(input):
+            return input[i]
+        return "\0"
+    i = 0
+    field = []
+    for n in range(num):
+        if length - i >= 1 and at(i) == ' ':
+            i += 1
+        if length - i >= 2 and at(i) == '0' and at(i + 1) == 'x':
+            i += 2
+        if length - i < 2:
+            return None
+        c1 = py_xtoi(at(i))
+        c2 = py_xtoi(at(i + 1))
+        if c1 < 0 or c2 < 0:
+            return None
+        field.append((c1 << 4) | c2)
+        i += 2
+    if at(i) != "\0":
+        return None
+    return field
+
+def py_read_ascii32(input, length):
+    """reference ZReadAscii32, which sign extends into a long"""
+    field = py_read_ascii(input, length, 4)
+    if field is None:
+        return None
+    value = (field[0] << 24) | (field[1] << 16) | (field[2] << 8) | field[3]
+    if field[0] & 0x80:
+        value -= 1 << 32
+    return value % (1 << (8 * sizeof(c_ulong)))
+
+def py_read_ascii16(input, length):
+    """reference ZReadAscii16"""
+    field = py_read_ascii(input, length, 2)
+    if field is None:
+        return None
+    return (field[0] << 8) | field[1]
+
+def fuzz_string(rand, alphabet, maxlen):
+    """a random string, mostly from alphabet, sometimes any byte"""
+    chars = []
+    for i in range(rand.randint(0, maxlen)):
+        if rand.random() < 0.9:
+            chars.append(rand.choice(alphabet))
+        else:
+            chars.append(chr(rand.randint(0, 255)))
+    return "".join(chars)
+
 def find_libzephyr(builddir='.'):
     # find the library
     libzephyr_paths = ['libzephyr.so', 'libzephyr.dylib']
@@ -146,6 +304,242 @@ class ZephyrTestSuite(TestSuite):
             assert self._libzephyr.ZExpandRealm("localhost") == socket.getfqdn("localhost").upper()
             assert self._libzephyr.ZExpandRealm("bitsy.mit.edu") == "BITSY.MIT.EDU"
 
+    def test_read_ascii_fuzz(self):
+        """fuzz ZReadAscii and friends against the python reference"""
+        rand = random.Random(38)
+        hexdigits = "0123456789ABCDEF"
+        alphabet = hexdigits * 4 + "abcdefx:@G \0"
+        for round in range(20000):
+            if rand.random() < 0.5:
+                # mostly well formed: "0x" and digits, perhaps spaced
+                words = []
+                for i in range(rand.randint(1, 5)):
+                    words.append("0x" + "".join(rand.choice(hexdigits)
+                                  for j in range(rand.choice([2, 4, 8]))))
+                input = " ".join(words)
+                if rand.random() < 0.3:
+                    pos = rand.randint(0, len(input) - 1)
+                    input = (input[:pos] + rand.choice(alphabet) +
+                             input[pos + 1:])
+            else:
+                input = fuzz_string(rand, alphabet, 24)
+            if "\0" in input:
+                input = input[:input.index("\0")]
+            length = rand.randint(max(0, len(input) - 3), len(input) + 1)
+
+            num = rand.randint(1, 8)
+            field = create_string_buffer(num)
+            st = self._libzephyr.ZReadAscii(input, length, field, num)
+            expected = py_read_ascii(input, length, num)
+            assert (st == 0) == (expected is not None), \
+                "ZReadAscii(%r, %d, %d) returned %d" % (input, length, num, st)
+            if expected is not None:
+                assert map(ord, field.raw) == expected, \
+                    "ZReadAscii(%r, %d, %d) read %r" % (input, length, num,
+                                                       field.raw)
+
+            value = c_ulong(0)
+            st = self._libzephyr.ZReadAscii32(input, length, value)
+            expected = py_read_ascii32(input, length)
+            assert (st == 0) == (expected is not None), \
+                "ZReadAscii32(%r, %d) returned %d" % (input, length, st)
+            if expected is not None:
+                assert value.value == expected, \
+                    "ZReadAscii32(%r, %d) read %#x" % (input, length,
+                                                       value.value)
+
+            value = c_ushort(0)
+            st = self._libzephyr.ZReadAscii16(input, length, value)
+            expected = py_read_ascii16(input, length)
+            assert (st == 0) == (expected is not None), \
+                "ZReadAscii16(%r, %d) returned %d" % (input, length, st)
+            if expected is not None:
+                assert value.value == expected, \
+                    "ZReadAscii16(%r, %d) read %#x" % (input, length,
+                                                       value.value)
+
+    def test_encoders_equivalence(self):
+        """compare the hex and Zcode encoders and decoders with the
+        python reference, output buffer and all"""
+        rand = random.Random(39)
+        lib = self._libzephyr
+
+        def random_field(maxlen):
+            # Dense escapes, random bytes, or plain text.
+            style = rand.randint(0, 2)
+            chars = []
+            for i in range(rand.randint(0, maxlen)):
+                if style == 0:
+                    chars.append(rand.choice("\0\xff\0\xff\xf0\xf1a"))
+                elif style == 1:
+                    chars.append(chr(rand.randint(0, 255)))
+                else:
+                    chars.append(rand.choice("abcdefghij 0x"))
+            return "".join(chars)
+
+        def into(size):
+            return create_string_buffer(FILL * (size + SLOP), size + SLOP)
+
+        for round in range(20000):
+            field = random_field(40)
+
+            # Sizes around what the field needs, so that the tight
+            # cases and their partial output get covered.
+            need = max(1, (len(field) + 3) / 4 * 11)
+            size = rand.randint(max(1, need - 6), need + 2)
+            buf = into(size)
+            st = lib.ZMakeAscii(buf, size, field, len(field))
+            ok, expected = py_make_ascii_into(size, field)
+            assert (st == 0) == ok and buf.raw == expected, \
+                "ZMakeAscii(%d, %r) gave %d %r" % (size, field, st, buf.raw)
+            if ok:
+                assert buf.value == py_make_ascii(field)
+
+            need = len(py_make_zcode(field)) + 1
+            size = rand.randint(max(1, len(field)), need + 2)
+            buf = into(size)
+            st = lib.ZMakeZcode(buf, size, field, len(field))
+            ok, expected = py_make_zcode_into(size, field)
+            assert (st == 0) == ok and buf.raw == expected, \
+                "ZMakeZcode(%d, %r) gave %d %r" % (size, field, st, buf.raw)
+            if ok:
+                assert buf.raw[:need] == py_make_zcode(field) + "\0"
+
+            value = rand.getrandbits(8 * sizeof(c_ulong))
+            size = rand.randint(8, 13)
+            buf = into(size)
+            st = lib.ZMakeAscii32(buf, size, value)
+            ok, expected = py_make_ascii_n_into(size, value, 8)
+            assert (st == 0) == ok and buf.raw == expected, \
+                "ZMakeAscii32(%d, %#x) gave %r" % (size, value, buf.raw)
+            value = rand.getrandbits(32)
+            size = rand.randint(4, 9)
+            buf = into(size)
+            st = lib.ZMakeAscii16(buf, size, value)
+            ok, expected = py_make_ascii_n_into(size, value, 4)
+            assert (st == 0) == ok and buf.raw == expected, \
+                "ZMakeAscii16(%d, %#x) gave %r" % (size, value, buf.raw)
+
+            # The decoder gets good Zcode, damaged Zcode, and the odd
+            # field that isn't Zcode at all.
+            input = py_make_zcode(field)
+            op = rand.random()
+            if op < 0.3 and len(input) > 1:
+                pos = rand.randint(1, len(input) - 1)
+                input = (input[:pos] + rand.choice(["\xff", "\xff\xf2",
+                                                    "\xff\xff", "Z"]) +
+                         input[pos + 1:])
+            elif op < 0.4:
+                input = input[:rand.randint(0, len(input))]
+            elif op < 0.45:
+                input = random_field(20)
+            if "\0" in input:
+                input = input[:input.index("\0")]
+            if not input:
+                continue
+            room = rand.randint(max(0, len(field) - 3), len(field) + 3)
+            buf = into(room)
+            length = c_int(-1)
+            st = lib.ZReadZcode(input, buf, room, length)
+            ok, expected, expected_len = py_read_zcode_into(input, room)
+            assert (st == 0) == ok and buf.raw == expected, \
+                "ZReadZcode(%r, %d) gave %d %r" % (input, room, st, buf.raw)
+            if ok:
+                assert length.value == expected_len, \
+                    "ZReadZcode(%r, %d) length %d" % (input, room,
+                                                      length.value)
+
+    def test_parse_notice_fuzz(self):
+        """fuzz ZParseNotice with mutated packets"""
+        rand = random.Random(380)
+        alphabet = "abcXYZ.@* \0"
+        mutations = "\0\0 0x0123456789ABCDEFZ\xff"
+
+        def field_at(notice, name, index=0):
+            """the address a char * field of notice points at"""
+            offset = getattr(ZNotice_t, name).offset
+            return c_void_p.from_buffer(notice,
+                                        offset + index * sizeof(c_void_p)).value
+
+        for round in range(5000):
+            notice = ZNotice_t()
+            notice.z_kind = rand.randint(0, 8)
+            notice.z_port = rand.randint(0, 65535)
+            for name in ("z_class", "z_class_inst", "z_opcode", "z_sender",
+                         "z_recipient", "z_default_format"):
+                setattr(notice, name, fuzz_string(rand, alphabet[:-1], 12)
+                        .replace("\0", ""))
+            message = fuzz_string(rand, alphabet, 40)
+            notice.z_message = message
+            notice.z_message_len = len(message)
+            zbuf = c_char_p(0)
+            zbuflen = c_int(0)
+            st = self._libzephyr.ZFormatNotice(notice, zbuf, zbuflen, ZNOAUTH)
+            assert st == 0, "ZFormatNotice failed"
+            packet = ctypes.string_at(zbuf, zbuflen.value)
+
+            for i in range(rand.randint(0, 4)):
+                op = rand.random()
+                pos = rand.randint(0, len(packet))
+                if op < 0.5:
+                    packet = (packet[:pos] + rand.choice(mutations) +
+                              packet[pos + 1:])
+                elif op < 0.7:
+                    packet = packet[:pos] + "\0" + packet[pos:]
+                elif op < 0.85:
+                    packet = packet[:pos] + packet[pos + 1:]
+                else:
+                    packet = packet[:pos]
+
+            # Packets arrive in a larger buffer; the byte after one is
+            # always readable.
+            buf = create_string_buffer(packet, len(packet) + 1)
+            base = ctypes.addressof(buf)
+            parsed = ZNotice_t()
+            st = self._libzephyr.ZParseNotice(buf, len(packet), parsed)
+            if st != 0:
+                continue
+
+            # Walk the fields the way the header says they are laid out.
+            starts = [0]
+            while starts[-1] < len(packet):
+                nul = packet.find("\0", starts[-1])
+                starts.append(nul + 1 if nul >= 0 else len(packet))
+            nfields = parsed.z_num_hdr_fields
+            assert nfields < len(starts), "parsed past the end"
+            assert field_at(parsed, "z_message") == base + starts[nfields]
+            assert parsed.z_message_len == len(packet) - starts[nfields]
+            assert field_at(parsed, "z_ascii_authent") == base + starts[7]
+            for n, name in enumerate(["z_class", "z_class_inst", "z_opcode",
+                                      "z_sender", "z_recipient",
+                                      "z_default_format",
+                                      "z_ascii_checksum",
+                                      "z_multinotice"]):
+                if n + 8 < nfields:
+                    assert field_at(parsed, name) == base + starts[n + 8], \
+                        "%s misplaced in %r" % (name, packet)
+                else:
+                    assert getattr(parsed, name) == ""
+            nother = max(0, min(nfields - 19, Z_MAXOTHERFIELDS))
+            assert parsed.z_num_other_fields == nother
+            for n in range(nother):
+                assert (field_at(parsed, "z_other_fields", n) ==
+                        base + starts[n + 19])
+
+            def hexfield(n):
+                return packet[starts[n]:], len(packet) - starts[n]
+            assert parsed.z_kind.value == ctypes.c_int(
+                py_read_ascii32(*hexfield(2))).value, \
+                "kind %d from %r" % (parsed.z_kind.value, packet)
+            assert socket.ntohs(parsed.z_port) == py_read_ascii16(*hexfield(4))
+            assert parsed.z_auth == ctypes.c_int(
+                py_read_ascii32(*hexfield(5))).value
+            assert parsed.z_authent_len == ctypes.c_int(
+                py_read_ascii32(*hexfield(6))).value
+            if nfields > 14:
+                checksum = py_read_ascii32(*hexfield(14))
+                assert parsed.z_checksum == (checksum or 0) % (1 << 32)
+
 def find_buildpath():
     parser = optparse.OptionParser(usage=__doc__,
                                    version = "%%prog %s" % __version__)
@@ -9,7 +9,7 @@ import ctypes.util
 import time
 import sys
 from ctypes import c_int, c_uint, c_ushort, c_char, c_ubyte
-from ctypes import c_uint16, c_uint32
+from ctypes import c_uint16, c_uint32, c_ulong
 from ctypes import POINTER, c_void_p, c_char_p
 from ctypes import Structure, Union, sizeof
 
@@ -165,6 +165,11 @@ Z_MAXOTHERFIELDS = 10
 #define ZNOAUTH ((Z_AuthProc)0)
 ZNOAUTH = 0
 
+# zephyr/zephyr_err.h, generated from lib/zephyr_err.et
+ZERR_PKTLEN = -772103680
+ZERR_HEADERLEN = -772103679
+ZERR_NOPORT = -772103673
+
 # typedef enum {
 #     UNSAFE, UNACKED, ACKED, HMACK, HMCTL, SERVACK, SERVNAK, CLIENTACK, STAT
 # } ZNotice_Kind_t;
@@ -314,6 +319,10 @@ class ZNotice_t(Structure):
             return ["NULL"]
         return ["%d: %s" % (n, self.z_hdr_fields[n])
                 for n in range(self.z_num_hdr_fields)]
+
+# typedef void (*Z_HandlerProc)(ZNotice_t *, struct sockaddr_in *, void *);
+Z_HandlerProc = ctypes.CFUNCTYPE(None, POINTER(ZNotice_t),
+                                 POINTER(sockaddr_in), c_void_p)
         
 class libZephyr(object):
     """wrappers for functions in libZephyr"""
@@ -325,6 +334,13 @@ class libZephyr(object):
         "Z_FormatRawHeader",
         "ZParseNotice",
         "ZFormatNotice",
+        "ZFormatNoticeInto",
+        "ZFormatNoticeList",
+        "ZFormatNoticeListInto",
+        "ZFormatRawNotice",
+        "ZFormatRawNoticeInto",
+        "ZFormatRawNoticeList",
+        "ZFormatRawNoticeListInto",
         "ZCompareUID",
         "ZExpandRealm",
         "ZGetCharsetString",
@@ -335,15 +351,25 @@ class libZephyr(object):
         "ZClosePort",
         "ZMakeAscii",
         "ZMakeZcode",
+        "ZMakeAscii32",
+        "ZMakeAscii16",
+        "ZReadZcode",
+        "ZReadAscii",
+        "ZReadAscii32",
+        "ZReadAscii16",
         "ZGetDestAddr",
         "ZSetFD",
         "ZPending",
+        "ZHandleKind",
+        "ZHandleUID",
+        "ZHandleClass",
+        "ZDispatch",
         ]
     def __init__(self, library_path=None):
         """connect to the library and build the wrappers"""
         if not library_path:
             library_path = ctypes.util.find_library("zephyr")
-        self._lib = ctypes.cdll.LoadLibrary(library_path)
+        self._lib = ctypes.CDLL(library_path, use_errno=True)
 
         # grab the Zauthtype variable
         self.Zauthtype = ctypes.c_int.in_dll(self._lib, 'Zauthtype').value
@@ -397,6 +423,106 @@ class libZephyr(object):
             c_void_p,                   # cert_routine
             ]
 
+        # Code_t
+        # ZFormatNoticeInto(register ZNotice_t *notice,
+        #                 char *buffer,
+        #                 int buffer_len,
+        #                 int *ret_len,
+        #                 Z_AuthProc cert_routine)
+        self.ZFormatNoticeInto.argtypes = [
+            POINTER(ZNotice_t),         # *notice
+            c_char_p,                   # *buffer
+            c_int,                      # buffer_len
+            POINTER(c_int),             # *ret_len
+            c_void_p,                   # cert_routine
+            ]
+
+        # Code_t
+        # ZFormatNoticeList(ZNotice_t *notice,
+        #                 register char **list,
+        #                 int nitems,
+        #                 char **buffer,
+        #                 int *ret_len,
+        #                 Z_AuthProc cert_routine)
+        self.ZFormatNoticeList.argtypes = [
+            POINTER(ZNotice_t),         # *notice
+            POINTER(c_char_p),          # **list
+            c_int,                      # nitems
+            POINTER(c_char_p),          # **buffer
+            POINTER(c_int),             # *ret_len
+            c_void_p,                   # cert_routine
+            ]
+
+        # Code_t
+        # ZFormatNoticeListInto(ZNotice_t *notice,
+        #                     char **list,
+        #                     int nitems,
+        #                     char *buffer,
+        #                     int buffer_len,
+        #                     int *ret_len,
+        #                     Z_AuthProc cert_routine)
+        self.ZFormatNoticeListInto.argtypes = [
+            POINTER(ZNotice_t),         # *notice
+            POINTER(c_char_p),          # **list
+            c_int,                      # nitems
+            c_char_p,                   # *buffer
+            c_int,                      # buffer_len
+            POINTER(c_int),             # *ret_len
+            c_void_p,                   # cert_routine
+            ]
+
+        # Code_t
+        # ZFormatRawNotice(register ZNotice_t *notice,
+        #                char **buffer,
+        #                int *ret_len)
+        self.ZFormatRawNotice.argtypes = [
+            POINTER(ZNotice_t),         # *notice
+            POINTER(c_char_p),          # **buffer
+            POINTER(c_int),             # *ret_len
+            ]
+
+        # Code_t
+        # ZFormatRawNoticeInto(register ZNotice_t *notice,
+        #                    char *buffer,
+        #                    int buffer_len,
+        #                    int *ret_len)
+        self.ZFormatRawNoticeInto.argtypes = [
+            POINTER(ZNotice_t),         # *notice
+            c_char_p,                   # *buffer
+            c_int,                      # buffer_len
+            POINTER(c_int),             # *ret_len
+            ]
+
+        # Code_t
+        # ZFormatRawNoticeList(ZNotice_t *notice,
+        #                    char *list[],
+        #                    int nitems,
+        #                    char **buffer,
+        #                    int *ret_len)
+        self.ZFormatRawNoticeList.argtypes = [
+            POINTER(ZNotice_t),         # *notice
+            POINTER(c_char_p),          # *list[]
+            c_int,                      # nitems
+            POINTER(c_char_p),          # **buffer
+            POINTER(c_int),             # *ret_len
+            ]
+
+        # Code_t
+        # ZFormatRawNoticeListInto(ZNotice_t *notice,
+        #                        char *list[],
+        #                        int nitems,
+        #                        char *buffer,
+        #                        int buffer_len,
+        #                        int *ret_len)
+        self.ZFormatRawNoticeListInto.argtypes = [
+            POINTER(ZNotice_t),         # *notice
+            POINTER(c_char_p),          # *list[]
+            c_int,                      # nitems
+            c_char_p,                   # *buffer
+            c_int,                      # buffer_len
+            POINTER(c_int),             # *ret_len
+            ]
+
         # int
         # ZCompareUID(ZUnique_Id_t *uid1,
         #             ZUnique_Id_t *uid2)
@@ -479,6 +605,102 @@ class libZephyr(object):
             c_int,              # num
             ]
 
+        # Code_t
+        # ZHandleKind(ZNotice_Kind_t kind,
+        #             Z_HandlerProc proc,
+        #             void *arg)
+        self.ZHandleKind.argtypes = [
+            c_int,              # kind
+            Z_HandlerProc,      # proc
+            c_void_p,           # arg
+            ]
+
+        # Code_t
+        # ZHandleUID(ZUnique_Id_t *uid,
+        #            Z_HandlerProc proc,
+        #            void *arg)
+        self.ZHandleUID.argtypes = [
+            POINTER(ZUnique_Id_t),      # *uid
+            Z_HandlerProc,              # proc
+            c_void_p,                   # arg
+            ]
+
+        # Code_t
+        # ZHandleClass(char *class,
+        #              char *inst,
+        #              Z_HandlerProc proc,
+        #              void *arg)
+        self.ZHandleClass.argtypes = [
+            c_char_p,           # class
+            c_char_p,           # inst
+            Z_HandlerProc,      # proc
+            c_void_p,           # arg
+            ]
+
+        # Code_t
+        # ZMakeAscii32(register char *ptr,
+        # 	     int len,
+        # 	     unsigned long value)
+        self.ZMakeAscii32.argtypes = [
+            c_char_p,           # ptr
+            c_int,              # len
+            c_ulong,            # value
+            ]
+
+        # Code_t
+        # ZMakeAscii16(register char *ptr,
+        # 	     int len,
+        # 	     unsigned int value)
+        self.ZMakeAscii16.argtypes = [
+            c_char_p,           # ptr
+            c_int,              # len
+            c_uint,             # value
+            ]
+
+        # Code_t
+        # ZReadZcode(unsigned char *ptr,
+        # 	   unsigned char *field,
+        # 	   int max,
+        # 	   int *len)
+        self.ZReadZcode.argtypes = [
+            c_char_p,           # ptr; c_uchar_p?
+            c_char_p,           # field; c_uchar_p?
+            c_int,              # max
+            POINTER(c_int),     # len
+            ]
+
+        # Code_t
+        # ZReadAscii(char *ptr,
+        # 	   int len,
+        # 	   unsigned char *field,
+        # 	   int num)
+        self.ZReadAscii.argtypes = [
+            c_char_p,           # ptr
+            c_int,              # len
+            c_char_p,           # field; c_uchar_p?
+            c_int,              # num
+            ]
+
+        # Code_t
+        # ZReadAscii32(char *ptr,
+        # 	     int len,
+        # 	     unsigned long *value_ptr)
+        self.ZReadAscii32.argtypes = [
+            c_char_p,           # ptr
+            c_int,              # len
+            POINTER(c_ulong),   # value_ptr
+            ]
+
+        # Code_t
+        # ZReadAscii16(char *ptr,
+        # 	     int len,
+        # 	     unsigned short *value_ptr)
+        self.ZReadAscii16.argtypes = [
+            c_char_p,           # ptr
+            c_int,              # len
+            POINTER(c_ushort),  # value_ptr
+            ]
+
         # struct sockaddr_in ZGetDestAddr (void) {
         self.ZGetDestAddr.restype = sockaddr_in
 
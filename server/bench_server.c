@@ -0,0 +1,903 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It contains a load generator and benchmark harness for the server.
+ *
+ *	Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *	For copying and distribution information, see the file
+ *	"mit-copyright.h".
+ */
+
+/*
+ * bench_server optionally starts a local zephyrd, subscribes a
+ * synthetic population of clients to a set of classes, and then drives
+ * the server from several threads with a mix of class notices, logins
+ * and locates.  It reports throughput, SERVACK and delivery latency
+ * percentiles, how many notices were never acked, and the server's
+ * resident set size.  Each thread keeps at most a window of notices
+ * awaiting their SERVACKs, giving up on one after ACK_TIMEOUT.
+ *
+ * Each simulated client owns a UDP socket and talks to the server
+ * directly, the way zhm would forward for it.  The server must be built
+ * without Kerberos: subscriptions and logins are marked authentic by
+ * setting z_auth, which only an unauthenticated server accepts.
+ *
+ * Latency is measured from the UID timestamp of the original notice,
+ * which the server preserves in its SERVACKs, in the copies it fans
+ * out to subscribers, and in its locate replies.
+ *
+ * With -W N the zephyrd it starts runs N shard threads.  With -k the
+ * run is a test rather than a measurement: it fails unless every
+ * notice was acked and every message reached each of its class's
+ * subscribers exactly once.  "make check-shards" runs both together.
+ */
+
+#include <zephyr/mit-copyright.h>
+#include <internal.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+
+#define DEFAULT_THREADS		4
+#define DEFAULT_CLASSES		16
+#define DEFAULT_SUBSCRIBERS	8
+#define DEFAULT_DURATION	10
+#define DEFAULT_WINDOW		32
+#define DEFAULT_MSGLEN		64
+#define DRAIN_TIME		2	/* secs to collect stragglers */
+#define ACK_TIMEOUT		2	/* secs before a notice counts as lost */
+#define SUBSCRIBE_TIMEOUT	10	/* secs to wait for subscriptions */
+#define STARTUP_TIMEOUT		10	/* secs to wait for zephyrd */
+
+enum op_type { OP_MESSAGE, OP_LOGIN, OP_LOCATE, NUM_OPS };
+
+static const char * const op_names[NUM_OPS] = {
+    "message", "login", "locate"
+};
+
+/* A growable array of latency samples, in microseconds. */
+struct samples {
+    unsigned int *val;
+    int n, size;
+};
+
+/* A notice sent by a worker and not yet acked, known by its sequence
+   number (see make_notice()). */
+struct inflight {
+    unsigned long seq;
+    struct timeval sent;
+    int used;
+};
+
+struct receiver {
+    int fd;
+    struct sockaddr_in addr;
+    int class_idx;
+    int subscribed;
+};
+
+struct worker {
+    pthread_t thread;
+    int idx;
+    int fd;				/* sends notices, gets SERVACKs */
+    struct sockaddr_in addr;
+    char principal[64];
+    struct receiver *receivers;
+    int nreceivers;
+    unsigned int seed;
+    unsigned long seq;
+    int outstanding;
+    struct inflight *inflight;		/* window entries */
+    struct timeval next_expire;
+
+    unsigned long sent[NUM_OPS];
+    unsigned long acked, naked, lost, delivered, dropped, locate_replies;
+    struct samples ack_lat[NUM_OPS];
+    struct samples deliver_lat;
+    struct samples locate_lat;
+};
+
+static struct sockaddr_in server_addr;
+static int nthreads = DEFAULT_THREADS;
+static int nclasses = DEFAULT_CLASSES;
+static int nsubscribers = DEFAULT_SUBSCRIBERS;
+static int duration = DEFAULT_DURATION;
+static int window = DEFAULT_WINDOW;
+static int msglen = DEFAULT_MSGLEN;
+static double rate;			/* total notices/sec; 0 = unpaced */
+static int login_pct, locate_pct, loss_pct;
+static int nshards;			/* -w for the zephyrd we start */
+static int check;			/* fail on anything lost */
+static char *message_body;
+
+static pthread_barrier_t start_barrier;
+static struct timeval start_time, end_time;
+
+static void usage(char *);
+static pid_t start_server(char *);
+static int check_counts(unsigned long *, unsigned long, unsigned long,
+			unsigned long, unsigned long);
+static void stop_server(pid_t);
+static long server_rss(pid_t, char *);
+static int open_socket(struct sockaddr_in *);
+static void make_notice(struct worker *, ZNotice_t *, struct sockaddr_in *);
+static int send_notice(int, ZNotice_t *);
+static int wait_for_server(void);
+static void *worker_main(void *);
+static int subscribe_all(struct worker *);
+static void send_op(struct worker *);
+static void handle_input(struct worker *, int, struct receiver *);
+static void expire_inflight(struct worker *, struct timeval *);
+static void add_sample(struct samples *, unsigned int);
+static void merge_samples(struct samples *, struct samples *);
+static void report_latency(char *, struct samples *);
+static double tv_diff(struct timeval *, struct timeval *);
+
+int
+main(int argc,
+     char **argv)
+{
+    struct worker *workers;
+    struct samples ack_lat[NUM_OPS], deliver_lat, locate_lat;
+    unsigned long sent[NUM_OPS], acked = 0, naked = 0, lost = 0, delivered = 0;
+    unsigned long dropped = 0, locate_replies = 0;
+    char *zephyrd = NULL, *host = "127.0.0.1";
+    struct hostent *hp;
+    struct servent *sp;
+    pid_t server_pid = 0;
+    long rss_idle = -1;
+    double elapsed;
+    int optchar, i, j, r, nreceivers, status = 0;
+
+    while ((optchar = getopt(argc, argv, "z:s:t:c:S:d:r:w:l:L:p:m:W:k"))
+	   != EOF) {
+	switch (optchar) {
+	  case 'z':
+	    zephyrd = optarg;
+	    break;
+	  case 's':
+	    host = optarg;
+	    break;
+	  case 't':
+	    nthreads = atoi(optarg);
+	    break;
+	  case 'c':
+	    nclasses = atoi(optarg);
+	    break;
+	  case 'S':
+	    nsubscribers = atoi(optarg);
+	    break;
+	  case 'd':
+	    duration = atoi(optarg);
+	    break;
+	  case 'r':
+	    rate = atof(optarg);
+	    break;
+	  case 'w':
+	    window = atoi(optarg);
+	    break;
+	  case 'l':
+	    login_pct = atoi(optarg);
+	    break;
+	  case 'L':
+	    locate_pct = atoi(optarg);
+	    break;
+	  case 'p':
+	    loss_pct = atoi(optarg);
+	    break;
+	  case 'm':
+	    msglen = atoi(optarg);
+	    break;
+	  case 'W':
+	    nshards = atoi(optarg);
+	    break;
+	  case 'k':
+	    check = 1;
+	    break;
+	  default:
+	    usage(argv[0]);
+	}
+    }
+    if (nthreads < 1 || nclasses < 1 || nsubscribers < 0 || duration < 1
+	|| window < 1 || msglen < 0 || msglen > Z_MAXPKTLEN / 2
+	|| login_pct < 0 || locate_pct < 0 || login_pct + locate_pct > 100
+	|| loss_pct < 0 || loss_pct > 100 || nshards < 0
+	|| (nshards && !zephyrd) || (check && loss_pct))
+	usage(argv[0]);
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    sp = getservbyname(SERVER_SVCNAME, "udp");
+    server_addr.sin_port = (sp) ? sp->s_port : SERVER_SVC_FALLBACK;
+    hp = gethostbyname(host);
+    if (!hp || hp->h_addrtype != AF_INET) {
+	fprintf(stderr, "%s: unknown host %s\n", argv[0], host);
+	exit(1);
+    }
+    memcpy(&server_addr.sin_addr, hp->h_addr, sizeof(struct in_addr));
+
+    message_body = malloc(msglen + 1);
+    if (!message_body) {
+	perror("malloc");
+	exit(1);
+    }
+    memset(message_body, 'x', msglen);
+    message_body[msglen] = '\0';
+
+    if (zephyrd) {
+	server_pid = start_server(zephyrd);
+	if (server_pid < 0)
+	    exit(1);
+    }
+    if (wait_for_server()) {
+	fprintf(stderr, "%s: no response from server at %s\n", argv[0],
+		inet_ntoa(server_addr.sin_addr));
+	stop_server(server_pid);
+	exit(1);
+    }
+    if (server_pid)
+	rss_idle = server_rss(server_pid, "VmRSS:");
+
+    /* Lay out the population: receiver r subscribes to class r / S, and
+       receivers are dealt round-robin to the worker threads. */
+    workers = (struct worker *) calloc(nthreads, sizeof(struct worker));
+    if (!workers) {
+	perror("calloc");
+	exit(1);
+    }
+    nreceivers = nclasses * nsubscribers;
+    for (i = 0; i < nthreads; i++) {
+	workers[i].idx = i;
+	workers[i].seed = getpid() ^ (i << 16);
+	sprintf(workers[i].principal, "bench%d", i);
+	workers[i].fd = open_socket(&workers[i].addr);
+	workers[i].receivers = (struct receiver *)
+	    calloc(nreceivers / nthreads + 1, sizeof(struct receiver));
+	workers[i].inflight = (struct inflight *)
+	    calloc(window, sizeof(struct inflight));
+	if (workers[i].fd < 0 || !workers[i].receivers ||
+	    !workers[i].inflight) {
+	    perror("worker setup");
+	    stop_server(server_pid);
+	    exit(1);
+	}
+    }
+    for (r = 0; r < nreceivers; r++) {
+	struct worker *w = &workers[r % nthreads];
+	struct receiver *rcv = &w->receivers[w->nreceivers++];
+
+	rcv->class_idx = r / nsubscribers;
+	rcv->fd = open_socket(&rcv->addr);
+	if (rcv->fd < 0) {
+	    perror("receiver socket");
+	    stop_server(server_pid);
+	    exit(1);
+	}
+    }
+
+    printf("zephyrd benchmark: %d threads, %d classes x %d subscribers, "
+	   "%d s", nthreads, nclasses, nsubscribers, duration);
+    if (rate > 0)
+	printf(", %.0f notices/s", rate);
+    if (nshards)
+	printf(", %d shards", nshards);
+    printf("\nmix: %d%% login, %d%% locate, %d%% message; %d%% loss; "
+	   "%d byte messages\n", login_pct, locate_pct,
+	   100 - login_pct - locate_pct, loss_pct, msglen);
+
+    pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+    for (i = 0; i < nthreads; i++) {
+	if (pthread_create(&workers[i].thread, NULL, worker_main,
+			   &workers[i]) != 0) {
+	    perror("pthread_create");
+	    stop_server(server_pid);
+	    exit(1);
+	}
+    }
+    /* The workers subscribe, then wait here; start the clock. */
+    pthread_barrier_wait(&start_barrier);
+    gettimeofday(&start_time, NULL);
+    end_time = start_time;
+    end_time.tv_sec += duration;
+    pthread_barrier_wait(&start_barrier);
+
+    for (i = 0; i < nthreads; i++)
+	pthread_join(workers[i].thread, NULL);
+    elapsed = duration;
+
+    memset(sent, 0, sizeof(sent));
+    memset(ack_lat, 0, sizeof(ack_lat));
+    memset(&deliver_lat, 0, sizeof(deliver_lat));
+    memset(&locate_lat, 0, sizeof(locate_lat));
+    for (i = 0; i < nthreads; i++) {
+	for (j = 0; j < NUM_OPS; j++) {
+	    sent[j] += workers[i].sent[j];
+	    merge_samples(&ack_lat[j], &workers[i].ack_lat[j]);
+	}
+	acked += workers[i].acked;
+	naked += workers[i].naked;
+	lost += workers[i].lost;
+	delivered += workers[i].delivered;
+	dropped += workers[i].dropped;
+	locate_replies += workers[i].locate_replies;
+	merge_samples(&deliver_lat, &workers[i].deliver_lat);
+	merge_samples(&locate_lat, &workers[i].locate_lat);
+    }
+
+    printf("sent:       %lu messages (%.0f/s), %lu logins, %lu locates\n",
+	   sent[OP_MESSAGE], sent[OP_MESSAGE] / elapsed, sent[OP_LOGIN],
+	   sent[OP_LOCATE]);
+    printf("acked:      %lu SERVACK, %lu SERVNAK, %lu locate replies; "
+	   "%lu lost\n", acked, naked, locate_replies, lost);
+    printf("delivered:  %lu notices (%.0f/s), %lu dropped by simulated "
+	   "loss\n", delivered, delivered / elapsed, dropped);
+    for (j = 0; j < NUM_OPS; j++) {
+	char label[32];
+
+	sprintf(label, "%s ack", op_names[j]);
+	report_latency(label, &ack_lat[j]);
+    }
+    report_latency("delivery", &deliver_lat);
+    report_latency("locate reply", &locate_lat);
+    if (server_pid) {
+	printf("server RSS: %ld kB before subscriptions, %ld kB after run, "
+	       "%ld kB peak\n", rss_idle, server_rss(server_pid, "VmRSS:"),
+	       server_rss(server_pid, "VmHWM:"));
+	stop_server(server_pid);
+    }
+    if (check)
+	status = check_counts(sent, acked, naked, lost, delivered);
+    return status;
+}
+
+/*
+ * For -k: every notice must have been acked, and every message
+ * delivered once to each subscriber of its class.  Fewer deliveries
+ * mean a subscriber was missed, more mean one got duplicates.
+ */
+static int
+check_counts(unsigned long *sent,
+	     unsigned long acked,
+	     unsigned long naked,
+	     unsigned long lost,
+	     unsigned long delivered)
+{
+    unsigned long total = sent[OP_MESSAGE] + sent[OP_LOGIN] + sent[OP_LOCATE];
+    unsigned long expected = sent[OP_MESSAGE] * nsubscribers;
+    int ok = 1;
+
+    if (!sent[OP_MESSAGE]) {
+	printf("check: no messages were sent\n");
+	ok = 0;
+    }
+    if (acked != total || naked || lost) {
+	printf("check: %lu notices sent, but %lu SERVACK, %lu SERVNAK, "
+	       "%lu lost\n", total, acked, naked, lost);
+	ok = 0;
+    }
+    if (delivered != expected) {
+	printf("check: %lu deliveries, expected %lu\n", delivered, expected);
+	ok = 0;
+    }
+    printf("check: %s\n", ok ? "passed" : "FAILED");
+    return !ok;
+}
+
+static void
+usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-z zephyrd] [-s server] [-t threads] "
+	    "[-c classes]\n\t[-S subscribers-per-class] [-d seconds] "
+	    "[-r notices/sec] [-w window]\n\t[-l login%%] [-L locate%%] "
+	    "[-p loss%%] [-m message-length]\n\t[-W shards] [-k]\n", prog);
+    exit(1);
+}
+
+/*
+ * Start a zephyrd in the foreground and return its pid.
+ */
+static pid_t
+start_server(char *path)
+{
+    char shards[16];
+    pid_t pid;
+
+    pid = fork();
+    if (pid < 0) {
+	perror("fork");
+	return -1;
+    }
+    if (pid == 0) {
+	if (nshards) {
+	    sprintf(shards, "%d", nshards);
+	    execl(path, path, "-n", "-w", shards, (char *) NULL);
+	} else {
+	    execl(path, path, "-n", (char *) NULL);
+	}
+	perror(path);
+	_exit(1);
+    }
+    return pid;
+}
+
+static void
+stop_server(pid_t pid)
+{
+    int status;
+
+    if (pid <= 0)
+	return;
+    kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+}
+
+/*
+ * Return a size field (in kB) from /proc/<pid>/status, or -1.
+ */
+static long
+server_rss(pid_t pid,
+	   char *field)
+{
+    char fname[64], line[256];
+    long kb = -1;
+    FILE *fp;
+
+    sprintf(fname, "/proc/%d/status", (int) pid);
+    fp = fopen(fname, "r");
+    if (!fp)
+	return -1;
+    while (fgets(line, sizeof(line), fp)) {
+	if (strncmp(line, field, strlen(field)) == 0) {
+	    kb = atol(line + strlen(field));
+	    break;
+	}
+    }
+    fclose(fp);
+    return kb;
+}
+
+static int
+open_socket(struct sockaddr_in *addr)
+{
+    socklen_t len = sizeof(*addr);
+    int fd, flags;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+	return -1;
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    if (bind(fd, (struct sockaddr *) addr, sizeof(*addr)) < 0
+	|| getsockname(fd, (struct sockaddr *) addr, &len) < 0) {
+	close(fd);
+	return -1;
+    }
+    /* The server sees our loopback or interface address; use the one it
+       will reply to in the notice's sender address. */
+    addr->sin_addr = server_addr.sin_addr;
+    flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    return fd;
+}
+
+/*
+ * Fill in the fixed parts of a notice from the given socket address.
+ * The UID carries the send time; its address part carries the worker
+ * and sequence number so that UIDs stay unique across threads.
+ */
+static void
+make_notice(struct worker *w,
+	    ZNotice_t *notice,
+	    struct sockaddr_in *from)
+{
+    struct timeval tv;
+
+    memset(notice, 0, sizeof(*notice));
+    notice->z_kind = ACKED;
+    notice->z_port = from->sin_port;
+    gettimeofday(&tv, NULL);
+    notice->z_uid.zuid_addr.s_addr = htonl((w->idx << 20) |
+					   (w->seq++ & 0xfffff));
+    notice->z_uid.tv.tv_sec = htonl((u_long) tv.tv_sec);
+    notice->z_uid.tv.tv_usec = htonl((u_long) tv.tv_usec);
+    notice->z_multiuid = notice->z_uid;
+    notice->z_multinotice = "";
+    notice->z_sender_sockaddr.ip4 = *from;
+    notice->z_sender = w->principal;
+    notice->z_recipient = "";
+    notice->z_default_format = "";
+    notice->z_ascii_authent = "";
+}
+
+static int
+send_notice(int fd,
+	    ZNotice_t *notice)
+{
+    ZPacket_t pkt;
+    int len;
+
+    if (ZFormatSmallRawNotice(notice, pkt, &len) != ZERR_NONE)
+	return -1;
+    if (sendto(fd, pkt, len, 0, (struct sockaddr *) &server_addr,
+	       sizeof(server_addr)) < 0)
+	return (errno == EAGAIN || errno == ENOBUFS) ? 0 : -1;
+    return 0;
+}
+
+/*
+ * Ping the server with a notice to an unsubscribed class until it
+ * answers with a SERVACK (it will say LOST) or we give up.
+ */
+static int
+wait_for_server(void)
+{
+    struct worker w;
+    struct pollfd pfd;
+    ZNotice_t notice, reply;
+    ZPacket_t pkt;
+    int fd, len, tries;
+
+    memset(&w, 0, sizeof(w));
+    strcpy(w.principal, "bench-ping");
+    fd = open_socket(&w.addr);
+    if (fd < 0)
+	return -1;
+    for (tries = 0; tries < STARTUP_TIMEOUT * 5; tries++) {
+	make_notice(&w, &notice, &w.addr);
+	notice.z_class = "bench-ping";
+	notice.z_class_inst = "ping";
+	if (send_notice(fd, &notice) < 0)
+	    break;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 200) <= 0)
+	    continue;
+	len = recv(fd, pkt, sizeof(pkt), 0);
+	if (len > 0 && ZParseNotice(pkt, len, &reply) == ZERR_NONE
+	    && (reply.z_kind == SERVACK || reply.z_kind == SERVNAK)) {
+	    close(fd);
+	    return 0;
+	}
+    }
+    close(fd);
+    return -1;
+}
+
+static void *
+worker_main(void *arg)
+{
+    struct worker *w = (struct worker *) arg;
+    struct pollfd *pfds;
+    struct timeval now, next_send, stop;
+    double interval = 0;
+    int i, n, timeout;
+
+    pfds = (struct pollfd *) malloc((w->nreceivers + 1) *
+				    sizeof(struct pollfd));
+    if (!pfds) {
+	perror("malloc");
+	exit(1);
+    }
+    pfds[0].fd = w->fd;
+    pfds[0].events = POLLIN;
+    for (i = 0; i < w->nreceivers; i++) {
+	pfds[i + 1].fd = w->receivers[i].fd;
+	pfds[i + 1].events = POLLIN;
+    }
+
+    if (subscribe_all(w) < 0)
+	fprintf(stderr, "worker %d: not all subscriptions were acked\n",
+		w->idx);
+
+    pthread_barrier_wait(&start_barrier);
+    pthread_barrier_wait(&start_barrier);
+
+    next_send = start_time;
+    if (rate > 0)
+	interval = nthreads / rate;
+    stop = end_time;
+    for (;;) {
+	gettimeofday(&now, NULL);
+	if (timercmp(&now, &end_time, >=)) {
+	    /* Stop sending but keep reading until the drain time is up. */
+	    if (timercmp(&now, &stop, >=)) {
+		if (stop.tv_sec != end_time.tv_sec)
+		    break;
+		stop.tv_sec += DRAIN_TIME;
+	    }
+	    timeout = 50;
+	} else {
+	    expire_inflight(w, &now);
+	    while (w->outstanding < window
+		   && (interval == 0 || timercmp(&now, &next_send, >=))) {
+		send_op(w);
+		if (interval > 0) {
+		    next_send.tv_usec += (long) (interval * 1000000);
+		    next_send.tv_sec += next_send.tv_usec / 1000000;
+		    next_send.tv_usec %= 1000000;
+		}
+	    }
+	    if (w->outstanding >= window || interval == 0)
+		timeout = 10;
+	    else
+		timeout = (int) (tv_diff(&next_send, &now) * 1000);
+	}
+	n = poll(pfds, w->nreceivers + 1, timeout);
+	if (n <= 0)
+	    continue;
+	if (pfds[0].revents & POLLIN)
+	    handle_input(w, w->fd, NULL);
+	for (i = 0; i < w->nreceivers; i++) {
+	    if (pfds[i + 1].revents & POLLIN)
+		handle_input(w, w->receivers[i].fd, &w->receivers[i]);
+	}
+    }
+    free(pfds);
+    return NULL;
+}
+
+/*
+ * Subscribe each of this worker's receivers to its class and wait for
+ * the server to acknowledge all of them.
+ */
+static int
+subscribe_all(struct worker *w)
+{
+    struct timeval now, deadline;
+    struct pollfd pfd;
+    ZNotice_t notice;
+    char msg[64];
+    int i, len, pending;
+
+    gettimeofday(&deadline, NULL);
+    deadline.tv_sec += SUBSCRIBE_TIMEOUT;
+    do {
+	pending = 0;
+	for (i = 0; i < w->nreceivers; i++) {
+	    struct receiver *rcv = &w->receivers[i];
+
+	    if (rcv->subscribed)
+		continue;
+	    pending++;
+	    make_notice(w, &notice, &rcv->addr);
+	    notice.z_auth = 1;
+	    notice.z_class = ZEPHYR_CTL_CLASS;
+	    notice.z_class_inst = ZEPHYR_CTL_CLIENT;
+	    notice.z_opcode = CLIENT_SUBSCRIBE_NODEFS;
+	    len = sprintf(msg, "bench-%d", rcv->class_idx);
+	    memcpy(msg + len + 1, "*\0", 3);
+	    notice.z_message = msg;
+	    notice.z_message_len = len + 1 + 2 + 1;
+	    send_notice(rcv->fd, &notice);
+	    pfd.fd = rcv->fd;
+	    pfd.events = POLLIN;
+	    if (poll(&pfd, 1, 100) > 0)
+		handle_input(w, rcv->fd, rcv);
+	}
+	gettimeofday(&now, NULL);
+    } while (pending && timercmp(&now, &deadline, <));
+    return pending ? -1 : 0;
+}
+
+/*
+ * Send one operation, chosen according to the login/locate mix.
+ */
+static void
+send_op(struct worker *w)
+{
+    ZNotice_t notice;
+    char inst[32], msg[128];
+    int i, pick, len;
+    enum op_type op;
+
+    make_notice(w, &notice, &w->addr);
+    pick = rand_r(&w->seed) % 100;
+    if (pick < login_pct) {
+	op = OP_LOGIN;
+	notice.z_auth = 1;
+	notice.z_class = LOGIN_CLASS;
+	notice.z_class_inst = w->principal;
+	notice.z_opcode = EXPOSE_REALMVIS;
+	len = sprintf(msg, "bench-host");
+	len += sprintf(msg + len + 1, "Thu Jan  1 00:00:00 1970") + 1;
+	len += sprintf(msg + len + 1, "pts/%d", w->idx) + 1;
+	notice.z_message = msg;
+	notice.z_message_len = len + 1;
+    } else if (pick < login_pct + locate_pct) {
+	op = OP_LOCATE;
+	notice.z_class = LOCATE_CLASS;
+	sprintf(inst, "bench%d", rand_r(&w->seed) % nthreads);
+	notice.z_class_inst = inst;
+	notice.z_opcode = LOCATE_LOCATE;
+    } else {
+	op = OP_MESSAGE;
+	sprintf(inst, "bench-%lu",
+		(unsigned long) (w->idx + w->sent[OP_MESSAGE] * nthreads)
+		% nclasses);
+	notice.z_class = inst;
+	notice.z_class_inst = "load";
+	notice.z_opcode = "";
+	notice.z_default_format = "$message";
+	notice.z_message = message_body;
+	notice.z_message_len = msglen;
+    }
+    if (send_notice(w->fd, &notice) == 0) {
+	w->sent[op]++;
+	for (i = 0; i < window && w->inflight[i].used; i++)
+	    ;
+	w->inflight[i].seq = ntohl(notice.z_uid.zuid_addr.s_addr) & 0xfffff;
+	gettimeofday(&w->inflight[i].sent, NULL);
+	w->inflight[i].used = 1;
+	w->outstanding++;
+    }
+}
+
+/*
+ * Give up on notices that have gone unacked for ACK_TIMEOUT, so that a
+ * lost notice or SERVACK doesn't hold its place in the window forever.
+ * Checked every tenth of a second.
+ */
+static void
+expire_inflight(struct worker *w,
+		struct timeval *now)
+{
+    int i;
+
+    if (timercmp(now, &w->next_expire, <))
+	return;
+    w->next_expire = *now;
+    w->next_expire.tv_usec += 100000;
+    if (w->next_expire.tv_usec >= 1000000) {
+	w->next_expire.tv_sec++;
+	w->next_expire.tv_usec -= 1000000;
+    }
+    for (i = 0; i < window; i++) {
+	if (w->inflight[i].used &&
+	    tv_diff(now, &w->inflight[i].sent) >= ACK_TIMEOUT) {
+	    w->inflight[i].used = 0;
+	    w->outstanding--;
+	    w->lost++;
+	}
+    }
+}
+
+/*
+ * Read everything waiting on fd.  Receivers get fanned-out notices and
+ * their subscription acks; the worker socket gets SERVACKs and locate
+ * replies.  Anything the server expects an ack for gets a CLIENTACK,
+ * unless simulated loss drops it first.
+ */
+static void
+handle_input(struct worker *w,
+	     int fd,
+	     struct receiver *rcv)
+{
+    struct timeval now, sent;
+    struct sockaddr_in from;
+    socklen_t fromlen;
+    ZNotice_t notice;
+    ZPacket_t pkt, ackpkt;
+    unsigned long seq;
+    unsigned int lat;
+    int i, len, acklen;
+    enum op_type op;
+
+    for (;;) {
+	fromlen = sizeof(from);
+	len = recvfrom(fd, pkt, sizeof(pkt), 0, (struct sockaddr *) &from,
+		       &fromlen);
+	if (len <= 0)
+	    return;
+	if (ZParseNotice(pkt, len, &notice) != ZERR_NONE)
+	    continue;
+	gettimeofday(&now, NULL);
+	sent.tv_sec = ntohl(notice.z_uid.tv.tv_sec);
+	sent.tv_usec = ntohl(notice.z_uid.tv.tv_usec);
+	lat = (unsigned int) (tv_diff(&now, &sent) * 1000000);
+
+	if (notice.z_kind == SERVACK || notice.z_kind == SERVNAK) {
+	    if (rcv) {
+		rcv->subscribed = 1;
+		continue;
+	    }
+	    if (!strcmp(notice.z_class, LOGIN_CLASS))
+		op = OP_LOGIN;
+	    else if (!strcmp(notice.z_class, LOCATE_CLASS))
+		op = OP_LOCATE;
+	    else
+		op = OP_MESSAGE;
+	    /* Only the first ack for a notice still in the window. */
+	    seq = ntohl(notice.z_uid.zuid_addr.s_addr) & 0xfffff;
+	    for (i = 0; i < window; i++) {
+		if (w->inflight[i].used && w->inflight[i].seq == seq)
+		    break;
+	    }
+	    if (i == window)
+		continue;
+	    w->inflight[i].used = 0;
+	    w->outstanding--;
+	    if (notice.z_kind == SERVACK)
+		w->acked++;
+	    else
+		w->naked++;
+	    add_sample(&w->ack_lat[op], lat);
+	    continue;
+	}
+	if (notice.z_kind == HMACK || notice.z_kind == CLIENTACK)
+	    continue;
+
+	if (rcv && loss_pct && rand_r(&w->seed) % 100 < loss_pct) {
+	    w->dropped++;
+	    continue;
+	}
+	notice.z_kind = CLIENTACK;
+	notice.z_message_len = 0;
+	if (ZFormatSmallRawNotice(&notice, ackpkt, &acklen) == ZERR_NONE)
+	    sendto(fd, ackpkt, acklen, 0, (struct sockaddr *) &from, fromlen);
+	if (rcv) {
+	    w->delivered++;
+	    add_sample(&w->deliver_lat, lat);
+	} else if (!strcmp(notice.z_class, LOCATE_CLASS)) {
+	    w->locate_replies++;
+	    add_sample(&w->locate_lat, lat);
+	}
+    }
+}
+
+static void
+add_sample(struct samples *s,
+	   unsigned int val)
+{
+    if (s->n == s->size) {
+	s->size = s->size ? s->size * 2 : 1024;
+	s->val = (unsigned int *) realloc(s->val,
+					  s->size * sizeof(unsigned int));
+	if (!s->val) {
+	    perror("realloc");
+	    exit(1);
+	}
+    }
+    s->val[s->n++] = val;
+}
+
+static void
+merge_samples(struct samples *to,
+	      struct samples *from)
+{
+    int i;
+
+    for (i = 0; i < from->n; i++)
+	add_sample(to, from->val[i]);
+    free(from->val);
+}
+
+static int
+cmp_uint(const void *a,
+	 const void *b)
+{
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void
+report_latency(char *label,
+	       struct samples *s)
+{
+    if (!s->n)
+	return;
+    qsort(s->val, s->n, sizeof(unsigned int), cmp_uint);
+    printf("%-18s p50 %u us, p99 %u us, max %u us (%d samples)\n", label,
+	   s->val[s->n / 2], s->val[(int) (s->n * 0.99)], s->val[s->n - 1],
+	   s->n);
+}
+
+static double
+tv_diff(struct timeval *a,
+	struct timeval *b)
+{
+    return (a->tv_sec - b->tv_sec) + (a->tv_usec - b->tv_usec) / 1000000.0;
+}
@@ -89,6 +89,7 @@ client_register(ZNotice_t *notice,
 #endif
 	client->last_send = 0;
 	client->last_ack = NOW;
+	client->srtt = client->rttvar = client->rtt_min = 0;
 	client->addr.sin_family = AF_INET;
 	client->addr.sin_addr.s_addr = host->s_addr;
 	client->addr.sin_port = notice->z_port;
@@ -45,6 +45,14 @@ nacktab_hashval(struct sockaddr_in sa, ZUnique_Id_t uid) {
  *	int auth;
  *	struct sockaddr_in *who;
  *
+ * void handle_notice(notice, who)
+ *	ZNotice_t *notice;
+ *	struct sockaddr_in *who;
+ *
+ * int handle_notice_shared(notice, who)
+ *	ZNotice_t *notice;
+ *	struct sockaddr_in *who;
+ *
  * void clt_ack(notice, who, sent)
  *	ZNotice_t *notice;
  *	struct sockaddr_in *who;
@@ -59,11 +67,23 @@ nacktab_hashval(struct sockaddr_in sa, ZUnique_Id_t uid) {
  *	struct sockaddr_in *who;
  *      int external;
  *
- * void xmit(notice, dest, auth, client)
+ * int fanout_count(notice)
+ *	ZNotice_t *notice;
+ *
+ * void xmit(notice, dest, auth, client, cache)
  *	ZNotice_t *notice;
  *	struct sockaddr_in *dest;
  *	int auth;
  *	Client *client;
+ *	Xmit_cache *cache;
+ *
+ * void client_rtt_sample(client, rtt)
+ *	Client *client;
+ *	long rtt;
+ *
+ * long client_rto(client, rexmits)
+ *	Client *client;
+ *	int rexmits;
  */
 
 
@@ -73,9 +93,42 @@ int rexmit_times[] = REXMIT_TIMES;
 
 static void nack_cancel(ZNotice_t *, struct sockaddr_in *);
 static void dispatch(ZNotice_t *, int, struct sockaddr_in *, int);
-static int send_to_dest(ZNotice_t *, int, Destination *dest, int, int);
+/*
+ * The clients a notice has already gone to, so that none gets it twice.
+ * Unsharded, each client is stamped with a counter as it is sent to.
+ * Shard threads would race on the stamps, so with shards the clients
+ * of the exact-instance pass go into a small hash set of the thread's
+ * own instead, and the wildcard-instance pass skips those.
+ */
+
+#define SENT_INLINE	64		/* slots that fit on the stack */
+
+typedef struct _Sent_set {
+    int counter;			/* this notice's stamp, unsharded */
+    Client **slots;			/* open addressed; NULL if empty */
+    unsigned int mask;
+    Client **list;			/* to scan if slots didn't fit */
+    Client *inline_slots[SENT_INLINE];
+} Sent_set;
+
+static void sent_init(Sent_set *);
+static void sent_fill(Sent_set *, Client **);
+static int sent_skip(Sent_set *, Client *);
+static void sent_done(Sent_set *);
+static String *notice_recipient(ZNotice_t *, char *, String *);
+static int send_to_dest(ZNotice_t *, int, Destination *dest, Sent_set *, int,
+			Xmit_cache *);
+static int count_dest(Destination *, Sent_set *);
+static Code_t xmit_frag_to(ZNotice_t *, char *, int, struct sockaddr_in *);
+static Unacked *nack_alloc(char *, int);
+static Unacked *nack_enter(char *, int, ZUnique_Id_t *, struct sockaddr_in *,
+			   Client *);
+static void nack_send_failed(Unacked *, struct sockaddr_in *, ZUnique_Id_t *,
+			     Code_t);
+static Code_t send_packet(char *, int, struct sockaddr_in *);
 static void hostm_deathgram(struct sockaddr_in *, Server *);
 static char *hm_recipient(void);
+static long usec_since(struct timeval *);
 
 Statistic realm_notices = {0, "inter-realm notices"};
 Statistic interserver_notices = {0, "inter-server notices"};
@@ -89,8 +142,13 @@ Statistic i_s_admins = {0, "inter-server admin notices"};
 Statistic i_s_locates = {0, "inter-server locate notices"};
 Statistic locate_notices = {0, "locate notices"};
 Statistic admin_notices = {0, "admin notices"};
+Statistic spurious_rexmits = {0, "spurious retransmits"};
 
 static Unacked *nacktab[NACKTAB_HASHSIZE];
+/* Shard threads add to and cancel from nacktab concurrently, under the
+   shared state lock; everything else happens under the exclusive lock
+   and doesn't need this one. */
+static pthread_mutex_t nack_lock = PTHREAD_MUTEX_INITIALIZER;
 static struct in_addr *hosts;
 static int hosts_size = 0, num_hosts = 0;
 
@@ -113,6 +171,12 @@ dump_stats (void *arg)
     syslog(LOG_INFO, "stats: %s: %d", i_s_logins.str, i_s_logins.val);
     syslog(LOG_INFO, "stats: %s: %d", i_s_admins.str, i_s_admins.val);
     syslog(LOG_INFO, "stats: %s: %d", i_s_locates.str, i_s_locates.val);
+    syslog(LOG_INFO, "stats: %s: %d", throttle_deferred.str,
+	   throttle_deferred.val);
+    syslog(LOG_INFO, "stats: %s: %d", throttle_dropped.str,
+	   throttle_dropped.val);
+    syslog(LOG_INFO, "stats: %s: %d", spurious_rexmits.str,
+	   spurious_rexmits.val);
 
     /* log stuff once an hour */
     timer_set_rel ((long) 6*60*60, dump_stats, arg);
@@ -131,13 +195,8 @@ handle_packet(void)
     ZPacket_t input_packet;	/* from the network */
     ZNotice_t new_notice;	/* parsed from input_packet */
     int input_len;		/* len of packet */
-    struct sockaddr_in input_sin; /* Zconstructed for authent */
     struct sockaddr_in whoisit;	/* for holding peer's address */
-    int authentic;		/* authentic flag */
     Pending *pending;		/* pending packet */
-    int from_server;		/* packet is from another server */
-    ZRealm *realm;		/* foreign realm ptr */
-    struct sockaddr_in *whence; /* pointer to actual origin */
 #ifdef DEBUG
     static int first_time = 1;
 #endif
@@ -179,45 +238,123 @@ handle_packet(void)
 	return;
     }
     npackets++;
+    ZPROBE3(packet__receive, whoisit.sin_addr.s_addr, whoisit.sin_port,
+	    input_len);
     status = ZParseNotice(input_packet, input_len, &new_notice);
+    ZPROBE4(packet__parse, whoisit.sin_addr.s_addr,
+	    status == ZERR_NONE ? (int) new_notice.z_kind : -1,
+	    status == ZERR_NONE ? new_notice.z_class : NULL, status);
     if (status != ZERR_NONE) {
 	syslog(LOG_ERR, "bad notice parse (%s): %s",
 	       inet_ntoa(whoisit.sin_addr), error_message(status));
 	return;
     }
 
-    if (server_which_server(&whoisit)) {
+    handle_notice(&new_notice, &whoisit);
+}
+
+/*
+ * Authenticate and dispatch a notice just received from whoisit.
+ */
+
+void
+handle_notice(ZNotice_t *new_notice,
+	      struct sockaddr_in *whoisit)
+{
+    struct sockaddr_in input_sin; /* Zconstructed for authent */
+    int authentic;		/* authentic flag */
+    int from_server;		/* packet is from another server */
+    ZRealm *realm;		/* foreign realm ptr */
+    struct sockaddr_in *whence; /* pointer to actual origin */
+
+    if (server_which_server(whoisit)) {
 	/* we need to parse twice--once to get
 	   the source addr, second to check
 	   authentication */
-	notice_extract_address(&new_notice, &input_sin);
+	notice_extract_address(new_notice, &input_sin);
         /* Should check to see if packet is from another realm's server,
            or a client */
 	from_server = 1;
 	whence = &input_sin;
     } else {
 	from_server = 0;
-	whence = &whoisit;
+	whence = whoisit;
     }
 
     /* Don't bother checking authentication on client ACKs */
-    if (new_notice.z_kind == CLIENTACK) {
-	nack_cancel(&new_notice, &whoisit);
+    if (new_notice->z_kind == CLIENTACK) {
+	nack_cancel(new_notice, whoisit);
 	return;
     }
 
     /* Clients don't check auth of acks, nor do we make it so they
        can in general, so this is safe. */
-    if (new_notice.z_kind == SERVACK || new_notice.z_kind == SERVNAK) {
+    if (new_notice->z_kind == SERVACK || new_notice->z_kind == SERVNAK) {
 	authentic = ZAUTH_YES;
     } else {
 	realm = realm_which_realm(whence);
-	authentic = ZCheckSrvAuthentication(&new_notice, whence, realm ? realm->name : NULL);
+	authentic = ZCheckSrvAuthentication(new_notice, whence, realm ? realm->name : NULL);
     }
 
     message_notices.val++;
-    dispatch(&new_notice, authentic, &whoisit, from_server);
-    return;
+    dispatch(new_notice, authentic, whoisit, from_server);
+}
+
+/*
+ * Handle a notice received by a shard thread, which holds the state
+ * lock shared.  Only client acks and ordinary class notices from local
+ * clients are handled here.  Along that path the nack table and the
+ * timers have locks of their own, Kerberos calls are serialized, and
+ * nothing else is modified: sendit() only looks strings up, the rate
+ * limiter has its own lock, and the counters are bumped atomically.
+ * Returns 0 if the notice has to go through handle_notice() under the
+ * exclusive lock instead.
+ */
+
+int
+handle_notice_shared(ZNotice_t *notice,
+		     struct sockaddr_in *who)
+{
+    String *notice_class;
+    int authentic;
+
+    if (notice->z_kind == CLIENTACK) {
+	nack_cancel(notice, who);
+	return 1;
+    }
+
+    /* Leave inter-realm delivery, server traffic and control, login,
+       locate and restricted classes to the main path. */
+    if (nrealms || server_which_server(who))
+	return 0;
+    if (notice->z_kind != UNSAFE && notice->z_kind != UNACKED &&
+	notice->z_kind != ACKED)
+	return 0;
+    if (!realm_bound_for_realm(ZGetRealm(), notice->z_recipient))
+	return 0;
+    notice_class = find_string(notice->z_class, 1);
+    if (notice_class &&
+	(class_is_hm(notice_class) || class_is_control(notice_class) ||
+	 class_is_ulogin(notice_class) || class_is_ulocate(notice_class) ||
+	 class_is_admin(notice_class) || class_get_acl(notice_class)))
+	return 0;
+
+#if defined(HAVE_KRB4) || defined(HAVE_KRB5)
+    shard_krb_lock();
+    authentic = ZCheckSrvAuthentication(notice, who, NULL);
+    shard_krb_unlock();
+#else
+    authentic = ZCheckSrvAuthentication(notice, who, NULL);
+#endif
+
+    __sync_fetch_and_add(&message_notices.val, 1);
+    ZPROBE4(dispatch__class, who->sin_addr.s_addr, (int) notice->z_kind,
+	    notice->z_class, 0);
+    if (notice->z_recipient[0] == '@')
+	notice->z_recipient = "";
+    if (throttle_admit(notice, authentic == ZAUTH_YES, who))
+	sendit(notice, authentic == ZAUTH_YES, who, 1);
+    return 1;
 }
 /*
  * Dispatch a notice.
@@ -250,6 +387,8 @@ dispatch(ZNotice_t *notice,
     }
 
     notice_class = make_string(notice->z_class,1);
+    ZPROBE4(dispatch__class, who->sin_addr.s_addr, (int) notice->z_kind,
+	    notice_class->string, from_server);
 
     if (from_server) {
 	interserver_notices.val++;
@@ -284,7 +423,8 @@ dispatch(ZNotice_t *notice,
 	} else {
 	    if (notice->z_recipient[0] == '@')
 		notice->z_recipient = "";
-	    sendit(notice, authflag, who, 1);
+	    if (throttle_admit(notice, authflag, who))
+		sendit(notice, authflag, who, 1);
 	}
 	free_string(notice_class);
 	return;
@@ -297,6 +437,9 @@ dispatch(ZNotice_t *notice,
 
 /*
  * Send a notice off to those clients who have subscribed to it.
+ * This may run under the shared state lock (see handle_notice_shared()),
+ * so it only looks strings up rather than interning them: a class or
+ * instance that isn't in the string table has no subscribers.
  */
 
 void
@@ -305,15 +448,16 @@ sendit(ZNotice_t *notice,
        struct sockaddr_in *who,
        int external)
 {
-    static int send_counter = 0;
-    char recipbuf[MAX_PRINCIPAL_SIZE], *recipp, *acl_sender;
+    char recipbuf[MAX_PRINCIPAL_SIZE], *acl_sender;
     int any = 0;
     Acl *acl;
     Destination dest;
-    String *class;
+    String *class, recip;
+    Sent_set sent;
+    Xmit_cache cache;
 
-    class = make_string(notice->z_class, 1);
-    if (realm_bound_for_realm(ZGetRealm(), notice->z_recipient)) {
+    class = find_string(notice->z_class, 1);
+    if (class && realm_bound_for_realm(ZGetRealm(), notice->z_recipient)) {
       ZRealm *rlm;
 
       acl = class_get_acl(class);
@@ -326,7 +470,6 @@ sendit(ZNotice_t *notice,
 	    syslog(LOG_WARNING, "sendit auth not verifiable %s (%s) from %s",
 		   notice->z_class, rlm->name, notice->z_sender);
 	    clt_ack(notice, who, AUTH_FAILED);
-	    free_string(class);
 	    return;
 	  }
 	}
@@ -335,7 +478,6 @@ sendit(ZNotice_t *notice,
 	    syslog(LOG_WARNING, "sendit unauthorized %s from %s%s",
 		   notice->z_class, notice->z_sender, auth ? "" : " (unauth)");
 	    clt_ack(notice, who, AUTH_FAILED);
-	    free_string(class);
 	    return;
 	}
 	/* sender != inst and not auth to send to others --> fail */
@@ -345,69 +487,193 @@ sendit(ZNotice_t *notice,
 		   notice->z_sender, auth ? "" : " (unauth)",
 		   notice->z_class, notice->z_class_inst);
 	    clt_ack(notice, who, AUTH_FAILED);
-	    free_string(class);
 	    return;
 	}
       }
     }
 
-    /* Increment the send counter, used to prevent duplicate sends to
-     * clients.  On the off-chance that we wrap around to 0, skip over
-     * it to prevent missing clients which have never had a packet
-     * sent to them. */
-    send_counter++;
-    if (send_counter == 0)
-	send_counter = 1;
+    if (!class) {
+	nack(notice, who);
+	return;
+    }
 
     /* Send to clients subscribed to the triplet itself. */
     dest.classname = class;
-    dest.inst = make_string(notice->z_class_inst, 1);
-    if (realm_bound_for_realm(ZGetRealm(), notice->z_recipient) &&
-	*notice->z_recipient == '@')
-      dest.recip = make_string("", 0);
-    else {
-      strncpy(recipbuf, notice->z_recipient, sizeof(recipbuf));
-      recipp = strrchr(recipbuf, '@');
-      if (recipp)
-	/* XXX if realm_expand_realm doesn't find a match
-	 * it returns what's passed into it, causing an overlapping
-	 * copy, the results of which are undefined.
-	 */
-	strncpy(recipp + 1, realm_expand_realm(recipp + 1),
-	       sizeof(recipbuf) - (recipp - recipbuf) - 1);
-      dest.recip = make_string(recipbuf, 0);
+    dest.inst = find_string(notice->z_class_inst, 1);
+    dest.recip = notice_recipient(notice, recipbuf, &recip);
+
+    ZPROBE3(fanout__start, notice->z_class, notice->z_class_inst,
+	    dest.recip->string);
+    sent_init(&sent);
+    cache.len = 0;
+    if (dest.inst) {
+	any = send_to_dest(notice, auth, &dest, &sent, external, &cache);
+	sent_fill(&sent, triplet_lookup(&dest));
     }
 
-    if (send_to_dest(notice, auth, &dest, send_counter, external))
-	any = 1;
-
     /* Send to clients subscribed to the triplet with the instance
-     * substituted with the wildcard instance. */
-    free_string(dest.inst);
+     * substituted with the wildcard instance, skipping those we just
+     * sent to. */
     dest.inst = wildcard_instance;
-    if (send_to_dest(notice, auth, &dest, send_counter, external))
-	any = 1;
+    any += send_to_dest(notice, auth, &dest, &sent, external, &cache);
+    sent_done(&sent);
+    ZPROBE4(fanout__done, notice->z_class, notice->z_class_inst,
+	    dest.recip->string, any);
 
-    free_string(class);
-    free_string(dest.recip);
     if (any)
 	ack(notice, who);
     else
 	nack(notice, who);
 }
 
+static void
+sent_init(Sent_set *set)
+{
+    static int send_counter = 0;
+
+    set->slots = NULL;
+    set->list = NULL;
+    if (!nshards) {
+	send_counter++;
+	if (send_counter == 0)
+	    send_counter = 1;
+	set->counter = send_counter;
+    }
+}
+
+static unsigned int
+sent_hash(Client *client)
+{
+    return (unsigned int) (((unsigned long) client >> 4) * 2654435761UL);
+}
+
+/*
+ * With shards, remember the clients in list, the null-terminated list
+ * for the exact instance, for the wildcard-instance pass.
+ */
+
+static void
+sent_fill(Sent_set *set,
+	  Client **list)
+{
+    unsigned int n, size, h;
+
+    if (!nshards || !list || !*list)
+	return;
+    for (n = 0; list[n]; n++)
+	;
+    for (size = SENT_INLINE; size < 2 * n; size <<= 1)
+	;
+    if (size == SENT_INLINE) {
+	set->slots = set->inline_slots;
+    } else {
+	set->slots = (Client **) malloc(size * sizeof(Client *));
+	if (!set->slots) {
+	    set->list = list;
+	    return;
+	}
+    }
+    memset(set->slots, 0, size * sizeof(Client *));
+    set->mask = size - 1;
+    for (; *list; list++) {
+	for (h = sent_hash(*list) & set->mask; set->slots[h];
+	     h = (h + 1) & set->mask) {
+	    if (set->slots[h] == *list)
+		break;
+	}
+	set->slots[h] = *list;
+    }
+}
+
+/* Returns whether client has had the notice already. */
+
+static int
+sent_skip(Sent_set *set,
+	  Client *client)
+{
+    Client **clientp;
+    unsigned int h;
+
+    if (!nshards) {
+	if (client->last_send == set->counter)
+	    return 1;
+	client->last_send = set->counter;
+	return 0;
+    }
+    if (set->slots) {
+	for (h = sent_hash(client) & set->mask; set->slots[h];
+	     h = (h + 1) & set->mask) {
+	    if (set->slots[h] == client)
+		return 1;
+	}
+    } else if (set->list) {
+	for (clientp = set->list; *clientp; clientp++) {
+	    if (*clientp == client)
+		return 1;
+	}
+    }
+    return 0;
+}
+
+static void
+sent_done(Sent_set *set)
+{
+    if (set->slots && set->slots != set->inline_slots)
+	free(set->slots);
+}
+
+/*
+ * The recipient a notice goes to, as subscriptions name it: empty for
+ * the whole realm, and otherwise with its realm name expanded.  Like
+ * sendit(), this only looks strings up; one that isn't in the string
+ * table is made up in recip, with its text in buf, which must hold
+ * MAX_PRINCIPAL_SIZE bytes.
+ */
+
+static String *
+notice_recipient(ZNotice_t *notice,
+		 char *buf,
+		 String *recip)
+{
+    String *found;
+    char *recipp;
+
+    if (realm_bound_for_realm(ZGetRealm(), notice->z_recipient) &&
+	*notice->z_recipient == '@')
+      return empty;
+
+    strncpy(buf, notice->z_recipient, MAX_PRINCIPAL_SIZE);
+    recipp = strrchr(buf, '@');
+    if (recipp)
+	/* XXX if realm_expand_realm doesn't find a match
+	 * it returns what's passed into it, causing an overlapping
+	 * copy, the results of which are undefined.
+	 */
+	strncpy(recipp + 1, realm_expand_realm(recipp + 1),
+	       MAX_PRINCIPAL_SIZE - (recipp - buf) - 1);
+    /* Recipients match case-insensitively (see ZDest_eq()), so one
+       that isn't interned may still match; look it up by value. */
+    found = find_string(buf, 0);
+    if (!found) {
+	recip->string = buf;
+	recip->hash_val = hash(buf);
+	found = recip;
+    }
+    return found;
+}
+
 /*
- * Send to each client in the list.  Avoid duplicates by setting
- * last_send on each client to send_counter, a nonce which is updated
- * by sendit() above.
+ * Send to each client subscribed to dest that sent doesn't skip.
+ * Returns the number of clients sent to.
  */
 
 static int
 send_to_dest(ZNotice_t *notice,
 	     int auth,
 	     Destination *dest,
-	     int send_counter,
-	     int external)
+	     Sent_set *sent,
+	     int external,
+	     Xmit_cache *cache)
 {
     Client **clientp;
     int any = 0;
@@ -417,24 +683,72 @@ send_to_dest(ZNotice_t *notice,
 	return 0;
 
     for (; *clientp; clientp++) {
-	if ((*clientp)->last_send == send_counter)
+	if (sent_skip(sent, *clientp))
 	    continue;
-	(*clientp)->last_send = send_counter;
 	if ((*clientp)->realm) {
 	  if (external) {
 	    realm_handoff(notice, auth, &clientp[0]->addr, clientp[0]->realm,
 			  1);
-	    any = 1;
+	    any++;
 	  }
 	} else {
-	    xmit(notice, &((*clientp)->addr), auth, *clientp);
-	    any = 1;
+	    xmit(notice, &((*clientp)->addr), auth, *clientp, cache);
+	    any++;
 	}
     }
 
     return any;
 }
 
+/*
+ * The number of clients sendit() would send notice to.  A client that
+ * has both the exact and the wildcard instance is counted once, as it
+ * is sent to once.
+ */
+
+int
+fanout_count(ZNotice_t *notice)
+{
+    char recipbuf[MAX_PRINCIPAL_SIZE];
+    Destination dest;
+    String recip;
+    Sent_set sent;
+    int n = 0;
+
+    dest.classname = find_string(notice->z_class, 1);
+    if (!dest.classname)
+	return 0;
+    dest.inst = find_string(notice->z_class_inst, 1);
+    dest.recip = notice_recipient(notice, recipbuf, &recip);
+
+    sent_init(&sent);
+    if (dest.inst) {
+	n = count_dest(&dest, &sent);
+	sent_fill(&sent, triplet_lookup(&dest));
+    }
+    dest.inst = wildcard_instance;
+    n += count_dest(&dest, &sent);
+    sent_done(&sent);
+    return n;
+}
+
+static int
+count_dest(Destination *dest,
+	   Sent_set *sent)
+{
+    Client **clientp;
+    int n = 0;
+
+    clientp = triplet_lookup(dest);
+    if (!clientp)
+	return 0;
+    for (; *clientp; clientp++) {
+	if (!sent_skip(sent, *clientp))
+	    n++;
+    }
+    return n;
+}
+
 /*
  * Release anything destined for the client in the not-yet-acked table.
  */
@@ -451,7 +765,6 @@ nack_release(Client *client)
 	    if (nacked->client == client) {
 		timer_reset(nacked->timer);
 		Unacked_delete(nacked);
-		free(nacked->packet);
 		free(nacked);
 	    }
 	}
@@ -472,82 +785,156 @@ xmit_frag(ZNotice_t *notice,
 	  int waitforack)
 {
     struct sockaddr_in sin;
-    char *savebuf;
+
+    sin = ZGetDestAddr();
+    return xmit_frag_to(notice, buf, len, &sin);
+}
+
+/*
+ * Make a nack table entry holding a copy of the packet.  The packet
+ * lives in the same block as the entry, so freeing the entry frees it.
+ */
+
+static Unacked *
+nack_alloc(char *packet,
+	   int len)
+{
+    Unacked *nacked;
+
+    nacked = (Unacked *) malloc(sizeof(Unacked) + len);
+    if (!nacked)
+	return NULL;
+    nacked->packet = (char *) (nacked + 1);
+    nacked->packsz = len;
+    memcpy(nacked->packet, packet, len);
+    return nacked;
+}
+
+/*
+ * Put a packet that is about to be sent to dest in the not-yet-acked
+ * table.  This comes before the send: a shard thread can read the ack
+ * and look for the entry before send_packet() has even returned, and
+ * an ack that finds nothing leaves the packet to be retransmitted.
+ */
+
+static Unacked *
+nack_enter(char *packet,
+	   int len,
+	   ZUnique_Id_t *uid,
+	   struct sockaddr_in *dest,
+	   Client *client)
+{
+    Unacked *nacked;
+
+    nacked = nack_alloc(packet, len);
+    if (!nacked)
+	return NULL;
+    nacked->client = client;
+    nacked->rexmits = 0;
+    nacked->dest.addr = *dest;
+    nacked->uid = *uid;
+    (void) gettimeofday(&nacked->sent, (struct timezone *)0);
+    pthread_mutex_lock(&nack_lock);
+    nacked->timer = timer_set_rel_ms(client_rto(client, 0), rexmit, nacked);
+    Unacked_insert(&nacktab[nacktab_hashval(*dest, *uid)], nacked);
+    pthread_mutex_unlock(&nack_lock);
+    return nacked;
+}
+
+/*
+ * Sending the packet for an entry from nack_enter() failed.  If the
+ * socket was just full, leave the entry to retransmit it without
+ * counting the failed send as a try; otherwise drop it.  The entry may
+ * already be gone if a stray ack for the same UID came in meanwhile, so
+ * it is looked up by its key rather than used directly.
+ */
+
+static void
+nack_send_failed(Unacked *nacked,
+		 struct sockaddr_in *dest,
+		 ZUnique_Id_t *uid,
+		 Code_t retval)
+{
+    Unacked *p;
+
+    pthread_mutex_lock(&nack_lock);
+    for (p = nacktab[nacktab_hashval(*dest, *uid)];
+	 p && p != nacked; p = p->next)
+	;
+    if (p && (retval == EAGAIN || retval == ENOBUFS)) {
+	p->rexmits = -1;
+	p = NULL;
+    } else if (p) {
+	timer_reset(p->timer);
+	Unacked_delete(p);
+    }
+    pthread_mutex_unlock(&nack_lock);
+    free(p);
+}
+
+static Code_t
+xmit_frag_to(ZNotice_t *notice,
+	     char *buf,
+	     int len,
+	     struct sockaddr_in *dest)
+{
+    struct sockaddr_in sin = *dest;
     Unacked *nacked;
     Code_t retval;
-    int sendfail = 0;
 
-    retval = ZSendPacket(buf, len, 0);
+    ZPROBE4(notice__xmit, sin.sin_addr.s_addr, sin.sin_port, len, 0);
+    /* mark it as not ack'ed, then send it */
+    nacked = nack_enter(buf, len, &notice->z_uid, &sin, NULL);
+    retval = send_packet(buf, len, &sin);
     if (retval != ZERR_NONE) {
 	syslog(LOG_WARNING, "xmit_frag send: %s", error_message(retval));
+	if (nacked)
+	    nack_send_failed(nacked, &sin, &notice->z_uid, retval);
 	if (retval != EAGAIN && retval != ENOBUFS)
 	    return retval;
-	sendfail = 1;
     }
-
-    /* now we've sent it, mark it as not ack'ed */
-    nacked = (Unacked *) malloc(sizeof(Unacked));
     if (!nacked) {
 	/* no space: just punt */
 	syslog(LOG_WARNING, "xmit_frag nack malloc");
 	return ENOMEM;
     }
-
-    savebuf = (char *) malloc(len);
-    if (!savebuf) {
-	/* no space: just punt */
-	syslog(LOG_WARNING, "xmit_frag pack malloc");
-	free(nacked);
-	return ENOMEM;
-    }
-
-    memcpy(savebuf, buf, len);
-
-    sin = ZGetDestAddr();
-    nacked->client = NULL;
-    nacked->rexmits = (sendfail) ? -1 : 0;
-    nacked->packet = savebuf;
-    nacked->dest.addr = sin;
-    nacked->packsz = len;
-    nacked->uid = notice->z_uid;
-    nacked->timer = timer_set_rel(rexmit_times[0], rexmit, nacked);
-    Unacked_insert(&nacktab[nacktab_hashval(sin, nacked->uid)], nacked);
     return(ZERR_NONE);
 }
 
 
 /*
- * Send the notice to the client.  After transmitting, put it onto the
- * not ack'ed list.
+ * Send the notice to the client, putting it onto the not ack'ed list
+ * first.
  */
 
 void
 xmit(ZNotice_t *notice,
      struct sockaddr_in *dest,
      int auth,
-     Client *client)
+     Client *client,
+     Xmit_cache *cache)
 {
-    char *noticepack;
+    ZPacket_t packbuf;
+    char *noticepack = packbuf;
+    char addrbuf[INET_ADDRSTRLEN];
     Unacked *nacked;
-    int packlen, sendfail = 0;
+    int packlen;
     Code_t retval;
 
-    noticepack = (char *) malloc(sizeof(ZPacket_t));
-    if (!noticepack) {
-	syslog(LOG_ERR, "xmit malloc");
-	return;			/* DON'T put on nack list */
-    }
-
     packlen = sizeof(ZPacket_t);
 
     if (auth && client) {
 	/* we are distributing authentic and we have a pointer to auth info */
 #if defined(HAVE_KRB5)
+	shard_krb_lock();
 	retval = ZFormatAuthenticNoticeV5(notice, noticepack, packlen,
 					  &packlen, client->session_keyblock);
+	shard_krb_unlock();
 #elif defined(HAVE_KRB4)
+	shard_krb_lock();
 	retval = ZFormatAuthenticNotice(notice, noticepack, packlen,
 					&packlen, client->session_key);
+	shard_krb_unlock();
 #else /* !HAVE_KRB4 */
 	notice->z_auth = 1;
 	retval = ZFormatSmallRawNotice(notice, noticepack, &packlen);
@@ -558,7 +945,17 @@ xmit(ZNotice_t *notice,
 	notice->z_auth = 0;
 	notice->z_authent_len = 0;
 	notice->z_ascii_authent = (char *)"";
-	retval = ZFormatSmallRawNotice(notice, noticepack, &packlen);
+	/* Every client gets the same bytes, so format them only once. */
+	if (cache)
+	    noticepack = cache->packet;
+	if (cache && cache->len) {
+	    packlen = cache->len;
+	    retval = ZERR_NONE;
+	} else {
+	    retval = ZFormatSmallRawNotice(notice, noticepack, &packlen);
+	    if (retval == ZERR_NONE && cache)
+		cache->len = packlen;
+	}
         /* This code is needed because a Zephyr can "grow" when a remote
          * realm name is inserted into the Zephyr before being resent out
          * locally. It essentially matches the code in realm.c to do the
@@ -575,14 +972,6 @@ xmit(ZNotice_t *notice,
           int origoffset = 0;
 	  int origlen = notice->z_message_len;
 
-          free(noticepack);
-
-          retval = ZSetDestAddr(dest);
-          if (retval) {
-            syslog(LOG_WARNING, "xmit: ZSetDestAddr: %s", error_message(retval));
-            return;
-          }
-
           partnotice.z_auth = 0;
           partnotice.z_authent_len = 0;
           partnotice.z_ascii_authent = (char *)"";
@@ -642,7 +1031,8 @@ xmit(ZNotice_t *notice,
             (void) memcpy(buffer + hdrlen, partnotice.z_message,
 			  partnotice.z_message_len);
 
-            xmit_frag(&partnotice, buffer, hdrlen + partnotice.z_message_len, 0);
+            xmit_frag_to(&partnotice, buffer,
+			 hdrlen + partnotice.z_message_len, dest);
 
             offset += fragsize;
 
@@ -658,45 +1048,24 @@ xmit(ZNotice_t *notice,
 		   error_message(retval));
     }
     if (!retval) {
-	retval = ZSetDestAddr(dest);
-	if (retval)
-	    syslog(LOG_WARNING, "xmit: ZSetDestAddr: %s", error_message(retval));
-    }
-    if (!retval) {
-	retval = ZSendPacket(noticepack, packlen, 0);
-	if (retval) {
-	    syslog(LOG_WARNING, "xmit: ZSendPacket: (%s/%d) %s",
-		   inet_ntoa(dest->sin_addr), ntohs(dest->sin_port),
-		   error_message(retval));
-	    if (retval == EAGAIN || retval == ENOBUFS) {
-		retval = ZERR_NONE;
-		sendfail = 1;
-	    }
-	}
-    }
-
-    /* now we've sent it, mark it as not ack'ed */
-    if (!retval) {
-	nacked = (Unacked *) malloc(sizeof(Unacked));
+	ZPROBE4(notice__xmit, dest->sin_addr.s_addr, dest->sin_port, packlen,
+		auth);
+	/* mark it as not ack'ed, then send it */
+	nacked = nack_enter(noticepack, packlen, &notice->z_uid, dest, client);
 	if (!nacked) {
-	    /* no space: just punt */
+	    /* no space: send it anyway, but don't retransmit it */
 	    syslog(LOG_WARNING, "xmit nack malloc");
-	    retval = ENOMEM;
+	}
+	retval = send_packet(noticepack, packlen, dest);
+	if (retval) {
+	    syslog(LOG_WARNING, "xmit: send_packet: (%s/%d) %s",
+		   inet_ntop(AF_INET, &dest->sin_addr, addrbuf,
+			     sizeof(addrbuf)),
+		   ntohs(dest->sin_port), error_message(retval));
+	    if (nacked)
+		nack_send_failed(nacked, dest, &notice->z_uid, retval);
 	}
     }
-
-    if (!retval) {
-	nacked->client = client;
-	nacked->rexmits = (sendfail) ? -1 : 0;
-	nacked->packet = noticepack;
-	nacked->dest.addr = *dest;
-	nacked->packsz = packlen;
-	nacked->uid = notice->z_uid;
-	nacked->timer = timer_set_rel(rexmit_times[0], rexmit, nacked);
-	Unacked_insert(&nacktab[nacktab_hashval(*dest, nacked->uid)], nacked);
-    }
-    if (retval)
-	free(noticepack);
 }
 
 /*
@@ -711,9 +1080,11 @@ rexmit(void *arg)
     Unacked *nacked = (Unacked *) arg;
     int retval;
 
-    syslog(LOG_DEBUG, "rexmit %s/%d #%d time %d",
+    zdbug((LOG_DEBUG, "rexmit %s/%d #%d time %d",
 	   inet_ntoa(nacked->dest.addr.sin_addr),
-	   ntohs(nacked->dest.addr.sin_port), nacked->rexmits + 1, (int)NOW);
+	   ntohs(nacked->dest.addr.sin_port), nacked->rexmits + 1, (int)NOW));
+    ZPROBE3(notice__rexmit, nacked->dest.addr.sin_addr.s_addr,
+	    nacked->dest.addr.sin_port, nacked->rexmits + 1);
 
     nacked->rexmits++;
     if (rexmit_times[nacked->rexmits] == -1) {
@@ -730,7 +1101,6 @@ rexmit(void *arg)
 		server_kill_clt(nacked->client);
 		client_deregister(nacked->client, 1);
 	    }
-	    free(nacked->packet);
 	    free(nacked);
 	    return;
 	} else {
@@ -741,23 +1111,68 @@ rexmit(void *arg)
     }
 
     /* retransmit the packet */
-    retval = ZSetDestAddr(&nacked->dest.addr);
-    if (retval != ZERR_NONE) {
-	syslog(LOG_WARNING, "rexmit set addr: %s", error_message(retval));
-    } else {
-	retval = ZSendPacket(nacked->packet, nacked->packsz, 0);
-	if (retval != ZERR_NONE)
-	    syslog(LOG_WARNING, "rexmit xmit: %s", error_message(retval));
-	if (retval == EAGAIN || retval == ENOBUFS)
-	    nacked->rexmits--;
-    }
+    retval = send_packet(nacked->packet, nacked->packsz, &nacked->dest.addr);
+    if (retval != ZERR_NONE)
+	syslog(LOG_WARNING, "rexmit xmit: %s", error_message(retval));
+    if (retval == EAGAIN || retval == ENOBUFS)
+	nacked->rexmits--;
+    else if (retval == ZERR_NONE)
+	(void) gettimeofday(&nacked->sent, (struct timezone *)0);
 
     /* reset the timer */
-    nacked->timer = timer_set_rel(rexmit_times[nacked->rexmits], rexmit,
-				  nacked);
+    nacked->timer = timer_set_rel_ms(client_rto(nacked->client,
+						nacked->rexmits),
+				     rexmit, nacked);
     return;
 }
 
+/*
+ * Each client's retransmit timer follows its own round trip, sampled
+ * from sending a notice to the client's ack for notices that were not
+ * retransmitted; the ack for a retransmitted one could be for either
+ * copy.  nack_cancel() counts such an ack as a spurious retransmission
+ * when it came back sooner than rtt_min.
+ */
+
+void
+client_rtt_sample(Client *client,
+		  long rtt)
+{
+    if (!client->srtt || rtt < client->rtt_min)
+	client->rtt_min = rtt;
+    Z_RttSample(&client->srtt, &client->rttvar, rtt);
+}
+
+/*
+ * The time, in msec, to wait after transmission number rexmits.
+ * rexmit_times[] is the ceiling, and until the client has acked
+ * something, the schedule itself.
+ */
+long
+client_rto(Client *client,
+	   int rexmits)
+{
+    long max;
+
+    if (rexmits < 0)
+	rexmits = 0;
+    max = rexmit_times[rexmits] * 1000L;
+    if (!client)
+	return max;
+    return Z_Rto(client->srtt, client->rttvar, REXMIT_MIN_MSEC, max,
+		 rexmits);
+}
+
+static long
+usec_since(struct timeval *then)
+{
+    struct timeval now;
+
+    (void) gettimeofday(&now, (struct timezone *)0);
+    return (now.tv_sec - then->tv_sec) * 1000000L +
+	(now.tv_usec - then->tv_usec);
+}
+
 /*
  * Send an acknowledgement to the sending client, by sending back the
  * header from the original notice with the z_kind field changed to either
@@ -826,12 +1241,7 @@ clt_ack(ZNotice_t *notice,
 	syslog(LOG_ERR, "clt_ack format: %s", error_message(retval));
 	return;
     }
-    retval = ZSetDestAddr(who);
-    if (retval != ZERR_NONE) {
-	syslog(LOG_WARNING, "clt_ack set addr: %s", error_message(retval));
-	return;
-    }
-    retval = ZSendPacket(ackpack, packlen, 0);
+    retval = send_packet(ackpack, packlen, who);
     if (retval != ZERR_NONE) {
 	syslog(LOG_WARNING, "clt_ack xmit: %s", error_message(retval));
 	return;
@@ -841,6 +1251,25 @@ clt_ack(ZNotice_t *notice,
     return;
 }
 
+/*
+ * Send a packet to dest from the server socket.  Unlike ZSendPacket(),
+ * this doesn't go through the library's destination address, so shard
+ * threads can use it concurrently.
+ */
+
+static Code_t
+send_packet(char *packet,
+	    int len,
+	    struct sockaddr_in *dest)
+{
+    if (len > Z_MAXPKTLEN)
+	return ZERR_PKTLEN;
+    if (sendto(srv_socket, packet, len, 0, (struct sockaddr *) dest,
+	       sizeof(*dest)) < 0)
+	return errno;
+    return ZERR_NONE;
+}
+
 /*
  * An ack has arrived.
  * remove the packet matching this notice from the not-yet-acked queue
@@ -852,22 +1281,36 @@ nack_cancel(ZNotice_t *notice,
 {
     Unacked *nacked;
     int hashval;
+    long rtt;
 
     /* search the not-yet-acked table for this packet, and flush it. */
     hashval = nacktab_hashval(*who, notice->z_uid);
+    pthread_mutex_lock(&nack_lock);
     for (nacked = nacktab[hashval]; nacked; nacked = nacked->next) {
 	if (nacked->dest.addr.sin_addr.s_addr == who->sin_addr.s_addr
 	    && nacked->dest.addr.sin_port == who->sin_port
 	    && ZCompareUID(&nacked->uid, &notice->z_uid)) {
-	    if (nacked->client)
+	    ZPROBE3(notice__ack, who->sin_addr.s_addr, who->sin_port,
+		    nacked->rexmits);
+	    if (nacked->client) {
 		nacked->client->last_ack = NOW;
+		rtt = usec_since(&nacked->sent);
+		/* An ack sooner than any round trip we have seen
+		   after we retransmitted was for the first copy. */
+		if (nacked->rexmits == 0)
+		    client_rtt_sample(nacked->client, rtt);
+		else if (nacked->rexmits > 0 &&
+			 rtt < nacked->client->rtt_min)
+		    spurious_rexmits.val++;
+	    }
 	    timer_reset(nacked->timer);
-	    free(nacked->packet);
 	    Unacked_delete(nacked);
+	    pthread_mutex_unlock(&nack_lock);
 	    free(nacked);
 	    return;
 	}
     }
+    pthread_mutex_unlock(&nack_lock);
 
     zdbug((LOG_DEBUG,"nack_cancel: nack not found %s:%08X,%08X",
 	   inet_ntoa (notice->z_uid.zuid_addr),
@@ -911,6 +1354,9 @@ hostm_dispatch(ZNotice_t *notice,
 	}
     } else if (strcmp(opcode, HM_DETACH) == 0) {
 	remove_it = 1;
+    } else if (strcmp(opcode, HM_PING) == 0) {
+	/* The HM is timing us against the other servers. */
+	ack(notice, who);
     } else {
 	syslog(LOG_WARNING, "hm_dispatch: unknown opcode %s", opcode);
     }
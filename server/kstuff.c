@@ -20,6 +20,8 @@ static const char rcsid_kstuff_c[] = "$Id$";
 #endif
 #endif
 
+static Code_t check_srv_authentication(ZNotice_t *, struct sockaddr_in *,
+				       char *);
 #if defined(HAVE_KRB4) && defined(HAVE_KRB5)
 static Code_t ZCheckAuthentication4(ZNotice_t *notice, struct sockaddr_in *from);
 #endif
@@ -244,6 +246,21 @@ Code_t
 ZCheckSrvAuthentication(ZNotice_t *notice,
 			struct sockaddr_in *from,
 			char *realm)
+{
+    Code_t result;
+
+    ZPROBE3(auth__start, (int) notice->z_kind, notice->z_class,
+	    notice->z_sender);
+    result = check_srv_authentication(notice, from, realm);
+    ZPROBE4(auth__done, (int) notice->z_kind, notice->z_class,
+	    notice->z_sender, result);
+    return result;
+}
+
+static Code_t
+check_srv_authentication(ZNotice_t *notice,
+			 struct sockaddr_in *from,
+			 char *realm)
 {
 #ifdef HAVE_KRB5
     unsigned char *authbuf;
@@ -121,7 +121,7 @@ main(int argc,
     programname = (programname) ? programname + 1 : argv[0];
 
     /* process arguments */
-    while ((optchar = getopt(argc, argv, "dsnv4f:k:")) != EOF) {
+    while ((optchar = getopt(argc, argv, "dsnv4f:k:l:w:")) != EOF) {
 	switch(optchar) {
 	  case 'd':
 	    zdebug = 1;
@@ -149,6 +149,16 @@ main(int argc,
 	case '4':
 	    bdump_auth_proto = 4;
 	    break;
+	  case 'l':
+	    rate_limit = atoi(optarg);
+	    if (rate_limit < 0)
+		usage();
+	    break;
+	  case 'w':
+	    nshards = atoi(optarg);
+	    if (nshards < 0)
+		usage();
+	    break;
 	  case '?':
 	  default:
 	    usage();
@@ -207,6 +217,11 @@ main(int argc,
     if (init_from_dump)
 	read_from_dump(dumpfile);
 
+    throttle_init();
+
+    if (shard_init())
+	exit(1);
+
     /* Seed random number set.  */
     srandom(getpid() ^ time(0));
 
@@ -254,6 +269,10 @@ main(int argc,
 
     syslog(LOG_NOTICE, "Ready for action");
 
+    /* From here on, hold the state lock except while waiting for input,
+       so that shard threads can run. */
+    shard_lock();
+
     /* Reinitialize t_local now that initialization is done. */
     gettimeofday(&t_local, NULL);
     uptime = NOW;
@@ -268,10 +287,11 @@ main(int argc,
 	    dump_strings();
 
 	timer_process();
+	throttle_process();
 
 	readable = interesting;
 	FD_ZERO(&writable);
-	tvp = timer_timeout(&tv);
+	tvp = shard_timeout(throttle_timeout(timer_timeout(&tv), &tv), &tv);
 #ifdef HAVE_ARES
 	nselect = ares_fds(achannel, &readable, &writable);
 	if (nselect < nfds)
@@ -287,7 +307,9 @@ main(int argc,
 	    FD_ZERO(&readable);
 	    FD_ZERO(&writable);
 	} else  {
+	    shard_unlock();
 	    nfound = select(nselect, &readable, &writable, NULL, tvp);
+	    shard_lock();
 	}
 
 	/* Initialize t_local for other uses */
@@ -439,6 +461,15 @@ do_net_setup(void)
 	syslog(LOG_ERR, "client_sock failed: %m");
 	return 1;
     }
+#ifdef SO_REUSEPORT
+    /* Let the shard threads bind the port too. */
+    flags = 1;
+    if (nshards && setsockopt(srv_socket, SOL_SOCKET, SO_REUSEPORT, &flags,
+			      sizeof(flags)) < 0) {
+	syslog(LOG_ERR, "client SO_REUSEPORT failed: %m");
+	return 1;
+    }
+#endif
     if (bind(srv_socket, (struct sockaddr *) &srv_addr,
 	     sizeof(srv_addr)) < 0) {
 	syslog(LOG_ERR, "client bind failed: %m");
@@ -467,11 +498,11 @@ static void
 usage(void)
 {
 #ifdef DEBUG
-	fprintf(stderr, "Usage: %s [-d] [-s] [-n] [-k realm] [-f dumpfile]\n",
-		programname);
+	fprintf(stderr, "Usage: %s [-d] [-s] [-n] [-k realm] [-f dumpfile] "
+		"[-l rate] [-w shards]\n", programname);
 #else
-	fprintf(stderr, "Usage: %s [-d] [-n] [-k realm] [-f dumpfile]\n",
-		programname);
+	fprintf(stderr, "Usage: %s [-d] [-n] [-k realm] [-f dumpfile] "
+		"[-l rate] [-w shards]\n", programname);
 #endif /* DEBUG */
 	exit(2);
 }
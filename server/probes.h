@@ -0,0 +1,56 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It contains the static tracepoints compiled into the server.
+ *
+ *	$Id$
+ *
+ *	Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *	For copying and distribution information, see the file
+ *	"mit-copyright.h".
+ */
+
+#ifndef __PROBES_H__
+#define __PROBES_H__
+#include <zephyr/mit-copyright.h>
+
+/*
+ * With --enable-usdt each ZPROBE* expands to an SDT marker in the
+ * "zephyrd" provider, visible to bpftrace/perf/systemtap as
+ * usdt:zephyrd:<name>.  Otherwise the probes, including the evaluation
+ * of their arguments, are compiled out entirely.
+ *
+ * Probes (arguments in order):
+ *	packet__receive	 addr, port, len
+ *	packet__parse	 addr, kind, class, status
+ *	auth__start	 kind, class, sender
+ *	auth__done	 kind, class, sender, result
+ *	dispatch__class	 addr, kind, class, from_server
+ *	fanout__start	 class, inst, recipient
+ *	fanout__done	 class, inst, recipient, nclients
+ *	notice__xmit	 addr, port, len, auth
+ *	notice__ack	 addr, port, rexmits
+ *	notice__rexmit	 addr, port, rexmits
+ *	server__forward	 addr, len
+ *	server__ack	 addr
+ *	server__rexmit	 addr, rexmits
+ *	throttle__defer	 addr, class, cost
+ *	throttle__drop	 addr, class, cost
+ *
+ * Addresses and ports are passed in network byte order; strings are
+ * NUL-terminated char pointers.
+ */
+
+#ifdef HAVE_USDT
+#include <sys/sdt.h>
+
+#define ZPROBE1(name, a)		DTRACE_PROBE1(zephyrd, name, a)
+#define ZPROBE2(name, a, b)		DTRACE_PROBE2(zephyrd, name, a, b)
+#define ZPROBE3(name, a, b, c)		DTRACE_PROBE3(zephyrd, name, a, b, c)
+#define ZPROBE4(name, a, b, c, d)	DTRACE_PROBE4(zephyrd, name, a, b, c, d)
+#else
+#define ZPROBE1(name, a)
+#define ZPROBE2(name, a, b)
+#define ZPROBE3(name, a, b, c)
+#define ZPROBE4(name, a, b, c, d)
+#endif
+
+#endif /* __PROBES_H__ */
@@ -810,6 +810,7 @@ realm_init(void)
 	client->principal = make_string(rlmprinc, 0);
 	client->last_send = 0;
 	client->last_ack = NOW;
+	client->srtt = client->rttvar = client->rtt_min = 0;
 	client->subs = NULL;
 	client->realm = rlm;
 	client->addr.sin_family = 0;
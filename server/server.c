@@ -743,7 +743,9 @@ send_stats(struct sockaddr_in *who)
     sprintf(buf, "%ld seconds operational",NOW - uptime);
     upt = strsave(buf);
 
-    extrafields += nrealms;
+    extrafields += nrealms + 1;
+    if (rate_limit)
+	extrafields += 2;
     responses = (char **) malloc((NUM_FIXED + nservers + extrafields) *
 				 sizeof(char *));
     responses[0] = vers;
@@ -765,6 +767,14 @@ send_stats(struct sockaddr_in *who)
 	      rlm_states[(int) realm->state]);
       responses[num_resp++] = strsave(buf);
     }
+    if (rate_limit) {
+	sprintf(buf, "%d %s", throttle_deferred.val, throttle_deferred.str);
+	responses[num_resp++] = strsave(buf);
+	sprintf(buf, "%d %s", throttle_dropped.val, throttle_dropped.str);
+	responses[num_resp++] = strsave(buf);
+    }
+    sprintf(buf, "%d %s", spurious_rexmits.val, spurious_rexmits.str);
+    responses[num_resp++] = strsave(buf);
 
     send_msg_list(who, ADMIN_STATUS, responses, num_resp, 0);
 
@@ -1219,6 +1229,7 @@ server_forw_reliable(Server *server,
 	free(pack);
 	return;
     }
+    ZPROBE2(server__forward, server->addr.sin_addr.s_addr, packlen);
     retval = ZSendPacket(pack, packlen, 0);
     if (retval != ZERR_NONE) {
 	syslog(LOG_WARNING, "srv_fwd xmit: %s", error_message(retval));
@@ -1293,6 +1304,7 @@ srv_nack_cancel(ZNotice_t *notice,
     for (nacked = srv_nacktab[hashval]; nacked; nacked = nacked->next) {
 	if (nacked->dest.srv_idx == server - otherservers
 	    && ZCompareUID(&nacked->uid, &notice->z_uid)) {
+	    ZPROBE1(server__ack, server->addr.sin_addr.s_addr);
 	    timer_reset(nacked->timer);
 	    free(nacked->packet);
 	    Unacked_delete(nacked);
@@ -1320,6 +1332,9 @@ srv_rexmit(void *arg)
 	free(packet);
 	return;
     }
+    ZPROBE2(server__rexmit,
+	    otherservers[packet->dest.srv_idx].addr.sin_addr.s_addr,
+	    packet->rexmits + 1);
     retval = ZSetDestAddr(&otherservers[packet->dest.srv_idx].addr);
     if (retval != ZERR_NONE) {
 	syslog(LOG_WARNING, "srv_rexmit set addr: %s", error_message(retval));
@@ -0,0 +1,245 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It contains functions for running the server on several threads.
+ *
+ *	Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *	For copying and distribution information, see the file
+ *	"mit-copyright.h".
+ */
+
+#include <zephyr/mit-copyright.h>
+#include "zserver.h"
+#include <sys/socket.h>
+#include <signal.h>
+
+/*
+ * Sharded operation.
+ *
+ * External functions are:
+ *
+ * int shard_init()
+ *
+ * void shard_lock()
+ *
+ * void shard_unlock()
+ *
+ * void shard_krb_lock()
+ *
+ * void shard_krb_unlock()
+ *
+ * struct timeval *shard_timeout(tvp, tvbuf)
+ *	struct timeval *tvp, *tvbuf;
+ *
+ * With -w N, the server opens N extra client sockets on the server
+ * port with SO_REUSEPORT, and the kernel spreads incoming packets
+ * across them and srv_socket.  Each extra socket is owned by a shard
+ * thread, which receives and parses its own packets.
+ *
+ * All server state is guarded by a single reader/writer lock.  The
+ * main thread holds it exclusively whenever it is not waiting in
+ * select(), so everything it does (timers, brain dumps, control and
+ * location notices, server traffic) runs exactly as it does
+ * unsharded.  A shard thread takes the lock shared to handle client
+ * acks and ordinary class notices, which covers authentication, the
+ * subscription lookups in triplet_lookup() and the fan-out to
+ * subscribers; readers never wait for each other.  Anything else is
+ * handed back to handle_notice() under the exclusive lock.  See
+ * handle_notice_shared() in dispatch.c for what the shared path may
+ * touch.  Code on it formats addresses with inet_ntop(), since POSIX
+ * lets inet_ntoa() return one buffer shared by every thread, even
+ * though glibc's is per thread.
+ *
+ * Since the main thread updates t_local only while it holds the lock
+ * exclusively, shard threads can use NOW without further locking.  To
+ * keep it fresh, and to pick up retransmit timers set by the shards,
+ * the main thread's select() timeout is capped at SHARD_TICK.
+ */
+
+#define SHARD_TICK	100000		/* usecs between main loop wakeups */
+
+struct shard {
+    pthread_t thread;
+    int fd;
+    int idx;
+};
+
+int nshards = 0;			/* number of shard threads */
+
+static struct shard *shards;
+static pthread_rwlock_t state_lock;
+static pthread_mutex_t krb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *shard_main(void *);
+
+/*
+ * Set up the state lock, and if sharding was requested, open the shard
+ * sockets and start their threads.  Called after initialize(), with
+ * srv_socket already bound with SO_REUSEPORT.
+ */
+
+int
+shard_init(void)
+{
+    pthread_rwlockattr_t attr;
+    sigset_t mask, omask;
+    int i, on = 1;
+
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    /* The main thread is the only writer; don't let a steady stream of
+       shard readers starve it. */
+    pthread_rwlockattr_setkind_np(&attr,
+				  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&state_lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    if (!nshards)
+	return 0;
+#ifndef SO_REUSEPORT
+    syslog(LOG_ERR, "shard_init: SO_REUSEPORT is not supported here");
+    return 1;
+#else
+    shards = (struct shard *) calloc(nshards, sizeof(struct shard));
+    if (!shards) {
+	syslog(LOG_ERR, "shard_init: no memory for shards");
+	return 1;
+    }
+
+    /* Signals are for the main thread. */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, &omask);
+
+    for (i = 0; i < nshards; i++) {
+	shards[i].idx = i;
+	shards[i].fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (shards[i].fd < 0) {
+	    syslog(LOG_ERR, "shard %d socket failed: %m", i);
+	    break;
+	}
+	if (setsockopt(shards[i].fd, SOL_SOCKET, SO_REUSEPORT, &on,
+		       sizeof(on)) < 0) {
+	    syslog(LOG_ERR, "shard %d SO_REUSEPORT failed: %m", i);
+	    break;
+	}
+	if (bind(shards[i].fd, (struct sockaddr *) &srv_addr,
+		 sizeof(srv_addr)) < 0) {
+	    syslog(LOG_ERR, "shard %d bind failed: %m", i);
+	    break;
+	}
+	if (pthread_create(&shards[i].thread, NULL, shard_main,
+			   &shards[i]) != 0) {
+	    syslog(LOG_ERR, "shard %d thread creation failed", i);
+	    break;
+	}
+    }
+
+    pthread_sigmask(SIG_SETMASK, &omask, NULL);
+    if (i < nshards)
+	return 1;
+    syslog(LOG_INFO, "running %d shard threads", nshards);
+    return 0;
+#endif /* SO_REUSEPORT */
+}
+
+/*
+ * Take or release the state lock exclusively.
+ */
+
+void
+shard_lock(void)
+{
+    pthread_rwlock_wrlock(&state_lock);
+}
+
+void
+shard_unlock(void)
+{
+    pthread_rwlock_unlock(&state_lock);
+}
+
+/*
+ * Serialize Kerberos calls from shard threads, which share the
+ * library's context.
+ */
+
+void
+shard_krb_lock(void)
+{
+    pthread_mutex_lock(&krb_lock);
+}
+
+void
+shard_krb_unlock(void)
+{
+    pthread_mutex_unlock(&krb_lock);
+}
+
+/*
+ * Cap the main loop's select() timeout while shards are running.
+ */
+
+struct timeval *
+shard_timeout(struct timeval *tvp,
+	      struct timeval *tvbuf)
+{
+    if (!nshards)
+	return tvp;
+    if (tvp && tvp->tv_sec == 0 && tvp->tv_usec <= SHARD_TICK)
+	return tvp;
+    tvbuf->tv_sec = 0;
+    tvbuf->tv_usec = SHARD_TICK;
+    return tvbuf;
+}
+
+static void *
+shard_main(void *arg)
+{
+    struct shard *shard = (struct shard *) arg;
+    ZPacket_t input_packet;
+    ZNotice_t new_notice;
+    struct sockaddr_in whoisit;
+    socklen_t fromlen;
+    char addrbuf[INET_ADDRSTRLEN];
+    int input_len;
+    Code_t status;
+
+    for (;;) {
+	fromlen = sizeof(whoisit);
+	input_len = recvfrom(shard->fd, input_packet, sizeof(input_packet),
+			     0, (struct sockaddr *) &whoisit, &fromlen);
+	if (input_len < 0) {
+	    if (errno != EINTR)
+		syslog(LOG_WARNING, "shard %d receive: %m", shard->idx);
+	    continue;
+	}
+
+	pthread_rwlock_rdlock(&state_lock);
+	__sync_fetch_and_add(&npackets, 1);
+	ZPROBE3(packet__receive, whoisit.sin_addr.s_addr, whoisit.sin_port,
+		input_len);
+	status = ZParseNotice(input_packet, input_len, &new_notice);
+	ZPROBE4(packet__parse, whoisit.sin_addr.s_addr,
+		status == ZERR_NONE ? (int) new_notice.z_kind : -1,
+		status == ZERR_NONE ? new_notice.z_class : NULL, status);
+	if (status != ZERR_NONE) {
+	    pthread_rwlock_unlock(&state_lock);
+	    syslog(LOG_ERR, "bad notice parse (%s): %s",
+		   inet_ntop(AF_INET, &whoisit.sin_addr, addrbuf,
+			     sizeof(addrbuf)),
+		   error_message(status));
+	    continue;
+	}
+
+	if (handle_notice_shared(&new_notice, &whoisit)) {
+	    pthread_rwlock_unlock(&state_lock);
+	    continue;
+	}
+	pthread_rwlock_unlock(&state_lock);
+
+	/* Needs the whole server to itself. */
+	shard_lock();
+	handle_notice(&new_notice, &whoisit);
+	shard_unlock();
+    }
+    return NULL;
+}
@@ -75,6 +75,8 @@ int failures = 0;
 
 void test_uloc(void);
 void test_acl_files(void);
+void test_rto(void);
+void test_throttle(void);
 
 int
 main(int argc, char **argv)
@@ -89,6 +91,8 @@ main(int argc, char **argv)
 
     test_uloc();
     test_acl_files();
+    test_rto();
+    test_throttle();
 
     if(failures)
         printf("\n%d FAILURES\n", failures);
@@ -346,3 +350,189 @@ test_acl_files(){
     unlink(filename);
     puts("");
 }
+
+void
+test_rto(void)
+{
+    Client client;
+
+    memset(&client, 0, sizeof(client));
+
+    puts("adaptive retransmit times");
+    puts("");
+
+    PP("no samples");
+    TEST(client_rto(NULL, 0) == 2000);
+    TEST(client_rto(&client, 0) == 2000);
+    TEST(client_rto(&client, 4) == 8000);
+    TEST(client_rto(&client, -1) == 2000);
+
+    PP("one LAN sample of 1000 usec");
+    V(client_rtt_sample(&client, 1000));
+    TEST(client.srtt == 1000);
+    TEST(client.rttvar == 500);
+    TEST(client.rtt_min == 1000);
+    TEST(client_rto(&client, 0) == REXMIT_MIN_MSEC);
+    TEST(client_rto(&client, 1) == 2 * REXMIT_MIN_MSEC);
+    TEST(client_rto(&client, 3) == 8 * REXMIT_MIN_MSEC);
+    TEST(client_rto(&client, 4) == 16 * REXMIT_MIN_MSEC);
+    TEST(client_rto(&client, 11) == 2048 * REXMIT_MIN_MSEC);
+
+    PP("a slow sample");
+    V(client_rtt_sample(&client, 801000));
+    TEST(client.srtt == 101000);
+    TEST(client.rttvar == 200375);
+    TEST(client.rtt_min == 1000);
+    TEST(client_rto(&client, 0) == 902);
+    TEST(client_rto(&client, 1) == 1804);
+    TEST(client_rto(&client, 2) == 3608);
+
+    PP("never longer than the table");
+    memset(&client, 0, sizeof(client));
+    V(client_rtt_sample(&client, 5000000));
+    TEST(client_rto(&client, 0) == 2000);
+    TEST(client_rto(&client, 5) == 8000);
+    puts("");
+}
+
+/* Send a class notice with the given UID serial number to throttle_admit(). */
+static int
+admit(ZNotice_t *notice,
+      int serial,
+      int auth,
+      struct sockaddr_in *who)
+{
+    notice->z_uid.tv.tv_usec = htonl(serial);
+    return throttle_admit(notice, auth, who);
+}
+
+/* Count the NOT_SENT acknowledgements waiting on fd. */
+static int
+refused(int fd)
+{
+    ZPacket_t pkt;
+    ZNotice_t notice;
+    int len, n = 0;
+
+    while ((len = recv(fd, pkt, sizeof(pkt), MSG_DONTWAIT)) > 0) {
+	if (ZParseNotice(pkt, len, &notice) == ZERR_NONE &&
+	    notice.z_kind == SERVACK &&
+	    strcmp(notice.z_message, ZSRVACK_NOTSENT) == 0)
+	    n++;
+    }
+    return n;
+}
+
+void
+test_throttle(void)
+{
+    Client c1, c2, c3;
+    Destination dest;
+    ZNotice_t notice;
+    struct sockaddr_in who;
+    struct timeval tv;
+    socklen_t len = sizeof(who);
+    int fd, i, admitted, deferred, dropped;
+
+    puts("rate limiting");
+    puts("");
+
+    wildcard_instance = make_string(WILDCARD_INSTANCE, 1);
+    empty = make_string("", 0);
+
+    PP("fan-out counts each client once");
+    memset(&c1, 0, sizeof(c1));
+    memset(&c2, 0, sizeof(c2));
+    memset(&c3, 0, sizeof(c3));
+    dest.classname = make_string("throttle-test", 1);
+    dest.recip = empty;
+    dest.inst = make_string("inst", 1);
+    V(triplet_register(&c1, &dest, NULL));
+    V(triplet_register(&c2, &dest, NULL));
+    dest.inst = wildcard_instance;
+    V(triplet_register(&c2, &dest, NULL));
+    V(triplet_register(&c3, &dest, NULL));
+    memset(&notice, 0, sizeof(notice));
+    notice.z_kind = ACKED;
+    notice.z_class = "throttle-test";
+    notice.z_class_inst = "inst";
+    notice.z_opcode = "";
+    notice.z_sender = "sender";
+    notice.z_recipient = "";
+    notice.z_default_format = "";
+    notice.z_multinotice = "";
+    notice.z_ascii_authent = "";
+    TEST(fanout_count(&notice) == 3);
+    V(nshards = 2);
+    TEST(fanout_count(&notice) == 3);
+    V(nshards = 0);
+    V(notice.z_class_inst = "other");
+    TEST(fanout_count(&notice) == 2);
+    V(notice.z_class = "throttle-nobody");
+    TEST(fanout_count(&notice) == 0);
+
+    /* Refused notices are nacked, and so are released ones, since
+       nobody is subscribed to the class; catch the acknowledgements on
+       the sender's socket. */
+    srv_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&who, 0, sizeof(who));
+    who.sin_family = AF_INET;
+    who.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST(bind(fd, (struct sockaddr *) &who, sizeof(who)) == 0);
+    TEST(getsockname(fd, (struct sockaddr *) &who, &len) == 0);
+    notice.z_port = who.sin_port;
+
+    rate_limit = 10;
+    t_local.tv_sec = 1000;
+    t_local.tv_usec = 0;
+    deferred = throttle_deferred.val;
+    dropped = throttle_dropped.val;
+
+    PP("a new sender has five seconds of tokens");
+    for (i = admitted = 0; i < 60; i++)
+	admitted += admit(&notice, i, 0, &who);
+    TEST(admitted == 50);
+    TEST(throttle_deferred.val - deferred == 10);
+
+    PP("a retransmission of a deferred notice is ignored");
+    TEST(admit(&notice, 55, 0, &who) == 0);
+    TEST(throttle_deferred.val - deferred == 10);
+
+    PP("no more than two seconds' worth is deferred");
+    for (i = 60; i < 70; i++)
+	V(admit(&notice, i, 0, &who));
+    TEST(throttle_deferred.val - deferred == 20);
+    TEST(throttle_dropped.val == dropped);
+    TEST(admit(&notice, 70, 0, &who) == 0);
+    TEST(throttle_dropped.val - dropped == 1);
+    TEST(refused(fd) == 1);
+
+    PP("other senders are not held up");
+    TEST(admit(&notice, 71, 1, &who) == 1);
+
+    PP("deferred notices go out as tokens come back");
+    TEST(throttle_timeout(NULL, &tv) == &tv);
+    TEST(tv.tv_sec == 0 && tv.tv_usec == 100000);
+    V(throttle_process());
+    TEST(refused(fd) == 0);
+    V(t_local.tv_sec++);
+    V(throttle_process());
+    TEST(refused(fd) == 10);
+    TEST(throttle_timeout(NULL, &tv) == &tv);
+    V(t_local.tv_sec++);
+    V(throttle_process());
+    TEST(refused(fd) == 10);
+    TEST(throttle_timeout(NULL, &tv) == NULL);
+
+    PP("an idle sender refills only to five seconds of tokens");
+    V(t_local.tv_sec += 100);
+    for (i = 100, admitted = 0; i < 160; i++)
+	admitted += admit(&notice, i, 0, &who);
+    TEST(admitted == 50);
+
+    rate_limit = 0;
+    close(srv_socket);
+    close(fd);
+    puts("");
+}
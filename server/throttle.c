@@ -0,0 +1,379 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It contains functions for limiting the rate at which clients send.
+ *
+ *	Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *	For copying and distribution information, see the file
+ *	"mit-copyright.h".
+ */
+
+#include <zephyr/mit-copyright.h>
+#include "zserver.h"
+
+/*
+ * Per-sender rate limiting.
+ *
+ * External functions are:
+ *
+ * void throttle_init()
+ *
+ * int throttle_admit(notice, auth, who)
+ *	ZNotice_t *notice;
+ *	int auth;
+ *	struct sockaddr_in *who;
+ *
+ * void throttle_process()
+ *
+ * struct timeval *throttle_timeout(tvp, tvbuf)
+ *	struct timeval *tvp, *tvbuf;
+ *
+ * With -l N, each sender may cause at most N deliveries a second,
+ * averaged over THROTTLE_BURST seconds.  A sender is the principal for
+ * authentic notices and the sending host otherwise.  Each class notice
+ * from a local client costs one token per subscriber it fans out to,
+ * so a flood to a popular class runs out of tokens long before a user
+ * chatting on a quiet instance does.
+ *
+ * Notices from a sender whose bucket is empty are not dropped right
+ * away.  They are queued on the sender's bucket, as long as they can
+ * go out within THROTTLE_MAX_WAIT seconds, and the main loop releases
+ * them as tokens come back, one notice per sender in turn, so that
+ * several flooding senders share what is left fairly and nobody else
+ * waits behind them.  Anything beyond that is refused with a SERVNAK.
+ * Retransmissions of a notice that is still queued are ignored.
+ *
+ * Admission may happen on a shard thread under the shared state lock,
+ * so the buckets are guarded by throttle_lock.  Queued notices are
+ * only released by the main thread, which holds the state lock
+ * exclusively and so never runs alongside an admission.
+ */
+
+typedef struct _Bucket Bucket;
+typedef struct _Deferred Deferred;
+
+struct _Deferred {
+    Pending		pending;	/* the notice itself */
+    ZUnique_Id_t	uid;		/* to spot retransmissions */
+    int			cost;		/* tokens it will take */
+    Deferred		*next;
+};
+
+struct _Bucket {
+    char		*key;		/* principal or dotted quad */
+    unsigned long	hashval;
+    double		tokens;		/* may go negative */
+    struct timeval	last;		/* time of last refill */
+    Deferred		*queue, *queue_last;
+    int			queued;		/* notices on queue */
+    int			queued_cost;	/* tokens they will take */
+    Bucket		*next;		/* hash chain */
+    Bucket		*run_next;	/* on the ready ring */
+};
+
+enum {
+    THROTTLE_HASHSIZE = 1023
+};
+
+#define THROTTLE_BURST		5	/* seconds of tokens a bucket holds */
+#define THROTTLE_MAX_WAIT	2	/* longest a notice may be deferred */
+#define THROTTLE_MAX_QUEUE	256	/* most notices deferred per sender */
+#define THROTTLE_BATCH		64	/* most released per main loop pass */
+#define THROTTLE_SWEEP		60	/* seconds between idle bucket sweeps */
+
+int rate_limit = 0;			/* deliveries per second per sender */
+
+Statistic throttle_deferred = {0, "notices deferred by rate limiting"};
+Statistic throttle_dropped = {0, "notices refused by rate limiting"};
+
+static Bucket *buckets[THROTTLE_HASHSIZE];
+static Bucket *run_ring;		/* last bucket with queued notices */
+static int nready = 0;			/* number of buckets on run_ring */
+static pthread_mutex_t throttle_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Bucket *bucket_get(const char *);
+static void bucket_refill(Bucket *);
+static void throttle_sweep(void *);
+
+/*
+ * Start sweeping idle buckets, if rate limiting was asked for.
+ */
+
+void
+throttle_init(void)
+{
+    if (!rate_limit)
+	return;
+    timer_set_rel(THROTTLE_SWEEP, throttle_sweep, NULL);
+    syslog(LOG_INFO, "limiting senders to %d deliveries a second",
+	   rate_limit);
+}
+
+/*
+ * Decide whether a class notice from a local client may be sent now.
+ * Returns 1 if the caller should go ahead and sendit().  Otherwise the
+ * notice has been queued for later or refused, and the caller is done
+ * with it.
+ */
+
+int
+throttle_admit(ZNotice_t *notice,
+	       int auth,
+	       struct sockaddr_in *who)
+{
+    Bucket *bucket;
+    Deferred *deferred;
+    char *pack, addrbuf[INET_ADDRSTRLEN];
+    int packlen, cost;
+    Code_t retval;
+
+    if (!rate_limit)
+	return 1;
+
+    /* What it will cost; a notice nobody gets still costs one. */
+    cost = fanout_count(notice);
+    if (!cost)
+	cost = 1;
+
+    pthread_mutex_lock(&throttle_lock);
+    bucket = bucket_get(auth ? notice->z_sender :
+			inet_ntop(AF_INET, &who->sin_addr, addrbuf,
+				  sizeof(addrbuf)));
+    if (!bucket) {
+	pthread_mutex_unlock(&throttle_lock);
+	return 1;
+    }
+    bucket_refill(bucket);
+
+    if (!bucket->queue && bucket->tokens > 0) {
+	bucket->tokens -= cost;
+	pthread_mutex_unlock(&throttle_lock);
+	return 1;
+    }
+
+    for (deferred = bucket->queue; deferred; deferred = deferred->next) {
+	if (ZCompareUID(&deferred->uid, &notice->z_uid)) {
+	    pthread_mutex_unlock(&throttle_lock);
+	    return 0;
+	}
+    }
+
+    if (bucket->queued >= THROTTLE_MAX_QUEUE ||
+	bucket->queued_cost + cost - bucket->tokens >
+	(double) rate_limit * THROTTLE_MAX_WAIT) {
+	pthread_mutex_unlock(&throttle_lock);
+	__sync_fetch_and_add(&throttle_dropped.val, 1);
+	ZPROBE3(throttle__drop, who->sin_addr.s_addr, notice->z_class, cost);
+	nack(notice, who);
+	return 0;
+    }
+
+    retval = ZFormatRawNotice(notice, &pack, &packlen);
+    if (retval != ZERR_NONE) {
+	pthread_mutex_unlock(&throttle_lock);
+	syslog(LOG_ERR, "throttle_admit format: %s", error_message(retval));
+	nack(notice, who);
+	return 0;
+    }
+    deferred = (Deferred *) malloc(sizeof(Deferred));
+    if (!deferred) {
+	pthread_mutex_unlock(&throttle_lock);
+	syslog(LOG_ERR, "throttle_admit: no memory");
+	free(pack);
+	nack(notice, who);
+	return 0;
+    }
+    deferred->pending.packet = pack;
+    deferred->pending.len = packlen;
+    deferred->pending.auth = auth;
+    deferred->pending.who = *who;
+    deferred->uid = notice->z_uid;
+    deferred->cost = cost;
+    deferred->next = NULL;
+
+    if (bucket->queue) {
+	bucket->queue_last->next = deferred;
+    } else {
+	bucket->queue = deferred;
+	/* Put it at the end of the ring, so it waits its turn. */
+	if (run_ring) {
+	    bucket->run_next = run_ring->run_next;
+	    run_ring->run_next = bucket;
+	} else {
+	    bucket->run_next = bucket;
+	}
+	run_ring = bucket;
+	nready++;
+    }
+    bucket->queue_last = deferred;
+    bucket->queued++;
+    bucket->queued_cost += cost;
+    pthread_mutex_unlock(&throttle_lock);
+
+    __sync_fetch_and_add(&throttle_deferred.val, 1);
+    ZPROBE3(throttle__defer, who->sin_addr.s_addr, notice->z_class, cost);
+    return 0;
+}
+
+/*
+ * Release deferred notices whose senders have tokens again, going
+ * round the senders one notice at a time.  Called from the main loop
+ * with the state lock held exclusively.
+ */
+
+void
+throttle_process(void)
+{
+    Bucket *bucket;
+    Deferred *deferred;
+    ZNotice_t notice;
+    Code_t status;
+    int released = 0, idle = 0;
+
+    /* run_ring is the tail; its successor is the next one to serve. */
+    while (run_ring && idle < nready && released < THROTTLE_BATCH) {
+	bucket = run_ring->run_next;
+	bucket_refill(bucket);
+	if (bucket->tokens <= 0) {
+	    run_ring = bucket;
+	    idle++;
+	    continue;
+	}
+	idle = 0;
+
+	deferred = bucket->queue;
+	bucket->queue = deferred->next;
+	bucket->queued--;
+	bucket->queued_cost -= deferred->cost;
+	bucket->tokens -= deferred->cost;
+	if (bucket->queue) {
+	    run_ring = bucket;
+	} else {
+	    if (bucket == run_ring)
+		run_ring = NULL;
+	    else
+		run_ring->run_next = bucket->run_next;
+	    bucket->run_next = NULL;
+	    nready--;
+	}
+
+	status = ZParseNotice(deferred->pending.packet,
+			      deferred->pending.len, &notice);
+	if (status != ZERR_NONE)
+	    syslog(LOG_ERR, "throttle_process parse: %s",
+		   error_message(status));
+	else
+	    sendit(&notice, deferred->pending.auth, &deferred->pending.who, 1);
+	free(deferred->pending.packet);
+	free(deferred);
+	released++;
+    }
+}
+
+/*
+ * Wake the main loop when the first deferred notice can go out.
+ */
+
+struct timeval *
+throttle_timeout(struct timeval *tvp,
+		 struct timeval *tvbuf)
+{
+    Bucket *bucket;
+    double wait, soonest = -1;
+
+    if (!run_ring)
+	return tvp;
+    bucket = run_ring;
+    do {
+	bucket_refill(bucket);
+	wait = bucket->tokens > 0 ? 0 : (1 - bucket->tokens) / rate_limit;
+	if (soonest < 0 || wait < soonest)
+	    soonest = wait;
+	bucket = bucket->run_next;
+    } while (bucket != run_ring);
+
+    if (tvp && (tvp->tv_sec + tvp->tv_usec / 1000000.0) <= soonest)
+	return tvp;
+    tvbuf->tv_sec = (long) soonest;
+    tvbuf->tv_usec = (long) ((soonest - tvbuf->tv_sec) * 1000000);
+    return tvbuf;
+}
+
+/*
+ * Find or create the bucket for key.  Called with throttle_lock held.
+ */
+
+static Bucket *
+bucket_get(const char *key)
+{
+    Bucket *bucket;
+    unsigned long hashval;
+
+    hashval = hash(key);
+    for (bucket = buckets[hashval % THROTTLE_HASHSIZE]; bucket;
+	 bucket = bucket->next) {
+	if (bucket->hashval == hashval && strcmp(bucket->key, key) == 0)
+	    return bucket;
+    }
+
+    bucket = (Bucket *) malloc(sizeof(Bucket));
+    if (!bucket) {
+	syslog(LOG_ERR, "bucket_get: no memory");
+	return NULL;
+    }
+    bucket->key = strsave(key);
+    bucket->hashval = hashval;
+    bucket->tokens = (double) rate_limit * THROTTLE_BURST;
+    bucket->last = t_local;
+    bucket->queue = bucket->queue_last = NULL;
+    bucket->queued = bucket->queued_cost = 0;
+    bucket->run_next = NULL;
+    bucket->next = buckets[hashval % THROTTLE_HASHSIZE];
+    buckets[hashval % THROTTLE_HASHSIZE] = bucket;
+    return bucket;
+}
+
+static void
+bucket_refill(Bucket *bucket)
+{
+    double elapsed, full;
+
+    elapsed = (t_local.tv_sec - bucket->last.tv_sec) +
+	(t_local.tv_usec - bucket->last.tv_usec) / 1000000.0;
+    if (elapsed <= 0)
+	return;
+    full = (double) rate_limit * THROTTLE_BURST;
+    bucket->tokens += elapsed * rate_limit;
+    if (bucket->tokens > full)
+	bucket->tokens = full;
+    bucket->last = t_local;
+}
+
+/*
+ * Free buckets that are full and have nothing queued; they would be
+ * recreated exactly the same.  Runs on the main thread.
+ */
+
+static void
+throttle_sweep(void *arg)
+{
+    Bucket **bucketp, *bucket;
+    double full = (double) rate_limit * THROTTLE_BURST;
+    int i;
+
+    pthread_mutex_lock(&throttle_lock);
+    for (i = 0; i < THROTTLE_HASHSIZE; i++) {
+	bucketp = &buckets[i];
+	while ((bucket = *bucketp) != NULL) {
+	    bucket_refill(bucket);
+	    if (!bucket->queue && bucket->tokens >= full) {
+		*bucketp = bucket->next;
+		free(bucket->key);
+		free(bucket);
+	    } else {
+		bucketp = &bucket->next;
+	    }
+	}
+    }
+    pthread_mutex_unlock(&throttle_lock);
+    timer_set_rel(THROTTLE_SWEEP, throttle_sweep, arg);
+}
+
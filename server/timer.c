@@ -50,6 +50,10 @@ static const char rcsid[] =
  *      long time_rel;
  *      void (*proc)();
  *      void *arg;
+ * Timer *timer_set_rel_ms (msec_rel, proc, arg)
+ *      long msec_rel;
+ *      void (*proc)();
+ *      void *arg;
  * Timer *timer_set_abs (time_abs, proc, arg)
  *      long time_abs;
  *      void (*proc)();
@@ -114,9 +118,17 @@ static Timer **heap;
 static int num_timers = 0;
 static int heap_size = 0;
 
+/* Shard threads set and reset timers concurrently (see shard.c); the
+   main thread only looks at the heap while it excludes them. */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static void timer_botch (void*);
 static Timer *add_timer (Timer *);
 
+/* Timers are kept to the microsecond of t_local, so that the client
+ * retransmit timers can be shorter than a second. */
+#define TIMER_NOW (t_local.tv_sec + t_local.tv_usec / 1000000.0)
+
 Timer *
 timer_set_rel(long time_rel,
 	      void (*proc)(void *),
@@ -127,10 +139,32 @@ timer_set_rel(long time_rel,
     new_t = (Timer *) malloc(sizeof(*new_t));
     if (new_t == NULL)
 	return(NULL);
-    new_t->abstime = time_rel + NOW;
+    new_t->abstime = time_rel + TIMER_NOW;
+    new_t->func = proc;
+    new_t->arg = arg;
+    pthread_mutex_lock(&heap_lock);
+    new_t = add_timer(new_t);
+    pthread_mutex_unlock(&heap_lock);
+    return new_t;
+}
+
+Timer *
+timer_set_rel_ms(long msec_rel,
+		 void (*proc)(void *),
+		 void *arg)
+{
+    Timer *new_t;
+
+    new_t = (Timer *) malloc(sizeof(*new_t));
+    if (new_t == NULL)
+	return(NULL);
+    new_t->abstime = msec_rel / 1000.0 + TIMER_NOW;
     new_t->func = proc;
     new_t->arg = arg;
-    return add_timer(new_t);
+    pthread_mutex_lock(&heap_lock);
+    new_t = add_timer(new_t);
+    pthread_mutex_unlock(&heap_lock);
+    return new_t;
 }
 
 void
@@ -138,6 +172,8 @@ timer_reset(Timer *tmr)
 {
     int pos, min;
 
+    pthread_mutex_lock(&heap_lock);
+
     /* Free the timer, saving its heap position. */
     pos = tmr->heap_pos;
     free(tmr);
@@ -169,6 +205,8 @@ timer_reset(Timer *tmr)
 	}
     }
     num_timers--;
+
+    pthread_mutex_unlock(&heap_lock);
 }
 
 
@@ -211,7 +249,7 @@ timer_process(void)
     timer_proc func;
     void *arg;
 
-    if (num_timers == 0 || heap[0]->abstime > NOW)
+    if (num_timers == 0 || heap[0]->abstime > TIMER_NOW)
 	return;
 
     /* Remove the first timer from the heap, remembering its
@@ -230,11 +268,14 @@ timer_process(void)
 struct timeval *
 timer_timeout(struct timeval *tvbuf)
 {
+    double left;
+
     if (num_timers > 0) {
-	tvbuf->tv_sec = heap[0]->abstime - NOW;
-	if (tvbuf->tv_sec < 0)
-	    tvbuf->tv_sec = 0;
-	tvbuf->tv_usec = 0;
+	left = heap[0]->abstime - TIMER_NOW;
+	if (left < 0)
+	    left = 0;
+	tvbuf->tv_sec = (long) left;
+	tvbuf->tv_usec = (long) ((left - tvbuf->tv_sec) * 1000000);
 	return tvbuf;
     } else {
 	return NULL;
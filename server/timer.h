@@ -39,12 +39,13 @@ typedef void (*timer_proc) __P((void *));
 
 typedef struct _Timer {
         int		heap_pos;	/* Position in timer heap */
-        long    	abstime;
+        double    	abstime;
         timer_proc	func;
         void		*arg;
 } Timer;
 
 Timer *timer_set_rel(long, timer_proc, void *);
+Timer *timer_set_rel_ms(long, timer_proc, void *);
 Timer *timer_set_abs(long, timer_proc, void *);
 void timer_reset(Timer *);
 void timer_process(void);
@@ -20,11 +20,13 @@
 #endif
 
 #include <arpa/inet.h>
+#include <pthread.h>
 
 #include "zsrv_err.h"
 
 #include "timer.h"
 #include "zsrv_conf.h"			/* configuration params */
+#include "probes.h"			/* static tracepoints */
 
 #include "zstring.h"
 #include "access.h"
@@ -103,6 +105,7 @@ typedef struct _Pending Pending;
 typedef struct _Server Server;
 typedef enum _Sent_type Sent_type;
 typedef struct _Statistic Statistic;
+typedef struct _Xmit_cache Xmit_cache;
 
 struct _Destination {
     String		*classname;
@@ -115,6 +118,13 @@ struct _Destlist {
     struct _Destlist	*next, **prev_p;
 };
 
+/* The unauthentic form of a notice, formatted once for all of the
+   clients it goes to. */
+struct _Xmit_cache {
+    int len;				/* 0 until formatted */
+    ZPacket_t packet;
+};
+
 struct _ZRealm_server {
     String *name;			/* server's hostname */
     struct sockaddr_in addr;		/* server's address */
@@ -159,6 +169,9 @@ struct _Client {
     String		*principal;	/* krb principal of user */
     int			last_send;	/* Counter for last sent packet. */
     time_t		last_ack;	/* Time of last received ack */
+    long		srtt;		/* smoothed ack RTT, usec; 0 if none */
+    long		rttvar;		/* its mean deviation, usec */
+    long		rtt_min;	/* least ack RTT seen, usec */
     ZRealm		*realm;
     struct _Client	*next, **prev_p;
 };
@@ -176,6 +189,7 @@ struct _Unacked {
     Client		*client;	/* responsible client, or NULL */
     short		rexmits;	/* number of retransmits */
     short		packsz;		/* size of packet */
+    struct timeval	sent;		/* time of last transmission */
     char		*packet;	/* ptr to packet */
     ZUnique_Id_t	uid;		/* uid of packet */
     struct sockaddr_in	ack_addr;
@@ -314,13 +328,18 @@ int packets_waiting(void);
 
 /* found in dispatch.c */
 void handle_packet(void);
+void handle_notice(ZNotice_t *notice, struct sockaddr_in *who);
+int handle_notice_shared(ZNotice_t *notice, struct sockaddr_in *who);
 void clt_ack(ZNotice_t *notice, struct sockaddr_in *who, Sent_type sent);
 void nack_release(Client *client);
 void sendit(ZNotice_t *notice, int auth, struct sockaddr_in *who,
 		 int external);
+int fanout_count(ZNotice_t *notice);
 void rexmit(void *);
+void client_rtt_sample(Client *client, long rtt);
+long client_rto(Client *client, int rexmits);
 void xmit(ZNotice_t *notice, struct sockaddr_in *dest, int auth,
-	       Client *client);
+	       Client *client, Xmit_cache *cache);
 Code_t hostm_dispatch(ZNotice_t *notice, int auth,
 			   struct sockaddr_in *who, Server *server);
 Code_t control_dispatch(ZNotice_t *notice, int auth,
@@ -411,6 +430,20 @@ Code_t realm_dispatch(ZNotice_t *, int, struct sockaddr_in *, Server *);
 void kill_realm_pids(void);
 void realm_dump_realms(FILE *);
 
+/* found in shard.c */
+int shard_init(void);
+void shard_lock(void);
+void shard_unlock(void);
+void shard_krb_lock(void);
+void shard_krb_unlock(void);
+struct timeval *shard_timeout(struct timeval *tvp, struct timeval *tvbuf);
+
+/* found in throttle.c */
+void throttle_init(void);
+int throttle_admit(ZNotice_t *notice, int auth, struct sockaddr_in *who);
+void throttle_process(void);
+struct timeval *throttle_timeout(struct timeval *tvp, struct timeval *tvbuf);
+
 /* found in version.c */
 char *get_version(void);
 
@@ -466,6 +499,7 @@ extern int bdump_concurrent;		/* set while processing a packet
 /* found in dispatch.c */
 extern Statistic i_s_ctls, i_s_logins, i_s_admins, i_s_locates;
 extern int rexmit_times[];
+extern Statistic spurious_rexmits;
 
 /* found in server.c */
 extern Server *otherservers;		/* array of servers */
@@ -479,6 +513,13 @@ extern String *wildcard_instance;
 extern ZRealm **otherrealms;
 extern int nrealms;
 
+/* found in shard.c */
+extern int nshards;
+
+/* found in throttle.c */
+extern int rate_limit;
+extern Statistic throttle_deferred, throttle_dropped;
+
 
 #define class_is_control(classname) (classname == class_control)
 #define class_is_admin(classname) (classname == class_admin)
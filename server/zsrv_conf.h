@@ -34,6 +34,7 @@
 #define REXMIT_TIMES { 2, 2, 4, 4, 8, 8, 16, 32, 64, 128, 256, 512, -1 }
 #define NUM_REXMIT_TIMES 12
 #define CLIENT_GIVEUP_MIN 512
+#define REXMIT_MIN_MSEC 200	/* shortest adaptive retransmit time */
 
 /* hostmanager defines */
 #define	LOSE_TIMO	(60)		/* time during which a losing host
@@ -18,21 +18,73 @@ static const char rcsid_queue_c[] = "$Id$";
 #endif /* SABER */
 #endif /* lint */
 
+/*
+ * Each entry carries its packet in the same block, from one of a few
+ * size classes so that a short notice does not tie up Z_MAXPKTLEN
+ * bytes.  Freed blocks are kept on a list per class for reuse.  Entries
+ * are also hashed by UID, since every SERVACK has to find its notice.
+ *
+ * With -H, a notice the server has not acked within hedge_delay() is
+ * sent to a second server as well, and the first ack from either
+ * settles it.  Both servers deliver it, and the receiving clients
+ * drop the second copy as a UID they have already seen; so only
+ * ordinary notices are hedged, never control, login or locate
+ * requests, which the servers act on and pass to each other.  We
+ * remember the UIDs of the last few hedged notices so that the
+ * slower server's ack can be dropped quietly.
+ *
+ * Retransmit times come from server_rto(), which adapts them to the
+ * server's round trip; we feed it the time from each notice's last
+ * transmission to its ack.  Since the adaptive times can be much
+ * shorter than rexmit_times[], we keep retransmitting until as long
+ * has passed as the table would have taken before giving up on the
+ * server.
+ */
+#define QUEUE_HASHSIZE	256	/* buckets in the UID index */
+#define QUEUE_SLABS	3	/* size classes of entries */
+#define QUEUE_SLAB_KEEP	64	/* free entries kept per class */
+#define HEDGE_RECENT	64	/* answered hedged UIDs remembered */
+
 typedef struct _Queue {
     Timer *timer;
+    Timer *hedge_timer;
     int retries;
+    int hedged;			/* sent to a second server */
+    struct timeval first;	/* first transmission */
+    struct timeval sent;	/* last transmission */
     ZNotice_t notice;
-    void *packet;
+    char *packet;
     int len;
+    int slab;			/* size class */
     struct sockaddr_in reply;
     struct _Queue *next, **prev_p;
+    struct _Queue *hash_next, **hash_prev_p;
 } Queue;
 
 static Queue *hm_queue;
+static Queue *queue_hash[QUEUE_HASHSIZE];
 static int retransmits_enabled = 0;
 
+static int slab_size[QUEUE_SLABS] = { 256, 512, Z_MAXPKTLEN };
+static Queue *slab_free[QUEUE_SLABS];
+static int slab_nfree[QUEUE_SLABS];
+
+static int queue_count, queue_max;
+static long queue_bytes;
+
+static ZUnique_Id_t hedge_done[HEDGE_RECENT];
+static int hedge_next, nhedged;
+static int nspurious;
+
 static Queue *find_notice_in_queue(ZNotice_t *notice);
 static void queue_timeout(void *arg);
+static void queue_hedge(void *arg);
+static int hedgeable(ZNotice_t *notice);
+static Queue *alloc_entry(int len);
+static void free_entry(Queue *entry);
+static unsigned int uid_hash(ZUnique_Id_t *uid);
+static long usec_since(struct timeval *then);
+static long rexmit_giveup(void);
 
 int rexmit_times[] = { 2, 2, 4, 4, 8, -1 };
 
@@ -49,10 +101,13 @@ init_queue(void)
 	q = hm_queue;
 	if (q->timer)
 	    timer_reset(q->timer);
-	free(q->packet);
+	if (q->hedge_timer)
+	    timer_reset(q->hedge_timer);
 	hm_queue = q->next;
-	free(q);
+	free_entry(q);
     }
+    memset(queue_hash, 0, sizeof(queue_hash));
+    queue_count = 0;
 
     DPR("Queue initialized and flushed.\n");
 }
@@ -63,36 +118,43 @@ add_notice_to_queue(ZNotice_t *notice,
 		    struct sockaddr_in *repl,
 		    int len)
 {
-    Queue *entry;
+    Queue *entry, **bucket;
+    long delay;
 
     DPR("Adding notice to queue...\n");
     if (!find_notice_in_queue(notice)) {
-	entry = (Queue *) malloc(sizeof(Queue));
+	entry = alloc_entry(len);
 	if (entry == NULL)
 	    return(ZERR_NONOTICE);
 	entry->retries = 0;
-	entry->packet = (char *) malloc(Z_MAXPKTLEN);
-	if (entry->packet == NULL) {
-	    free(entry);
-	    return(ZERR_NONOTICE);
-	}
-	memcpy(entry->packet, packet, Z_MAXPKTLEN);
+	memcpy(entry->packet, packet, len);
 	entry->len = len;
 	if (ZParseNotice(entry->packet, len, &entry->notice) != ZERR_NONE) {
 	    syslog(LOG_ERR, "ZParseNotice failed, but succeeded before");
-	    free(entry->packet);
-	} else {
-	    entry->reply = *repl;
-	    /*LIST_INSERT(&hm_queue, entry);*/
-
-	    (entry)->next = *(&hm_queue);
-	    if (*&hm_queue) ((*(&hm_queue))->prev_p = &(entry)->next);
-	    (*&hm_queue) = (entry);
-	    (entry)->prev_p = (&hm_queue);
-		
+	    free_entry(entry);
+	    return(ZERR_NONOTICE);
 	}
+	entry->reply = *repl;
+	(void) gettimeofday(&entry->first, (struct timezone *)0);
+	entry->sent = entry->first;
+	LIST_INSERT(&hm_queue, entry);
+
+	bucket = &queue_hash[uid_hash(&entry->notice.z_uid)];
+	entry->hash_next = *bucket;
+	if (*bucket)
+	    (*bucket)->hash_prev_p = &entry->hash_next;
+	*bucket = entry;
+	entry->hash_prev_p = bucket;
+
+	if (++queue_count > queue_max)
+	    queue_max = queue_count;
 	entry->timer = (retransmits_enabled) ?
-	    timer_set_rel(rexmit_times[0], queue_timeout, entry) : NULL;
+	    timer_set_rel_ms(server_rto(0), queue_timeout, entry) : NULL;
+	entry->hedged = 0;
+	entry->hedge_timer = NULL;
+	if (hedgeflag && retransmits_enabled && hedgeable(&entry->notice) &&
+	    (delay = hedge_delay()) >= 0)
+	    entry->hedge_timer = timer_set_rel_ms(delay, queue_hedge, entry);
     }
     return(ZERR_NONE);
 }
@@ -103,6 +165,7 @@ remove_notice_from_queue(ZNotice_t *notice,
 			 struct sockaddr_in *repl)
 {
     Queue *entry;
+    long rtt;
 
     DPR("Removing notice from queue...\n");
     entry = find_notice_in_queue(notice);
@@ -111,16 +174,28 @@ remove_notice_from_queue(ZNotice_t *notice,
 
     *kind = entry->notice.z_kind;
     *repl = entry->reply;
+    rtt = usec_since(&entry->sent);
+    stats_server_ack(entry->reply.sin_port, rtt, usec_since(&entry->first));
+    /* An ack for a hedged notice may be from either server. */
+    if (!entry->hedged && server_acked(rtt, entry->retries > 0))
+	nspurious++;
     if (entry->timer)
 	timer_reset(entry->timer);
-    free(entry->packet);
-    /*LIST_DELETE(entry);*/
-    *(entry)->prev_p = (entry)->next;
-    if((entry)->next) ((entry)->next->prev_p = (entry)->prev_p);
+    if (entry->hedge_timer)
+	timer_reset(entry->hedge_timer);
+    if (entry->hedged) {
+	hedge_done[hedge_next] = entry->notice.z_uid;
+	hedge_next = (hedge_next + 1) % HEDGE_RECENT;
+    }
+    LIST_DELETE(entry);
+    *entry->hash_prev_p = entry->hash_next;
+    if (entry->hash_next)
+	entry->hash_next->hash_prev_p = entry->hash_prev_p;
+    queue_count--;
 #ifdef DEBUG
     dump_queue();
 #endif /* DEBUG */
-    free(entry);
+    free_entry(entry);
     return(ZERR_NONE);
 }
 
@@ -151,7 +226,9 @@ retransmit_queue(struct sockaddr_in *sin)
 	    Zperr(ret);
 	    com_err("queue", ret, "sending raw notice");
 	}
-	entry->timer = timer_set_rel(rexmit_times[0], queue_timeout, entry);
+	(void) gettimeofday(&entry->first, (struct timezone *)0);
+	entry->sent = entry->first;
+	entry->timer = timer_set_rel_ms(server_rto(0), queue_timeout, entry);
 	entry->retries = 0;
     }
     retransmits_enabled = 1;
@@ -167,6 +244,9 @@ disable_queue_retransmits(void)
 	if (entry->timer)
 	    timer_reset(entry->timer);
 	entry->timer = NULL;
+	if (entry->hedge_timer)
+	    timer_reset(entry->hedge_timer);
+	entry->hedge_timer = NULL;
     }
     retransmits_enabled = 0;
 }
@@ -208,12 +288,129 @@ dump_queue(void)
 int
 queue_len(void)
 {
-    int length = 0;
+    return queue_count;
+}
+
+/* The most notices that have been queued at once. */
+int
+queue_max_len(void)
+{
+    return queue_max;
+}
+
+/* Bytes taken by queued notices, not counting free entries. */
+long
+queue_memory(void)
+{
+    return queue_bytes;
+}
+
+/* How many notices have been sent to a second server. */
+int
+queue_hedges(void)
+{
+    return nhedged;
+}
+
+/* How many retransmissions turned out not to have been needed. */
+int
+queue_spurious(void)
+{
+    return nspurious;
+}
+
+/* Whether this notice is queued and was also sent to a second server. */
+int
+queue_hedged(ZNotice_t *notice)
+{
+    Queue *entry = find_notice_in_queue(notice);
+
+    return entry && entry->hedged;
+}
+
+/* Whether this is the second ack for a hedged notice. */
+int
+hedge_answered(ZNotice_t *notice)
+{
+    int i;
+
+    for (i = 0; i < HEDGE_RECENT; i++) {
+	if (ZCompareUID(&hedge_done[i], &notice->z_uid))
+	    return 1;
+    }
+    return 0;
+}
+
+static Queue *
+alloc_entry(int len)
+{
     Queue *entry;
+    int slab;
 
-    for (entry = hm_queue; entry; entry = entry->next)
-	length++;
-    return length;
+    for (slab = 0; slab < QUEUE_SLABS && slab_size[slab] < len; slab++)
+	;
+    if (slab == QUEUE_SLABS)
+	return NULL;
+    if (slab_free[slab]) {
+	entry = slab_free[slab];
+	slab_free[slab] = entry->next;
+	slab_nfree[slab]--;
+    } else {
+	entry = (Queue *) malloc(sizeof(Queue) + slab_size[slab]);
+	if (entry == NULL)
+	    return NULL;
+    }
+    entry->slab = slab;
+    entry->packet = (char *) (entry + 1);
+    queue_bytes += sizeof(Queue) + slab_size[slab];
+    return entry;
+}
+
+static void
+free_entry(Queue *entry)
+{
+    int slab = entry->slab;
+
+    queue_bytes -= sizeof(Queue) + slab_size[slab];
+    if (slab_nfree[slab] < QUEUE_SLAB_KEEP) {
+	entry->next = slab_free[slab];
+	slab_free[slab] = entry;
+	slab_nfree[slab]++;
+    } else {
+	free(entry);
+    }
+}
+
+static unsigned int
+uid_hash(ZUnique_Id_t *uid)
+{
+    unsigned long h;
+
+    h = (unsigned long) uid->tv.tv_sec ^ (unsigned long) uid->tv.tv_usec ^
+	(unsigned long) uid->zuid_addr.s_addr;
+    return (h ^ (h >> 8) ^ (h >> 16)) % QUEUE_HASHSIZE;
+}
+
+static long
+usec_since(struct timeval *then)
+{
+    struct timeval now;
+
+    (void) gettimeofday(&now, (struct timezone *)0);
+    return (now.tv_sec - then->tv_sec) * 1000000L +
+	(now.tv_usec - then->tv_usec);
+}
+
+/* How long, in msec, rexmit_times[] waits before giving up. */
+static long
+rexmit_giveup(void)
+{
+    long total = 0;
+    int i;
+
+    for (i = 0; rexmit_times[i] != -1; i++)
+	total += rexmit_times[i] * 1000L;
+    return total;
 }
 
 static Queue *
@@ -221,7 +418,8 @@ find_notice_in_queue(ZNotice_t *notice)
 {
     Queue *entry;
 
-    for (entry = hm_queue; entry; entry = entry->next) {
+    for (entry = queue_hash[uid_hash(&notice->z_uid)]; entry;
+	 entry = entry->hash_next) {
 	if (ZCompareUID(&entry->notice.z_uid, &notice->z_uid))
 	    return entry;
     }
@@ -232,6 +430,7 @@ static void
 queue_timeout(void *arg)
 {
     Queue *entry = (Queue *) arg;
+    long delay, left = -1;
     Code_t ret;
 
     entry->timer = NULL;
@@ -242,8 +441,12 @@ queue_timeout(void *arg)
     }
     entry->retries++;
     if (rexmit_times[entry->retries] == -1) {
-	new_server(NULL);
-	return;
+	left = rexmit_giveup() - usec_since(&entry->first) / 1000;
+	if (left <= 0) {
+	    new_server(NULL);
+	    return;
+	}
+	entry->retries--;
     }
     DPR("Resending notice:\n");
     DPR2("\tz_kind: %d\n", entry->notice.z_kind);
@@ -257,8 +460,51 @@ queue_timeout(void *arg)
     if (ret != ZERR_NONE) {
 	Zperr(ret);
 	com_err("queue", ret, "sending raw notice");
+    } else {
+	(void) gettimeofday(&entry->sent, (struct timezone *)0);
     }
-    entry->timer = timer_set_rel(rexmit_times[entry->retries], queue_timeout,
-				 entry);
+    delay = server_rto(entry->retries);
+    if (left >= 0 && left < delay)
+	delay = left;
+    entry->timer = timer_set_rel_ms(delay, queue_timeout, entry);
 }
 
+static int
+hedgeable(ZNotice_t *notice)
+{
+    if (notice->z_kind != ACKED && notice->z_kind != UNACKED)
+	return 0;
+    return (strcasecmp(notice->z_class, ZEPHYR_CTL_CLASS) &&
+	    strcasecmp(notice->z_class, ZEPHYR_ADMIN_CLASS) &&
+	    strcasecmp(notice->z_class, HM_CTL_CLASS) &&
+	    strcasecmp(notice->z_class, LOGIN_CLASS) &&
+	    strcasecmp(notice->z_class, LOCATE_CLASS));
+}
+
+static void
+queue_hedge(void *arg)
+{
+    Queue *entry = (Queue *) arg;
+    struct sockaddr_in *sin;
+    Code_t ret;
+
+    entry->hedge_timer = NULL;
+    sin = hedge_server();
+    if (!sin)
+	return;
+    DPR2("Hedging notice to %s\n", inet_ntoa(sin->sin_addr));
+    ret = ZSetDestAddr(sin);
+    if (ret != ZERR_NONE) {
+	Zperr(ret);
+	com_err("queue", ret, "setting destination");
+	return;
+    }
+    ret = ZSendPacket(entry->packet, entry->len, 0);
+    if (ret != ZERR_NONE) {
+	Zperr(ret);
+	com_err("queue", ret, "sending raw notice");
+	return;
+    }
+    entry->hedged = 1;
+    nhedged++;
+}
@@ -0,0 +1,268 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It contains the hostmanager unit tests.
+ *
+ *	Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *	For copying and distribution information, see the file
+ *	"mit-copyright.h".
+ */
+
+#include "zhm.h"
+
+#define TEST(EXP) \
+    do { \
+        printf("%s:%d: %s: ", __FILE__, __LINE__, #EXP); \
+        fflush(stdout); \
+        if (EXP) {        \
+            puts("PASS"); \
+        } else {          \
+            puts("FAIL"); \
+            failures++; \
+        } \
+        fflush(stdout); \
+    } while (0)
+
+#define V(EXP) \
+    do { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #EXP); \
+        fflush(stdout); \
+        EXP; \
+    } while (0)
+
+#define PP(s) \
+    do { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, s); \
+        fflush(stdout); \
+    } while (0)
+
+int failures = 0;
+
+/* What zhm.c would otherwise provide. */
+int hmdebug, rebootflag, noflushflag, hedgeflag;
+int no_server = 1, nservchang, nserv, nclt;
+int booting = 1, deactivated = 1;
+u_short cli_port;
+struct sockaddr_in cli_sin, serv_sin, from;
+int numserv;
+char **serv_list = NULL;
+char prim_serv[NS_MAXDNAME], cur_serv[NS_MAXDNAME];
+#ifdef HAVE_ARES
+ares_channel achannel;
+#endif
+
+void
+die_gracefully(void)
+{
+    abort();
+}
+
+void test_local(void);
+void test_rto(void);
+
+int
+main(int argc, char **argv)
+{
+    test_local();
+    test_rto();
+
+    if (failures) {
+	printf("\n\n%d FAILURES\n", failures);
+	exit(1);
+    }
+    exit(0);
+}
+
+/* A UDP socket on the loopback address, standing in for a client. */
+static int
+client_socket(u_short *port)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &sin, sizeof(sin)) < 0 ||
+	getsockname(fd, (struct sockaddr *) &sin, &len) < 0) {
+	perror("client socket");
+	exit(1);
+    }
+    *port = sin.sin_port;
+    return fd;
+}
+
+/* Count the packets waiting on fd. */
+static int
+received(int fd)
+{
+    char buf[Z_MAXPKTLEN];
+    int n = 0;
+
+    while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0)
+	n++;
+    return n;
+}
+
+/* Pass a client's subscription request through, and the server's
+   answer back. */
+static void
+request(u_short port,
+	char *opcode,
+	char *class,
+	char *inst,
+	ZNotice_Kind_t answer)
+{
+    static int serial;
+    ZNotice_t notice;
+    char message[BUFSIZ];
+    int len;
+
+    memset(&notice, 0, sizeof(notice));
+    notice.z_kind = ACKED;
+    notice.z_port = port;
+    notice.z_uid.tv.tv_sec = ++serial;
+    notice.z_multiuid = notice.z_uid;
+    notice.z_class = ZEPHYR_CTL_CLASS;
+    notice.z_class_inst = ZEPHYR_CTL_CLIENT;
+    notice.z_opcode = opcode;
+    notice.z_sender = "user";
+    notice.z_recipient = "";
+    len = strlen(class) + 1;
+    memcpy(message, class, len);
+    memcpy(message + len, inst, strlen(inst) + 1);
+    len += strlen(inst) + 1;
+    message[len++] = '\0';
+    notice.z_message = message;
+    notice.z_message_len = len;
+    local_client_notice(&notice, NULL, 0);
+    notice.z_kind = answer;
+    local_server_ack(&notice);
+}
+
+/* A client sending a notice to the class. */
+static void
+send_local(u_short port,
+	   char *inst)
+{
+    ZNotice_t notice;
+    char packet[] = "packet";
+
+    memset(&notice, 0, sizeof(notice));
+    notice.z_kind = UNACKED;
+    notice.z_port = port;
+    notice.z_class = "zhm-test";
+    notice.z_class_inst = inst;
+    notice.z_opcode = "";
+    notice.z_sender = "user";
+    notice.z_recipient = "";
+    local_client_notice(&notice, packet, sizeof(packet));
+}
+
+void
+test_local(void)
+{
+    u_short aport, bport;
+    int a, b, deliveries;
+
+    puts("local delivery");
+    puts("");
+
+    TEST(set_local_classes("zhm-test") == 0);
+    cli_sin.sin_family = AF_INET;
+    cli_sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a = client_socket(&aport);
+    b = client_socket(&bport);
+    deliveries = local_deliveries;
+
+    PP("subscriptions are taken when the server acks them");
+    V(request(aport, CLIENT_SUBSCRIBE, "zhm-test", "foo", SERVACK));
+    V(request(aport, CLIENT_SUBSCRIBE, "zhm-test", "bar", SERVNAK));
+    V(request(aport, CLIENT_SUBSCRIBE, "zhm-other", "foo", SERVACK));
+    TEST(local_sub_count(aport) == 1);
+
+    PP("resubscribing does not add entries");
+    V(request(bport, CLIENT_SUBSCRIBE, "zhm-test", "*", SERVACK));
+    V(request(bport, CLIENT_SUBSCRIBE, "zhm-test", "*", SERVACK));
+    V(request(bport, CLIENT_SUBSCRIBE_NODEFS, "ZHM-TEST", "*", SERVACK));
+    TEST(local_sub_count(bport) == 1);
+
+    PP("each subscriber gets one copy");
+    V(send_local(bport, "foo"));
+    TEST(received(a) == 1);
+    TEST(received(b) == 1);
+    V(send_local(bport, "baz"));
+    TEST(received(a) == 0);
+    TEST(received(b) == 1);
+    TEST(local_deliveries - deliveries == 3);
+
+    PP("one unsubscribe undoes any number of subscribes");
+    V(request(bport, CLIENT_UNSUBSCRIBE, "zhm-test", "*", SERVACK));
+    TEST(local_sub_count(bport) == 0);
+    V(send_local(aport, "foo"));
+    TEST(received(a) == 1);
+    TEST(received(b) == 0);
+
+    PP("a flush forgets everything");
+    V(flush_local());
+    TEST(local_sub_count(aport) == 0);
+
+    close(a);
+    close(b);
+    puts("");
+}
+
+void
+test_rto(void)
+{
+    static char *servers[] = { "127.0.0.1", "127.0.0.2" };
+
+    puts("adaptive retransmit times");
+    puts("");
+
+#ifdef HAVE_ARES
+    TEST(ares_init(&achannel) == ARES_SUCCESS);
+#endif
+    serv_list = servers;
+    numserv = 2;
+    V(init_server_stats());
+    strcpy(cur_serv, servers[0]);
+
+    PP("no samples");
+    TEST(server_rto(0) == 2000);
+    TEST(server_rto(2) == 4000);
+    TEST(server_rto(4) == 8000);
+
+    PP("an ack for a retransmitted notice is not a sample");
+    TEST(server_acked(1000, 1) == 0);
+    TEST(server_rto(0) == 2000);
+
+    PP("one LAN sample of 1000 usec");
+    TEST(server_acked(1000, 0) == 0);
+    TEST(server_rto(0) == 200);
+    TEST(server_rto(1) == 400);
+    TEST(server_rto(2) == 800);
+    TEST(server_rto(4) == 3200);
+
+    PP("an ack faster than any seen must be for the first copy");
+    TEST(server_acked(500, 1) == 1);
+    TEST(server_acked(5000, 1) == 0);
+    TEST(server_rto(0) == 200);
+
+    PP("a slow sample");
+    TEST(server_acked(801000, 0) == 0);
+    TEST(server_rto(0) == 902);
+    TEST(server_rto(1) == 1804);
+    TEST(server_rto(2) == 3608);
+    TEST(server_rto(3) == 4000);
+
+    PP("each server has its own estimate");
+    V(strcpy(cur_serv, servers[1]));
+    TEST(server_rto(0) == 2000);
+    V(strcpy(cur_serv, "unknown"));
+    TEST(server_rto(0) == 2000);
+    TEST(server_acked(1000, 0) == 0);
+    V(strcpy(cur_serv, servers[0]));
+    TEST(server_rto(0) == 902);
+    puts("");
+}
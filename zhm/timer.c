@@ -51,6 +51,10 @@ static const char rcsid[] =
  *      long time_rel;
  *      void (*proc)();
  *      void *arg;
+ * Timer *timer_set_rel_ms (msec_rel, proc, arg)
+ *      long msec_rel;
+ *      void (*proc)();
+ *      void *arg;
  * Timer *timer_set_abs (time_abs, proc, arg)
  *      long time_abs;
  *      void (*proc)();
@@ -117,6 +121,18 @@ static int heap_size = 0;
 
 static void timer_botch (void*);
 static Timer *add_timer (Timer *);
+static double timer_now (void);
+
+/* Timers are kept to the microsecond, so that the hedge and
+ * retransmit timers can be shorter than a second. */
+static double
+timer_now(void)
+{
+    struct timeval tv;
+
+    (void) gettimeofday(&tv, (struct timezone *)0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
 
 Timer *
 timer_set_rel(long time_rel,
@@ -128,7 +144,23 @@ timer_set_rel(long time_rel,
     new_t = (Timer *) malloc(sizeof(*new_t));
     if (new_t == NULL)
 	return(NULL);
-    new_t->abstime = time_rel + time(NULL);
+    new_t->abstime = time_rel + timer_now();
+    new_t->func = proc;
+    new_t->arg = arg;
+    return add_timer(new_t);
+}
+
+Timer *
+timer_set_rel_ms(long msec_rel,
+		 void (*proc)(void *),
+		 void *arg)
+{
+    Timer *new_t;
+
+    new_t = (Timer *) malloc(sizeof(*new_t));
+    if (new_t == NULL)
+	return(NULL);
+    new_t->abstime = msec_rel / 1000.0 + timer_now();
     new_t->func = proc;
     new_t->arg = arg;
     return add_timer(new_t);
@@ -212,7 +244,7 @@ timer_process(void)
     timer_proc func;
     void *arg;
 
-    if (num_timers == 0 || heap[0]->abstime > time(NULL))
+    if (num_timers == 0 || heap[0]->abstime > timer_now())
 	return;
 
     /* Remove the first timer from the heap, remembering its
@@ -231,11 +263,14 @@ timer_process(void)
 struct timeval *
 timer_timeout(struct timeval *tvbuf)
 {
+    double left;
+
     if (num_timers > 0) {
-	tvbuf->tv_sec = heap[0]->abstime - time(NULL);
-	if (tvbuf->tv_sec < 0)
-	    tvbuf->tv_sec = 0;
-	tvbuf->tv_usec = 0;
+	left = heap[0]->abstime - timer_now();
+	if (left < 0)
+	    left = 0;
+	tvbuf->tv_sec = (long) left;
+	tvbuf->tv_usec = (long) ((left - tvbuf->tv_sec) * 1000000);
 	return tvbuf;
     } else {
 	return NULL;
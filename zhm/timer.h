@@ -39,12 +39,13 @@ typedef void (*timer_proc) __P((void *));
 
 typedef struct _Timer {
         int		heap_pos;	/* Position in timer heap */
-        long    	abstime;
+        double    	abstime;	/* seconds, to the microsecond */
         timer_proc	func;
         void		*arg;
 } Timer;
 
 Timer *timer_set_rel __P((long, timer_proc, void *));
+Timer *timer_set_rel_ms __P((long, timer_proc, void *));
 Timer *timer_set_abs __P((long, timer_proc, void *));
 void timer_reset __P((Timer *));
 void timer_process __P((void));
@@ -24,8 +24,10 @@ int use_hesiod = 0;
 #endif
 
 #define PIDDIR "/var/run/"
+#define HM_DRAIN_MAX	64	/* packets handled per wakeup */
 
 int hmdebug, rebootflag, noflushflag, errflg, dieflag, inetd, oldpid, nofork;
+int hedgeflag;
 int no_server = 1, nservchang, nserv, nclt;
 int booting = 1, timeout_type, deactivated = 1;
 int started = 0;
@@ -41,6 +43,9 @@ int terminating = 0;
 struct hostent *hp;
 char hostname[NS_MAXDNAME], loopback[4];
 char PidFile[128];
+#ifdef HAVE_ARES
+ares_channel achannel;			/* for server lookups */
+#endif
 
 static RETSIGTYPE deactivate(int);
 static RETSIGTYPE terminate(int);
@@ -50,6 +55,8 @@ static void init_hm(void);
 static void detach(void);
 #endif
 static void send_stats(ZNotice_t *, struct sockaddr_in *);
+static void send_detail_stats(ZNotice_t *, struct sockaddr_in *);
+static void handle_packet(void);
 static char *strsave(const char *);
 
 static RETSIGTYPE
@@ -68,12 +75,12 @@ int
 main(int argc,
      char *argv[])
 {
-    ZNotice_t notice;
-    ZPacket_t packet;
-    Code_t ret;
-    int opt, pak_len, fd, count;
-    fd_set readers;
-    struct timeval tv;
+    int opt, fd, count, nfds, i;
+    fd_set readers, writers;
+    struct timeval tv, *tvp;
+#ifdef HAVE_ARES
+    int status;
+#endif
 
     sprintf(PidFile, "%szhm.pid", PIDDIR);
 
@@ -82,7 +89,7 @@ main(int argc,
 	exit(-1);
     }
     prim_serv[0] = '\0';
-    while ((opt = getopt(argc, argv, "drhinfN")) != EOF)
+    while ((opt = getopt(argc, argv, "drhinfNHL:")) != EOF)
 	switch(opt) {
 	  case 'd':
 	    hmdebug = 1;
@@ -110,17 +117,37 @@ main(int argc,
 	  case 'N':
 	    booting = 0;
 	    break;
+	  case 'H':
+	    /* Send notices to a second server when ours is slow */
+	    hedgeflag = 1;
+	    break;
+	  case 'L':
+	    /* Deliver these classes to local clients directly */
+	    if (set_local_classes(optarg) < 0) {
+		fprintf(stderr, "%s: can't deliver %s locally\n", argv[0],
+			optarg);
+		errflg++;
+	    }
+	    break;
 	  case '?':
 	  default:
 	    errflg++;
 	    break;
 	}
     if (errflg) {
-	fprintf(stderr, "Usage: %s [-d] [-h] [-r] [-n] [-f] [server]\n",
+	fprintf(stderr, "Usage: %s [-d] [-h] [-r] [-n] [-f] [-N] [-H] [-L classes] [server]\n",
 		argv[0]);
 	exit(2);
     }
 
+#ifdef HAVE_ARES
+    status = ares_init(&achannel);
+    if (status != ARES_SUCCESS) {
+	printf("Couldn't initialize resolver: %s\n", ares_strerror(status));
+	exit(-1);
+    }
+#endif
+
     numserv = 0;
 
     /* Override server argument? */
@@ -154,6 +181,7 @@ main(int argc,
 #endif
 
     choose_server();
+    init_server_stats();
     if (*prim_serv == '\0') {
 	printf("No valid primary server found, exiting.\n");
 	exit(ZERR_SERVNAK);
@@ -170,13 +198,33 @@ main(int argc,
 	DPR("Waiting for a packet...");
 	fd = ZGetFD();
 	FD_ZERO(&readers);
+	FD_ZERO(&writers);
 	FD_SET(fd, &readers);
-	count = select(fd + 1, &readers, NULL, NULL, timer_timeout(&tv));
+	tvp = timer_timeout(&tv);
+	if (ZQLength() > 0) {
+	    /* Left over from the last round; don't wait. */
+	    tv.tv_sec = tv.tv_usec = 0;
+	    tvp = &tv;
+	}
+#ifdef HAVE_ARES
+	nfds = ares_fds(achannel, &readers, &writers);
+	if (nfds < fd + 1)
+	    nfds = fd + 1;
+	tvp = ares_timeout(achannel, tvp, &tv);
+#else
+	nfds = fd + 1;
+#endif
+	count = select(nfds, &readers, &writers, NULL, tvp);
 	if (count == -1 && errno != EINTR) {
 	    syslog(LOG_CRIT, "select() failed: %m");
 	    die_gracefully();
 	}
 
+#ifdef HAVE_ARES
+	if (count >= 0)
+	    ares_process(achannel, &readers, &writers);
+#endif
+
 	if (terminating)
 	    die_gracefully();
 
@@ -186,6 +234,7 @@ main(int argc,
 		die_gracefully();
 	    } else {
 		choose_server();
+		init_server_stats();
 		send_flush_notice(HM_FLUSH);
 		deactivated = 1;
 	    }
@@ -193,56 +242,83 @@ main(int argc,
 
 	timer_process();
 
-	if (count > 0) {
-	    ret = ZReceivePacket(packet, &pak_len, &from);
-	    if ((ret != ZERR_NONE) && (ret != EINTR)){
-		Zperr(ret);
-		com_err("hm", ret, "receiving notice");
-	    } else if (ret != EINTR) {
-		/* Where did it come from? */
-		if ((ret = ZParseNotice(packet, pak_len, &notice))
-		    != ZERR_NONE) {
-		    Zperr(ret);
-		    com_err("hm", ret, "parsing notice");
+	if (ZQLength() > 0 || (count > 0 && FD_ISSET(fd, &readers))) {
+	    /* Handle everything that has come in, up to a limit so the
+	       timers get their turn, then send the replies together. */
+	    for (i = 0; i < HM_DRAIN_MAX; i++) {
+		if (i > 0 && ZPending() <= 0)
+		    break;
+		handle_packet();
+	    }
+	    flush_outgoing();
+	}
+    }
+}
+
+static void
+handle_packet(void)
+{
+    ZNotice_t notice;
+    ZPacket_t packet;
+    Code_t ret;
+    int pak_len;
+
+    ret = ZReceivePacket(packet, &pak_len, &from);
+    if ((ret != ZERR_NONE) && (ret != EINTR)){
+	Zperr(ret);
+	com_err("hm", ret, "receiving notice");
+    } else if (ret != EINTR) {
+	/* Where did it come from? */
+	if ((ret = ZParseNotice(packet, pak_len, &notice))
+	    != ZERR_NONE) {
+	    Zperr(ret);
+	    com_err("hm", ret, "parsing notice");
+	} else {
+	    DPR("Got a packet.\n");
+	    DPR("notice:\n");
+	    DPR2("\tz_kind: %d\n", notice.z_kind);
+	    DPR2("\tz_port: %u\n", ntohs(notice.z_port));
+	    DPR2("\tz_class: %s\n", notice.z_class);
+	    DPR2("\tz_class_inst: %s\n", notice.z_class_inst);
+	    DPR2("\tz_opcode: %s\n", notice.z_opcode);
+	    DPR2("\tz_sender: %s\n", notice.z_sender);
+	    DPR2("\tz_recip: %s\n", notice.z_recipient);
+	    DPR2("\tz_def_format: %s\n", notice.z_default_format);
+	    DPR2("\tz_message: %s\n", notice.z_message);
+	    if (memcmp(loopback, &from.sin_addr, 4) &&
+		((notice.z_kind == SERVACK) ||
+		 (notice.z_kind == SERVNAK) ||
+		 (notice.z_kind == HMCTL))) {
+		server_manager(&notice);
+	    } else {
+		if (!memcmp(loopback, &from.sin_addr, 4) &&
+		    ((notice.z_kind == UNSAFE) ||
+		     (notice.z_kind == UNACKED) ||
+		     (notice.z_kind == ACKED) ||
+		     (notice.z_kind == HMCTL))) {
+		    /* Client program... */
+		    if (deactivated) {
+			flush_outgoing();
+			send_boot_notice(HM_BOOT);
+			deactivated = 0;
+		    }
+		    transmission_tower(&notice, packet, pak_len);
+		    DPR2("Pending = %d\n", ZPending());
 		} else {
-		    DPR("Got a packet.\n");
-		    DPR("notice:\n");
-		    DPR2("\tz_kind: %d\n", notice.z_kind);
-		    DPR2("\tz_port: %u\n", ntohs(notice.z_port));
-		    DPR2("\tz_class: %s\n", notice.z_class);
-		    DPR2("\tz_class_inst: %s\n", notice.z_class_inst);
-		    DPR2("\tz_opcode: %s\n", notice.z_opcode);
-		    DPR2("\tz_sender: %s\n", notice.z_sender);
-		    DPR2("\tz_recip: %s\n", notice.z_recipient);
-		    DPR2("\tz_def_format: %s\n", notice.z_default_format);
-		    DPR2("\tz_message: %s\n", notice.z_message);
-		    if (memcmp(loopback, &from.sin_addr, 4) &&
-			((notice.z_kind == SERVACK) ||
-			 (notice.z_kind == SERVNAK) ||
-			 (notice.z_kind == HMCTL))) {
-			server_manager(&notice);
+		    if (notice.z_kind == STAT) {
+			if (!strcmp(notice.z_opcode, HM_GIMMEDETAIL))
+			    send_detail_stats(&notice, &from);
+			else
+			    send_stats(&notice, &from);
+		    } else if (notice.z_kind == CLIENTACK) {
+			/* For a local delivery, or a detailed stats
+			   reply, which is not sent as an ack. */
+			if (!memcmp(loopback, &from.sin_addr, 4))
+			    local_client_ack(&notice);
 		    } else {
-			if (!memcmp(loopback, &from.sin_addr, 4) &&
-			    ((notice.z_kind == UNSAFE) ||
-			     (notice.z_kind == UNACKED) ||
-			     (notice.z_kind == ACKED) ||
-			     (notice.z_kind == HMCTL))) {
-			    /* Client program... */
-			    if (deactivated) {
-				send_boot_notice(HM_BOOT);
-				deactivated = 0;
-			    }
-			    transmission_tower(&notice, packet, pak_len);
-			    DPR2("Pending = %d\n", ZPending());
-			} else {
-			    if (notice.z_kind == STAT) {
-				send_stats(&notice, &from);
-			    } else {
-				syslog(LOG_INFO,
-				       "Unknown notice type: %d",
-				       notice.z_kind);
-			    }
-			}
+			syslog(LOG_INFO,
+			       "Unknown notice type: %d",
+			       notice.z_kind);
 		    }
 		}
 	    }
@@ -363,6 +439,7 @@ init_hm(void)
 {
      struct servent *sp;
      Code_t ret;
+     int waiting = 0;
 #ifndef DEBUG
      FILE *fp;
 #endif
@@ -435,7 +512,7 @@ init_hm(void)
      /* who to talk to */
      if ((hp = gethostbyname(prim_serv)) == NULL) {
 	  DPR("gethostbyname failed\n");
-	  find_next_server(NULL);
+	  waiting = !await_server();
      } else {
 	  DPR2("Server = %s\n", prim_serv);
 	  strncpy(cur_serv, prim_serv, sizeof(cur_serv));
@@ -443,11 +520,15 @@ init_hm(void)
 	  memcpy(&serv_sin.sin_addr, hp->h_addr, 4);
      }
 
-     if (booting)
-          send_boot_notice(HM_BOOT);
-     else
-          send_boot_notice(HM_ATTACH);
-     deactivated = 0;
+     /* If we are waiting for an address, the first lookup to finish
+        sends the boot notice. */
+     if (!waiting) {
+          if (booting)
+               send_boot_notice(HM_BOOT);
+          else
+               send_boot_notice(HM_ATTACH);
+          deactivated = 0;
+     }
 
 #ifdef _POSIX_VERSION
      sigemptyset(&sa.sa_mask);
@@ -527,7 +608,7 @@ send_stats(ZNotice_t *notice,
      Code_t ret;
      char *bfr;
      char *list[20];
-     int len, i, nitems = 10;
+     int len, i, nitems = 15;
      unsigned long size;
      extern int Zauthtype; /* XXX this may be changing in the future */
 
@@ -580,6 +661,21 @@ send_stats(ZNotice_t *notice,
      strncpy(list[9], MACHINE_TYPE, 32);
      list[9][31] = '\0';
 
+     list[10] = stats_malloc(64);
+     sprintf(list[10], "%ld", queue_memory());
+
+     list[11] = stats_malloc(64);
+     sprintf(list[11], "%d", queue_max_len());
+
+     list[12] = stats_malloc(64);
+     sprintf(list[12], "%d", local_deliveries);
+
+     list[13] = stats_malloc(64);
+     sprintf(list[13], "%d", queue_hedges());
+
+     list[14] = stats_malloc(64);
+     sprintf(list[14], "%d", queue_spurious());
+
      /* Since ZFormatRaw* won't change the version number on notices,
 	we need to set the version number explicitly.  This code is taken
 	from Zinternal.c, function Z_FormatHeader */
@@ -602,6 +698,38 @@ send_stats(ZNotice_t *notice,
 	  free(list[i]);
 }
 
+/*
+ * The detailed stats can be too long for one packet, and acks are
+ * never reassembled from fragments, so they go back as a STAT notice.
+ */
+static void
+send_detail_stats(ZNotice_t *notice,
+		  struct sockaddr_in *sin)
+{
+     ZNotice_t newnotice;
+     Code_t ret;
+     char *list[STATS_DETAIL_MAX];
+     int i, nitems;
+
+     newnotice = *notice;
+     newnotice.z_kind = STAT;
+     if (!*version)
+	     sprintf(version, "%s%d.%d", ZVERSIONHDR, ZVERSIONMAJOR,
+		     ZVERSIONMINOR);
+     newnotice.z_version = version;
+
+     nitems = stats_detail(list, STATS_DETAIL_MAX);
+     if ((ret = ZSetDestAddr(sin)) != ZERR_NONE) {
+	  Zperr(ret);
+	  com_err("hm", ret, "setting destination");
+     } else if ((ret = ZSendRawList(&newnotice, list, nitems)) != ZERR_NONE) {
+	  Zperr(ret);
+	  com_err("hm", ret, "sending detailed stats");
+     }
+     for (i = 0; i < nitems; i++)
+	  free(list[i]);
+}
+
 void
 die_gracefully(void)
 {
@@ -18,6 +18,9 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#ifdef HAVE_ARES
+#include <ares.h>
+#endif
 #include "timer.h"
 
 /* These macros are for insertion into and deletion from a singly-linked list
@@ -52,6 +55,23 @@ void die_gracefully(void);
 /* zhm_client.c */
 void transmission_tower(ZNotice_t *, char *, int);
 Code_t send_outgoing(ZNotice_t *);
+void flush_outgoing(void);
+
+/* zhm_local.c */
+int set_local_classes(char *);
+void flush_local(void);
+void local_client_notice(ZNotice_t *, char *, int);
+void local_server_ack(ZNotice_t *);
+void local_client_ack(ZNotice_t *);
+int local_sub_count(u_short);
+extern int local_deliveries;
+
+/* zhm_stats.c */
+#define STATS_DETAIL_MAX 80	/* lines in a detailed stats reply */
+void stats_client_packet(u_short, int);
+void stats_hmack(u_short, long);
+void stats_server_ack(u_short, long, long);
+int stats_detail(char **, int);
 
 /* queue.c */
 void init_queue(void);
@@ -62,23 +82,39 @@ Code_t remove_notice_from_queue(ZNotice_t *, ZNotice_Kind_t *,
 void retransmit_queue(struct sockaddr_in *);
 void disable_queue_retransmits(void);
 int queue_len(void);
+int queue_max_len(void);
+long queue_memory(void);
+int queue_hedges(void);
+int queue_hedged(ZNotice_t *);
+int hedge_answered(ZNotice_t *);
+int queue_spurious(void);
 
 /* zhm.c */
 extern void new_server(char *sugg_serv);
+extern void change_server(char *sugg_serv);
 extern void send_boot_notice(char *);
 extern void send_flush_notice(char *);
 
 /* zhm_server.c */
 extern void find_next_server(char *);
+extern int await_server(void);
 extern void server_manager(ZNotice_t *);
+extern void init_server_stats(void);
+extern long hedge_delay(void);
+extern struct sockaddr_in *hedge_server(void);
+extern int server_acked(long, int);
+extern long server_rto(int);
 
 extern u_short cli_port;
 extern char **serv_list;
 extern char cur_serv[], prim_serv[];
 extern struct sockaddr_in cli_sin, serv_sin, from;
-extern int no_server, deactivated, noflushflag, rebootflag;
+extern int no_server, deactivated, noflushflag, rebootflag, hedgeflag;
 extern int timeout_type, hmdebug, nservchang, booting, nclt, nserv, numserv;
 extern int rexmit_times[];
+#ifdef HAVE_ARES
+extern ares_channel achannel;
+#endif
 
 #ifdef HAVE_ETEXT
 extern int etext;
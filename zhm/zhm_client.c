@@ -10,6 +10,7 @@
  *      "mit-copyright.h". 
  */
 
+#define _GNU_SOURCE		/* for sendmmsg() */
 #include "zhm.h"
 
 #ifndef lint
@@ -18,6 +19,131 @@ static const char rcsid_hm_client_c[] = "$Id$";
 #endif /* SABER */
 #endif /* lint */
 
+/*
+ * The acks to clients and the copies sent on to the server are not
+ * sent as each client packet is handled but collected here, and the
+ * main loop sends them all at once, with sendmmsg() where there is
+ * one, after it has read everything waiting.  Anything that has to
+ * go out in order with them must call flush_outgoing() first.
+ */
+#define BATCH_MAX	64	/* packets held before we must send */
+
+static char batch_buf[BATCH_MAX][Z_MAXPKTLEN];
+static int batch_len[BATCH_MAX];
+static struct sockaddr_in batch_dest[BATCH_MAX];
+static struct timeval batch_time[BATCH_MAX];	/* when an HMACK's notice came */
+static int batch_hmack[BATCH_MAX];
+static int nbatch;
+
+static char *batch_slot(struct sockaddr_in *);
+static int make_hmack(ZNotice_t *, char *, char *);
+
+/* Return a buffer for a packet to dest, to be sent by flush_outgoing()
+ * once its length is filled in batch_len[nbatch++]. */
+static char *
+batch_slot(struct sockaddr_in *dest)
+{
+    if (nbatch == BATCH_MAX)
+	flush_outgoing();
+    batch_dest[nbatch] = *dest;
+    batch_hmack[nbatch] = 0;
+    return batch_buf[nbatch];
+}
+
+void
+flush_outgoing(void)
+{
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[BATCH_MAX];
+    struct iovec iov[BATCH_MAX];
+    int n;
+#endif
+    struct timeval now;
+    int i;
+
+#ifdef HAVE_SENDMMSG
+    memset(msgs, 0, nbatch * sizeof(struct mmsghdr));
+    for (i = 0; i < nbatch; i++) {
+	iov[i].iov_base = batch_buf[i];
+	iov[i].iov_len = batch_len[i];
+	msgs[i].msg_hdr.msg_name = &batch_dest[i];
+	msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (i = 0; i < nbatch; i += n) {
+	n = sendmmsg(ZGetFD(), msgs + i, nbatch - i, 0);
+	if (n < 0) {
+	    if (errno == EINTR) {
+		n = 0;
+		continue;
+	    }
+	    /* Skip the packet that failed and go on with the rest. */
+	    Zperr(errno);
+	    com_err("hm", errno, "sending to %s",
+		    inet_ntoa(batch_dest[i].sin_addr));
+	    n = 1;
+	}
+    }
+#else
+    for (i = 0; i < nbatch; i++) {
+	if (sendto(ZGetFD(), batch_buf[i], batch_len[i], 0,
+		   (struct sockaddr *)&batch_dest[i],
+		   sizeof(struct sockaddr_in)) < 0) {
+	    Zperr(errno);
+	    com_err("hm", errno, "sending to %s",
+		    inet_ntoa(batch_dest[i].sin_addr));
+	}
+    }
+#endif
+    (void) gettimeofday(&now, (struct timezone *)0);
+    for (i = 0; i < nbatch; i++) {
+	if (batch_hmack[i])
+	    stats_hmack(batch_dest[i].sin_port,
+			(now.tv_sec - batch_time[i].tv_sec) * 1000000L +
+			(now.tv_usec - batch_time[i].tv_usec));
+    }
+    nbatch = 0;
+}
+
+/*
+ * Make the HMACK for a client's packet from the packet's own header:
+ * the same fields, with the kind changed, the multinotice field
+ * emptied so that the library doesn't take it for a fragment, and no
+ * body.  Returns the length, or 0 if the header isn't laid out the
+ * way we expect and the ack must be formatted the slow way.
+ */
+static int
+make_hmack(ZNotice_t *notice,
+	   char *packet,
+	   char *buf)
+{
+    char *kind, *hdr_end, *mn;
+    int len, skip;
+
+    /* The kind is the third field. */
+    kind = memchr(packet, '\0', notice->z_message - packet);
+    if (kind)
+	kind = memchr(kind + 1, '\0', notice->z_message - kind - 1);
+    if (!kind || strlen(++kind) != 10)
+	return 0;
+
+    hdr_end = notice->z_message;
+    mn = notice->z_multinotice;
+    if (mn > packet && mn < hdr_end) {
+	skip = strlen(mn);
+	len = mn - packet;
+	memcpy(buf, packet, len);
+	memcpy(buf + len, mn + skip, hdr_end - mn - skip);
+	len += hdr_end - mn - skip;
+    } else {
+	len = hdr_end - packet;
+	memcpy(buf, packet, len);
+    }
+    (void) ZMakeAscii32(buf + (kind - packet), 11, HMACK);
+    return len;
+}
+
 void transmission_tower(ZNotice_t *notice,
 			char *packet,
 			int pak_len)
@@ -25,9 +151,11 @@ void transmission_tower(ZNotice_t *notice,
     ZNotice_t gack;
     Code_t ret;
     struct sockaddr_in gsin;
+    char *buf;
 
     nclt++;
     if (notice->z_kind == HMCTL) {
+	flush_outgoing();
 	if (!strcmp(notice->z_opcode, CLIENT_FLUSH)) {
 	    if (noflushflag)
 		syslog(LOG_INFO, "Client requested hm flush (disabled).");
@@ -41,39 +169,42 @@ void transmission_tower(ZNotice_t *notice,
 	    syslog (LOG_INFO, "Bad control notice from client.");
 	}
 	return;
-    } else {
-	if (notice->z_kind != UNSAFE) {
+    }
+    gsin = cli_sin;
+    gsin.sin_port = from.sin_port;
+    stats_client_packet(from.sin_port, pak_len);
+    if (notice->z_kind != UNSAFE) {
+	/* Bounce ACK to library */
+	buf = batch_slot(&gsin);
+	batch_hmack[nbatch] = 1;
+	(void) gettimeofday(&batch_time[nbatch], (struct timezone *)0);
+	if (notice->z_port == 0 ||
+	    !(batch_len[nbatch] = make_hmack(notice, packet, buf))) {
 	    gack = *notice;
 	    gack.z_kind = HMACK;
 	    gack.z_message_len = 0;
 	    gack.z_multinotice = "";
-	    gsin = cli_sin;
-	    gsin.sin_port = from.sin_port;
 	    if (gack.z_port == 0)
 		gack.z_port = from.sin_port;
-	    DPR2 ("Client Port = %u\n", ntohs(gack.z_port));
-	    notice->z_port = gack.z_port;
-	    if ((ret = ZSetDestAddr(&gsin)) != ZERR_NONE) {
+	    if ((ret = ZFormatSmallRawNotice(&gack, buf, &batch_len[nbatch]))
+		!= ZERR_NONE) {
 		Zperr(ret);
-		com_err("hm", ret, "setting destination");
-	    }
-	    /* Bounce ACK to library */
-	    if ((ret = send_outgoing(&gack)) != ZERR_NONE) {
-		Zperr(ret);
-		com_err("hm", ret, "sending raw notice");
+		com_err("hm", ret, "formatting ack");
+		batch_len[nbatch] = 0;
 	    }
 	}
+	if (batch_len[nbatch])
+	    nbatch++;
+	if (notice->z_port == 0)
+	    notice->z_port = from.sin_port;
+	DPR2 ("Client Port = %u\n", ntohs(notice->z_port));
     }
+    local_client_notice(notice, packet, pak_len);
     if (!no_server) {
 	DPR2 ("Server Port = %u\n", ntohs(serv_sin.sin_port));
-	if ((ret = ZSetDestAddr(&serv_sin)) != ZERR_NONE) {
-	    Zperr(ret);
-	    com_err("hm", ret, "setting destination");
-	}
-	if ((ret = ZSendPacket(packet, pak_len, 0)) != ZERR_NONE) {
-	    Zperr(ret);
-	    com_err("hm", ret, "while sending raw notice");
-	}
+	buf = batch_slot(&serv_sin);
+	memcpy(buf, packet, pak_len);
+	batch_len[nbatch++] = pak_len;
     }
     if (add_notice_to_queue(notice, packet, &gsin, pak_len) != ZERR_NONE)
         syslog(LOG_INFO, "Hey! Insufficient memory to add notice to queue!");
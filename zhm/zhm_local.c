@@ -0,0 +1,454 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It contains the hostmanager's local delivery routines.
+ *
+ *      $Id$
+ *
+ *      Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *      For copying and distribution information, see the file
+ *      "mit-copyright.h".
+ */
+
+#include "zhm.h"
+
+#ifndef lint
+#ifndef SABER
+static const char rcsid_hm_local_c[] = "$Id$";
+#endif /* SABER */
+#endif /* lint */
+
+/*
+ * With -L, notices in the listed classes that one client on this host
+ * sends to another are handed to the receiving client straight away,
+ * without waiting for them to come back from the server.  The server
+ * still delivers its own copy, which the receiving library acks and
+ * then drops, since it has already seen that UID; so the local copy
+ * only ever saves time, and a notice we fail to deliver here arrives
+ * the usual way.
+ *
+ * We learn who wants what from the subscription requests our clients
+ * send through us, taking a subscription only once the server has
+ * acked the request and only if the server would have kept it (its
+ * recipient is empty, our realm, or the subscriber).  The server's
+ * class ACLs are not visible from here, so the classes must be ones
+ * the administrator knows to be unrestricted; and since the receiving
+ * library would check an authenticated notice against its own key, we
+ * only pass on unauthenticated ones.  A port that stops acking the
+ * copies we send it is forgotten.
+ */
+#define LOCAL_MAXPENDING 32	/* subscription requests awaiting acks */
+#define LOCAL_MAXUNACKED 8	/* unacked copies before we drop a port */
+
+struct local_sub {
+    struct local_sub *next;
+    char *class;
+    char *inst;
+    char *recip;
+};
+
+struct local_client {
+    struct local_client *next;
+    u_short port;
+    int unacked;		/* copies sent since its last ack */
+    struct local_sub *subs;
+};
+
+struct local_pending {
+    struct local_pending *next;
+    ZUnique_Id_t uid;
+    u_short port;
+    char *sender;
+    char *message;
+    int message_len;
+};
+
+static char **local_classes;
+static int nlocal_classes;
+static struct local_client *local_clients;
+static struct local_pending *local_pending;
+static int nlocal_pending;
+
+int local_deliveries;
+
+static int local_class __P((char *));
+static char *next_field __P((char **, char *));
+static char *local_recip __P((char *, char *));
+static struct local_client *find_local_client __P((u_short, int));
+static void free_local_client __P((struct local_client **));
+static void free_pending __P((struct local_pending **));
+static void local_note_subscribe __P((ZNotice_t *));
+static void local_subscribe __P((struct local_pending *));
+static void local_unsubscribe __P((ZNotice_t *));
+static void local_deliver __P((ZNotice_t *, char *, int));
+
+/* Take a comma-separated list of classes to deliver locally. */
+int
+set_local_classes(char *list)
+{
+    char *cp;
+
+    list = strdup(list);
+    if (!list)
+	return -1;
+    for (cp = strtok(list, ","); cp; cp = strtok(NULL, ",")) {
+	if (!strcasecmp(cp, ZEPHYR_CTL_CLASS) ||
+	    !strcasecmp(cp, ZEPHYR_ADMIN_CLASS) ||
+	    !strcasecmp(cp, HM_CTL_CLASS) || !strcasecmp(cp, LOGIN_CLASS) ||
+	    !strcasecmp(cp, LOCATE_CLASS))
+	    return -1;
+	local_classes = realloc(local_classes,
+				(nlocal_classes + 1) * sizeof(char *));
+	if (!local_classes)
+	    return -1;
+	local_classes[nlocal_classes++] = cp;
+    }
+    return 0;
+}
+
+static int
+local_class(char *class)
+{
+    int i;
+
+    for (i = 0; i < nlocal_classes; i++) {
+	if (!strcasecmp(local_classes[i], class))
+	    return 1;
+    }
+    return 0;
+}
+
+/* Step over one NUL-terminated field of a subscription list. */
+static char *
+next_field(char **cpp,
+	   char *end)
+{
+    char *field = *cpp, *nul;
+
+    nul = memchr(field, '\0', end - field);
+    if (!nul)
+	return NULL;
+    *cpp = nul + 1;
+    return field;
+}
+
+/*
+ * The recipient as the server would match it: our own realm alone
+ * means everyone.  Returns NULL for a recipient the server would not
+ * deliver locally (another realm) or, given a sender, would not let
+ * that sender subscribe to.
+ */
+static char *
+local_recip(char *recip,
+	    char *sender)
+{
+    if (*recip == '@')
+	return strcmp(recip + 1, ZGetRealm()) ? NULL : "";
+    if (sender && *recip && strcmp(recip, sender))
+	return NULL;
+    return recip;
+}
+
+static struct local_client *
+find_local_client(u_short port,
+		  int create)
+{
+    struct local_client *c;
+
+    for (c = local_clients; c; c = c->next) {
+	if (c->port == port)
+	    return c;
+    }
+    if (!create)
+	return NULL;
+    c = (struct local_client *) malloc(sizeof(struct local_client));
+    if (!c)
+	return NULL;
+    c->port = port;
+    c->unacked = 0;
+    c->subs = NULL;
+    c->next = local_clients;
+    local_clients = c;
+    return c;
+}
+
+static void
+free_local_client(struct local_client **cp)
+{
+    struct local_client *c = *cp;
+    struct local_sub *s;
+
+    *cp = c->next;
+    while ((s = c->subs)) {
+	c->subs = s->next;
+	free(s->class);
+	free(s->inst);
+	free(s->recip);
+	free(s);
+    }
+    free(c);
+}
+
+static void
+free_pending(struct local_pending **pp)
+{
+    struct local_pending *p = *pp;
+
+    *pp = p->next;
+    free(p->sender);
+    free(p->message);
+    free(p);
+    nlocal_pending--;
+}
+
+/* The server has forgotten all of this host's subscriptions. */
+void
+flush_local(void)
+{
+    while (local_clients)
+	free_local_client(&local_clients);
+    while (local_pending)
+	free_pending(&local_pending);
+}
+
+/* Note what a client's subscription request asked for, to be taken
+ * once the server acks it. */
+static void
+local_note_subscribe(ZNotice_t *notice)
+{
+    struct local_pending *p, **pp;
+
+    if (!ZCompareUID(&notice->z_uid, &notice->z_multiuid))
+	return;
+    if (nlocal_pending == LOCAL_MAXPENDING) {
+	for (pp = &local_pending; (*pp)->next; pp = &(*pp)->next)
+	    ;
+	free_pending(pp);
+    }
+    p = (struct local_pending *) malloc(sizeof(struct local_pending));
+    if (!p)
+	return;
+    p->uid = notice->z_uid;
+    p->port = notice->z_port;
+    p->sender = strdup(notice->z_sender);
+    p->message = malloc(notice->z_message_len + 1);
+    if (!p->sender || !p->message) {
+	free(p->sender);
+	free(p->message);
+	free(p);
+	return;
+    }
+    memcpy(p->message, notice->z_message, notice->z_message_len);
+    p->message[notice->z_message_len] = '\0';
+    p->message_len = notice->z_message_len;
+    p->next = local_pending;
+    local_pending = p;
+    nlocal_pending++;
+}
+
+static void
+local_subscribe(struct local_pending *p)
+{
+    struct local_client *c;
+    struct local_sub *s;
+    char *cp, *end, *class, *inst, *recip;
+
+    c = NULL;
+    cp = p->message;
+    end = p->message + p->message_len;
+    while (cp < end && *cp) {
+	if (!(class = next_field(&cp, end)) ||
+	    !(inst = next_field(&cp, end)) ||
+	    !(recip = next_field(&cp, end)))
+	    break;
+	if (!local_class(class) || !(recip = local_recip(recip, p->sender)))
+	    continue;
+	if (!c && !(c = find_local_client(p->port, 1)))
+	    return;
+	/* Clients resubscribe to everything whenever they reload their
+	   subscriptions, so most requests repeat what we already have. */
+	for (s = c->subs; s; s = s->next) {
+	    if (!strcasecmp(s->class, class) && !strcasecmp(s->inst, inst) &&
+		!strcmp(s->recip, recip))
+		break;
+	}
+	if (s)
+	    continue;
+	s = (struct local_sub *) malloc(sizeof(struct local_sub));
+	if (!s)
+	    return;
+	s->class = strdup(class);
+	s->inst = strdup(inst);
+	s->recip = strdup(recip);
+	if (!s->class || !s->inst || !s->recip) {
+	    free(s->class);
+	    free(s->inst);
+	    free(s->recip);
+	    free(s);
+	    return;
+	}
+	s->next = c->subs;
+	c->subs = s;
+    }
+    if (c && hmdebug)
+	syslog(LOG_DEBUG, "Port %u has %d local subscriptions",
+	       ntohs(c->port), local_sub_count(c->port));
+}
+
+/* How many subscriptions we are mirroring for the client on port. */
+int
+local_sub_count(u_short port)
+{
+    struct local_client *c;
+    struct local_sub *s;
+    int n = 0;
+
+    c = find_local_client(port, 0);
+    if (c) {
+	for (s = c->subs; s; s = s->next)
+	    n++;
+    }
+    return n;
+}
+
+/* Dropping a subscription early is always safe, so do it now. */
+static void
+local_unsubscribe(ZNotice_t *notice)
+{
+    struct local_client *c;
+    struct local_sub **sp, *s;
+    char *cp, *end, *class, *inst, *recip;
+
+    c = find_local_client(notice->z_port, 0);
+    if (!c)
+	return;
+    cp = notice->z_message;
+    end = notice->z_message + notice->z_message_len;
+    while (cp < end && *cp) {
+	if (!(class = next_field(&cp, end)) ||
+	    !(inst = next_field(&cp, end)) ||
+	    !(recip = next_field(&cp, end)))
+	    break;
+	if (!(recip = local_recip(recip, NULL)))
+	    continue;
+	for (sp = &c->subs; (s = *sp);) {
+	    if (!strcasecmp(s->class, class) && !strcasecmp(s->inst, inst) &&
+		!strcmp(s->recip, recip)) {
+		*sp = s->next;
+		free(s->class);
+		free(s->inst);
+		free(s->recip);
+		free(s);
+	    } else {
+		sp = &s->next;
+	    }
+	}
+    }
+}
+
+/* Hand a copy of the packet to every local client that wants it. */
+static void
+local_deliver(ZNotice_t *notice,
+	      char *packet,
+	      int len)
+{
+    struct local_client **cp, *c;
+    struct local_sub *s;
+    struct sockaddr_in sin;
+    char *recip;
+    Code_t ret;
+
+    if (notice->z_auth || !local_class(notice->z_class))
+	return;
+    recip = local_recip(notice->z_recipient, NULL);
+    if (!recip)
+	return;
+    sin = cli_sin;
+    for (cp = &local_clients; (c = *cp);) {
+	for (s = c->subs; s; s = s->next) {
+	    if (!strcasecmp(s->class, notice->z_class) &&
+		(!strcmp(s->inst, "*") ||
+		 !strcasecmp(s->inst, notice->z_class_inst)) &&
+		!strcmp(s->recip, recip))
+		break;
+	}
+	if (!s) {
+	    cp = &c->next;
+	    continue;
+	}
+	if (++c->unacked > LOCAL_MAXUNACKED) {
+	    syslog(LOG_INFO, "Local client on port %u stopped answering.",
+		   ntohs(c->port));
+	    free_local_client(cp);
+	    continue;
+	}
+	sin.sin_port = c->port;
+	if ((ret = ZSetDestAddr(&sin)) != ZERR_NONE) {
+	    Zperr(ret);
+	    com_err("hm", ret, "setting destination");
+	} else if ((ret = ZSendPacket(packet, len, 0)) != ZERR_NONE) {
+	    Zperr(ret);
+	    com_err("hm", ret, "delivering locally");
+	} else {
+	    DPR2("Delivered locally to port %u\n", ntohs(c->port));
+	    local_deliveries++;
+	}
+	cp = &c->next;
+    }
+}
+
+/* A notice from one of our clients, about to go to the server. */
+void
+local_client_notice(ZNotice_t *notice,
+		    char *packet,
+		    int len)
+{
+    if (!nlocal_classes)
+	return;
+    if (!strcasecmp(notice->z_class, ZEPHYR_CTL_CLASS)) {
+	if (strcasecmp(notice->z_class_inst, ZEPHYR_CTL_CLIENT))
+	    return;
+	if (!strcmp(notice->z_opcode, CLIENT_SUBSCRIBE) ||
+	    !strcmp(notice->z_opcode, CLIENT_SUBSCRIBE_NODEFS)) {
+	    local_note_subscribe(notice);
+	} else if (!strcmp(notice->z_opcode, CLIENT_UNSUBSCRIBE)) {
+	    local_unsubscribe(notice);
+	} else if (!strcmp(notice->z_opcode, CLIENT_CANCELSUB)) {
+	    struct local_client **cp;
+
+	    for (cp = &local_clients; *cp; cp = &(*cp)->next) {
+		if ((*cp)->port == notice->z_port) {
+		    free_local_client(cp);
+		    break;
+		}
+	    }
+	}
+	return;
+    }
+    local_deliver(notice, packet, len);
+}
+
+/* The server's answer to one of our clients' notices. */
+void
+local_server_ack(ZNotice_t *notice)
+{
+    struct local_pending **pp;
+
+    for (pp = &local_pending; *pp; pp = &(*pp)->next) {
+	if (ZCompareUID(&(*pp)->uid, &notice->z_uid)) {
+	    if (notice->z_kind == SERVACK)
+		local_subscribe(*pp);
+	    free_pending(pp);
+	    return;
+	}
+    }
+}
+
+/* A client acking a copy we delivered. */
+void
+local_client_ack(ZNotice_t *notice)
+{
+    struct local_client *c;
+
+    c = find_local_client(from.sin_port, 0);
+    if (c)
+	c->unacked = 0;
+}
@@ -18,13 +18,75 @@ static const char rcsid_hm_server_c[] = "$Id$";
 #endif /* SABER */
 #endif /* lint */
 
+/*
+ * Every PROBE_INTERVAL seconds we send each server in the cluster an
+ * HM_PING, which it just acks, and keep a smoothed round trip time and
+ * loss rate for it.  When we have to find a new server we take the
+ * fastest healthy one, and we move off our server on our own if it is
+ * losing probes or has become much slower than another.  A server that
+ * has never answered a probe is unknown rather than dead, so we never
+ * leave it on that evidence.  It may well predate HM_PING, in which case
+ * it logs each one as an unknown opcode, so we probe it less and less
+ * often, down to once every PROBE_BACKOFF_MAX rounds.
+ *
+ * The same table caches the servers' addresses.  With c-ares they are
+ * looked up in the background and refreshed every RESOLVE_INTERVAL;
+ * a failed lookup keeps the last address that worked.
+ */
+#define PROBE_INTERVAL	30	/* seconds between probe rounds */
+#define PROBE_MIN_REPLIES 3	/* replies before we trust the RTT */
+#define PROBE_BACKOFF_MAX 120	/* most rounds a silent server is skipped */
+#define LOSS_UNHEALTHY	500	/* loss rate (per mille) of a sick server */
+#define LOSS_PENALTY	1000	/* usec of score per mille of loss */
+#define SWITCH_MARGIN	20000	/* usec another server must win by */
+#define SWITCH_HOLDDOWN	300	/* seconds between proactive switches */
+#define RESOLVE_INTERVAL 3600	/* seconds between address refreshes */
+#define HEDGE_MIN	20	/* msec before a notice is hedged */
+#define HEDGE_MAX	1000
+#define HEDGE_UNKNOWN	500	/* msec, until we have a measured RTT */
+#define REXMIT_MIN	200	/* shortest adaptive retransmit, msec */
+
+struct serv_stat {
+    char *name;			/* copy of the entry in serv_list */
+    struct sockaddr_in addr;
+    int got_addr;		/* addr is valid */
+    int lookup_pending;		/* waiting on the resolver */
+    int replies;		/* probes answered */
+    int outstanding;		/* probe sent and not yet answered */
+    int backoff;		/* rounds skipped after the last loss */
+    int skip;			/* rounds still to skip */
+    ZUnique_Id_t uid;		/* of the outstanding probe */
+    struct timeval sent;
+    long srtt;			/* smoothed round trip time, usec */
+    int loss;			/* smoothed loss rate, per mille */
+    long ack_srtt;		/* smoothed notice ack time, usec; 0 if none */
+    long ack_rttvar;		/* its mean deviation, usec */
+    long ack_min;		/* least ack time seen, usec */
+};
+
 static void boot_timeout __P((void *));
 static int get_serv_timeout __P((void));
+static void probe_servers __P((void *));
+static int probe_reply __P((ZNotice_t *));
+static struct serv_stat *best_server __P((char *));
+static struct serv_stat *find_serv_stat __P((char *));
+static struct serv_stat *random_server __P((char *));
+static void lookup_server_address __P((struct serv_stat *));
+static void got_server_address __P((struct serv_stat *, struct hostent *));
+#ifdef HAVE_ARES
+static void server_address_lookup_cb __P((void *, int, int, struct hostent *));
+#endif
 
 static Timer *boot_timer = NULL;
 static int serv_rexmit_times[] = { 5, 10, 20, 40 };
 static int serv_timeouts = 0;
 
+static struct serv_stat *serv_stats = NULL;
+static int nserv_stats = 0;
+static Timer *probe_timer = NULL;
+static time_t last_switch, last_resolve;
+static int awaiting_addr = 0;	/* started with no server address */
+
 int serv_loop = 0;
 
 void hm_control(ZNotice_t *);
@@ -38,6 +100,10 @@ send_boot_notice(char *op)
      ZNotice_t notice;
      Code_t ret;
 
+     /* There is no one to send it to yet; see await_server(). */
+     if (awaiting_addr)
+	  return;
+
      memset(&notice, 0, sizeof(ZNotice_t));
      /* Set up server notice */
      notice.z_kind = HMCTL;
@@ -51,6 +117,10 @@ send_boot_notice(char *op)
      notice.z_num_other_fields = 0;
      notice.z_message_len = 0;
 
+     /* A boot loses all of this host's subscriptions */
+     if (!strcmp(op, HM_BOOT))
+	  flush_local();
+
      /* Notify server that this host is here */
      if ((ret = ZSetDestAddr(&serv_sin)) != ZERR_NONE) {
 	  Zperr(ret);
@@ -70,6 +140,9 @@ send_flush_notice(char *op)
      ZNotice_t notice;
      Code_t ret;
 
+     if (awaiting_addr)
+	  return;
+
      memset(&notice, 0, sizeof(ZNotice_t));
      /* Set up server notice */
      notice.z_kind = HMCTL;
@@ -83,6 +156,9 @@ send_flush_notice(char *op)
      notice.z_num_other_fields = 0;
      notice.z_message_len = 0;
 
+     if (!strcmp(op, HM_FLUSH))
+	  flush_local();
+
      /* Tell server to lose us */
      if ((ret = ZSetDestAddr(&serv_sin)) != ZERR_NONE) {
 	  Zperr(ret);
@@ -94,85 +170,93 @@ send_flush_notice(char *op)
      }
 }
 
+/*
+ * Point serv_sin at another server.  Addresses come only from the
+ * cache in serv_stats, which is filled in the background, so this never
+ * waits on the resolver; if we know no other address we stay put and
+ * let the boot timer try again.
+ */
 void
 find_next_server(char *sugg_serv)
 {
-     struct hostent *hp = 0;
-     int done = 0;
-     char **parse = serv_list;
-     char *new_serv;
-
-     if (sugg_serv) {
-	  do {
-	       if (!strcmp(*parse, sugg_serv))
-		    done = 1;
-	  } while ((done == 0) && (*++parse != NULL));
-     }
-     if (done) {
-	  if ((hp = gethostbyname(sugg_serv)) != NULL) {
-	       DPR2 ("Server = %s\n", sugg_serv);
-	       (void)strncpy(cur_serv, sugg_serv, NS_MAXDNAME);
-	       cur_serv[NS_MAXDNAME - 1] = '\0';
-	       if (hmdebug)
-		    syslog(LOG_DEBUG, "Suggested server: %s\n", sugg_serv);
-	  } else {
-	       done = 0;
+     struct serv_stat *s = NULL;
+
+     if (sugg_serv && (s = find_serv_stat(sugg_serv)) != NULL &&
+	 s->got_addr) {
+	  if (hmdebug)
+	       syslog(LOG_DEBUG, "Suggested server: %s\n", sugg_serv);
+     } else if ((s = best_server(cur_serv)) != NULL) {
+	  if (hmdebug)
+	       syslog(LOG_DEBUG, "Fastest server: %s (%ld usec, %d/1000 lost)",
+		      s->name, s->srtt, s->loss);
+     } else {
+	  s = NULL;
+	  if ((++serv_loop > 3) && (strcmp(cur_serv, prim_serv))) {
+	       serv_loop = 0;
+	       s = find_serv_stat(prim_serv);
+	       if (s && !s->got_addr)
+		    s = NULL;
 	  }
+	  if (!s)
+	       s = random_server(cur_serv);
      }
-     while (!done) {
-	 if ((++serv_loop > 3) && (strcmp(cur_serv, prim_serv))) {
-	     serv_loop = 0;
-	     if ((hp = gethostbyname(prim_serv)) != NULL) {
-		 DPR2 ("Server = %s\n", prim_serv);
-		 (void)strncpy(cur_serv, prim_serv, NS_MAXDNAME);
-		 cur_serv[NS_MAXDNAME - 1] = '\0';
-		 done = 1;
-		 break;
-	     }
-	 }
-
-	 switch (numserv) {
-	 case 1:
-	     if ((hp = gethostbyname(*serv_list)) != NULL) {
-		 DPR2 ("Server = %s\n", *serv_list);
-		 (void)strncpy(cur_serv, *serv_list, NS_MAXDNAME);
-		 cur_serv[NS_MAXDNAME - 1] = '\0';
-		 done = 1;
-		 break;
-	     }
-	     /* fall through */
-	 case 0:
-	     if (rebootflag)
-		 die_gracefully();
-	     else
-		 sleep(1);
-	     break;
-	 default:
-	     do {
-		 new_serv = serv_list[random() % numserv];
-	     } while (!strcmp(new_serv, cur_serv));
-
-	     if ((hp = gethostbyname(new_serv)) != NULL) {
-		 DPR2 ("Server = %s\n", new_serv);
-		 (void)strncpy(cur_serv, new_serv, NS_MAXDNAME);
-		 cur_serv[NS_MAXDNAME - 1] = '\0';
-		 done = 1;
-	     } else
-		 sleep(1);
-
-	     break;
-	 }
+     if (!s) {
+	  /* As when every lookup blocked: with no other server to try,
+	     a rebooting hostmanager gives up. */
+	  if (rebootflag && numserv < 2)
+	       die_gracefully();
+	  syslog(LOG_WARNING, "No address known for another server, "
+		 "staying with %s", cur_serv);
+	  return;
      }
-     (void) memcpy((char *)&serv_sin.sin_addr, hp->h_addr, 4);
+     DPR2 ("Server = %s\n", s->name);
+     (void)strncpy(cur_serv, s->name, NS_MAXDNAME);
+     cur_serv[NS_MAXDNAME - 1] = '\0';
+     serv_sin.sin_addr = s->addr.sin_addr;
+     last_switch = time(NULL);
      nservchang++;
 }
 
+/*
+ * At startup, when the primary server's name would not resolve: use
+ * any server whose address is already known, or else stay detached,
+ * queueing what clients send, until a lookup comes back and
+ * got_server_address() boots us with that server.  Returns 0 in that
+ * case, 1 if serv_sin is set.
+ */
+int
+await_server(void)
+{
+     struct serv_stat *s;
+
+     s = random_server(prim_serv);
+     if (s) {
+	  DPR2 ("Server = %s\n", s->name);
+	  (void)strncpy(cur_serv, s->name, NS_MAXDNAME);
+	  cur_serv[NS_MAXDNAME - 1] = '\0';
+	  serv_sin.sin_addr = s->addr.sin_addr;
+	  return 1;
+     }
+     syslog(LOG_WARNING, "No server address known yet, waiting for one");
+     awaiting_addr = 1;
+     return 0;
+}
+
 void
 server_manager(ZNotice_t *notice)
 {
+    if (probe_reply(notice))
+	return;
     if (memcmp((char *)&serv_sin.sin_addr, (char *)&from.sin_addr, 4) ||
 	(serv_sin.sin_port != from.sin_port)) {
-	syslog (LOG_INFO, "Bad notice from port %u.", notice->z_port);
+	/* The other server answering a hedged notice first. */
+	if ((notice->z_kind == SERVACK || notice->z_kind == SERVNAK) &&
+	    queue_hedged(notice)) {
+	    nserv++;
+	    send_back(notice);
+	} else if (!hedge_answered(notice)) {
+	    syslog (LOG_INFO, "Bad notice from port %u.", notice->z_port);
+	}
     } else {
 	/* This is our server, handle the notice */
 	booting = 0;
@@ -202,22 +286,20 @@ void
 hm_control(ZNotice_t *notice)
 {
     Code_t ret;
-    struct hostent *hp;
-    char suggested_server[NS_MAXDNAME];
+    struct serv_stat *s;
     unsigned long addr;
 
     DPR("Control message!\n");
     if (!strcmp(notice->z_opcode, SERVER_SHUTDOWN)) {
 	if (notice->z_message_len) {
+	    /* Only a server in our list will do, so look the address up
+	       there rather than asking the resolver for its name. */
 	    addr = inet_addr(notice->z_message);
-	    hp = gethostbyaddr((char *) &addr, sizeof(addr), AF_INET);
-	    if (hp != NULL) {
-		strncpy(suggested_server, hp->h_name, sizeof(suggested_server));
-		suggested_server[sizeof(suggested_server) - 1] = '\0';
-		new_server(suggested_server);
-	    } else {
-		new_server(NULL);
+	    for (s = serv_stats; s < serv_stats + nserv_stats; s++) {
+		if (s->got_addr && s->addr.sin_addr.s_addr == addr)
+		    break;
 	    }
+	    new_server(s < serv_stats + nserv_stats ? s->name : NULL);
 	} else {
 	    new_server((char *)NULL);
 	}
@@ -255,8 +337,10 @@ send_back(ZNotice_t *notice)
 	if (rebootflag)
 	    die_gracefully();
     } else {
+	local_server_ack(notice);
 	if (remove_notice_from_queue(notice, &kind, &repl) != ZERR_NONE) {
-	    syslog (LOG_INFO, "Hey! This packet isn't in my queue!");
+	    if (!hedge_answered(notice))
+		syslog (LOG_INFO, "Hey! This packet isn't in my queue!");
 	} else {
 	    /* check if client wants an ACK, and send it */
 	    if (kind == ACKED) {
@@ -281,8 +365,14 @@ send_back(ZNotice_t *notice)
 void
 new_server(char *sugg_serv)
 {
-    no_server = 1;
     syslog (LOG_INFO, "Server went down, finding new server.");
+    change_server(sugg_serv);
+}
+
+void
+change_server(char *sugg_serv)
+{
+    no_server = 1;
     send_flush_notice(HM_DETACH);
     find_next_server(sugg_serv);
     if (booting || deactivated) {
@@ -311,3 +401,416 @@ static int get_serv_timeout(void)
 	ind = ntimeouts - 1;
     return serv_rexmit_times[ind];
 }
+
+/*
+ * Start over with a new serv_list, keeping the addresses of servers
+ * that were already in it, and look up the rest.
+ */
+void
+init_server_stats(void)
+{
+    struct serv_stat *new_stats, *old;
+    int i;
+
+    /* The old table's names are our own copies: choose_server() may
+       already have freed the serv_list entries they came from. */
+
+    new_stats = NULL;
+    if (numserv > 0) {
+	new_stats = (struct serv_stat *) calloc(numserv,
+						sizeof(struct serv_stat));
+	if (!new_stats) {
+	    syslog(LOG_ERR, "Out of memory for server statistics");
+	    return;
+	}
+    }
+    for (i = 0; i < numserv; i++) {
+	new_stats[i].name = strdup(serv_list[i]);
+	if (!new_stats[i].name) {
+	    syslog(LOG_ERR, "Out of memory for server statistics");
+	    while (i--)
+		free(new_stats[i].name);
+	    free(new_stats);
+	    return;
+	}
+	new_stats[i].addr.sin_family = AF_INET;
+	old = find_serv_stat(serv_list[i]);
+	if (old && old->got_addr) {
+	    new_stats[i].addr.sin_addr = old->addr.sin_addr;
+	    new_stats[i].got_addr = 1;
+	}
+    }
+    for (i = 0; i < nserv_stats; i++)
+	free(serv_stats[i].name);
+    free(serv_stats);
+    serv_stats = new_stats;
+    nserv_stats = numserv;
+
+    for (i = 0; i < nserv_stats; i++)
+	lookup_server_address(&serv_stats[i]);
+    last_resolve = time(NULL);
+    if (!probe_timer)
+	probe_timer = timer_set_rel(PROBE_INTERVAL, probe_servers, NULL);
+}
+
+#ifdef HAVE_ARES
+
+static void
+lookup_server_address(struct serv_stat *s)
+{
+    char *name;
+
+    if (s->lookup_pending)
+	return;
+    /* The table may be rebuilt before the answer comes back, so the
+       callback finds the entry again by name. */
+    name = strdup(s->name);
+    if (!name)
+	return;
+    s->lookup_pending = 1;
+    ares_gethostbyname(achannel, name, AF_INET, server_address_lookup_cb,
+		       name);
+}
+
+static void
+server_address_lookup_cb(void *arg,
+			 int status,
+			 int timeouts,
+			 struct hostent *hp)
+{
+    char *name = arg;
+    struct serv_stat *s;
+
+    s = find_serv_stat(name);
+    if (s) {
+	s->lookup_pending = 0;
+	if (status == ARES_SUCCESS) {
+	    got_server_address(s, hp);
+	} else {
+	    syslog(LOG_WARNING, "%s: hostname lookup failed: %s", name,
+		   ares_strerror(status));
+	}
+    }
+    free(name);
+}
+
+#else
+
+static void
+lookup_server_address(struct serv_stat *s)
+{
+    struct hostent *hp;
+
+    hp = gethostbyname(s->name);
+    if (hp) {
+	got_server_address(s, hp);
+    } else {
+	syslog(LOG_WARNING, "hostname failed, %s", s->name);
+    }
+}
+
+#endif
+
+static void
+got_server_address(struct serv_stat *s,
+		   struct hostent *hp)
+{
+    (void) memcpy(&s->addr.sin_addr, hp->h_addr, 4);
+    s->got_addr = 1;
+    if (awaiting_addr) {
+	/* The first server we can reach; see await_server(). */
+	awaiting_addr = 0;
+	DPR2 ("Server = %s\n", s->name);
+	(void)strncpy(cur_serv, s->name, NS_MAXDNAME);
+	cur_serv[NS_MAXDNAME - 1] = '\0';
+	serv_sin.sin_addr = s->addr.sin_addr;
+	send_boot_notice(HM_BOOT);
+	deactivated = 0;
+    }
+}
+
+static struct serv_stat *
+find_serv_stat(char *name)
+{
+    int i;
+
+    for (i = 0; i < nserv_stats; i++) {
+	if (!strcasecmp(serv_stats[i].name, name))
+	    return &serv_stats[i];
+    }
+    return NULL;
+}
+
+/* Any server but the one named whose address we know, or failing
+   that the one named. */
+static struct serv_stat *
+random_server(char *except)
+{
+    struct serv_stat *s, *self = NULL;
+    int n = 0;
+
+    for (s = serv_stats; s < serv_stats + nserv_stats; s++) {
+	if (!s->got_addr)
+	    continue;
+	if (!strcasecmp(s->name, except))
+	    self = s;
+	else
+	    n++;
+    }
+    if (n == 0)
+	return self;
+    n = random() % n;
+    for (s = serv_stats; s < serv_stats + nserv_stats; s++) {
+	if (s->got_addr && strcasecmp(s->name, except) && n-- == 0)
+	    break;
+    }
+    return s;
+}
+
+static long
+serv_score(struct serv_stat *s)
+{
+    return s->srtt + (long) s->loss * LOSS_PENALTY;
+}
+
+/* The healthy server, other than the one named, with the best score. */
+static struct serv_stat *
+best_server(char *except)
+{
+    struct serv_stat *s, *best = NULL;
+
+    for (s = serv_stats; s < serv_stats + nserv_stats; s++) {
+	if (!s->got_addr || s->replies < PROBE_MIN_REPLIES ||
+	    s->loss >= LOSS_UNHEALTHY || !strcasecmp(s->name, except))
+	    continue;
+	if (!best || serv_score(s) < serv_score(best))
+	    best = s;
+    }
+    return best;
+}
+
+static void
+send_probe(struct serv_stat *s)
+{
+    ZNotice_t notice;
+    Code_t ret;
+
+    memset(&notice, 0, sizeof(ZNotice_t));
+    notice.z_kind = HMCTL;
+    notice.z_port = cli_port;
+    notice.z_class = ZEPHYR_CTL_CLASS;
+    notice.z_class_inst = ZEPHYR_CTL_HM;
+    notice.z_opcode = HM_PING;
+    notice.z_sender = "HM";
+    notice.z_recipient = "";
+    notice.z_default_format = "";
+    notice.z_num_other_fields = 0;
+    notice.z_message_len = 0;
+
+    s->addr.sin_port = serv_sin.sin_port;
+    if ((ret = ZSetDestAddr(&s->addr)) != ZERR_NONE) {
+	Zperr(ret);
+	com_err("hm", ret, "setting destination");
+	return;
+    }
+    (void) gettimeofday(&s->sent, (struct timezone *)0);
+    if ((ret = ZSendNotice(&notice, ZNOAUTH)) != ZERR_NONE) {
+	Zperr(ret);
+	com_err("hm", ret, "sending probe");
+	return;
+    }
+    s->uid = notice.z_uid;
+    s->outstanding = 1;
+}
+
+static void
+probe_servers(void *arg)
+{
+    struct serv_stat *s, *cur, *best;
+
+    probe_timer = timer_set_rel(PROBE_INTERVAL, probe_servers, NULL);
+
+    /* Retry failed lookups every round; with the resolver running in
+       the background, refresh the good ones now and then too. */
+#ifdef HAVE_ARES
+    if (time(NULL) - last_resolve >= RESOLVE_INTERVAL) {
+	last_resolve = time(NULL);
+	for (s = serv_stats; s < serv_stats + nserv_stats; s++)
+	    lookup_server_address(s);
+    }
+#endif
+    for (s = serv_stats; s < serv_stats + nserv_stats; s++) {
+	if (!s->got_addr)
+	    lookup_server_address(s);
+    }
+
+    if (nserv_stats < 2)
+	return;
+
+    for (s = serv_stats; s < serv_stats + nserv_stats; s++) {
+	/* A probe still out from last time has been lost. */
+	if (s->outstanding) {
+	    s->loss += (1000 - s->loss) / 8;
+	    s->outstanding = 0;
+	    if (!s->replies) {
+		s->backoff = s->backoff ? 2 * s->backoff : 1;
+		if (s->backoff > PROBE_BACKOFF_MAX)
+		    s->backoff = PROBE_BACKOFF_MAX;
+		s->skip = s->backoff;
+	    }
+	}
+	if (s->skip) {
+	    s->skip--;
+	    continue;
+	}
+	if (s->got_addr)
+	    send_probe(s);
+    }
+
+    /* Decide whether to move, based on the last round's results. */
+    if (no_server || booting || time(NULL) - last_switch < SWITCH_HOLDDOWN)
+	return;
+    cur = find_serv_stat(cur_serv);
+    if (!cur || cur->replies < PROBE_MIN_REPLIES)
+	return;
+    best = best_server(cur_serv);
+    if (!best)
+	return;
+    if (cur->loss >= LOSS_UNHEALTHY ||
+	2 * serv_score(best) + SWITCH_MARGIN < serv_score(cur)) {
+	syslog(LOG_INFO, "Server %s is slow (%ld usec, %d/1000 lost), "
+	       "switching to %s (%ld usec, %d/1000 lost)", cur->name,
+	       cur->srtt, cur->loss, best->name, best->srtt, best->loss);
+	change_server(best->name);
+    }
+}
+
+/* The server to hedge our notices to: the best other one we know. */
+struct sockaddr_in *
+hedge_server(void)
+{
+    struct serv_stat *s;
+
+    s = best_server(cur_serv);
+    if (!s) {
+	s = random_server(cur_serv);
+	if (!s || !strcasecmp(s->name, cur_serv))
+	    return NULL;
+    }
+    s->addr.sin_port = serv_sin.sin_port;
+    return &s->addr;
+}
+
+/*
+ * How long, in msec, to wait for our server's ack before hedging:
+ * three of its probe round trips, or -1 if there is no other server
+ * to hedge to.
+ */
+long
+hedge_delay(void)
+{
+    struct serv_stat *cur;
+    long delay;
+
+    if (!hedge_server())
+	return -1;
+    cur = find_serv_stat(cur_serv);
+    if (!cur || cur->replies < PROBE_MIN_REPLIES)
+	return HEDGE_UNKNOWN;
+    delay = 3 * cur->srtt / 1000;
+    if (delay < HEDGE_MIN)
+	delay = HEDGE_MIN;
+    if (delay > HEDGE_MAX)
+	delay = HEDGE_MAX;
+    return delay;
+}
+
+/*
+ * The queue's retransmit timer follows our current server's ack time
+ * rather than the probe RTT, since probes come only every
+ * PROBE_INTERVAL and a busy server's load changes faster than that.
+ * Each server keeps its own estimate, so one we come back to after a
+ * switch picks up where it left off.
+ */
+
+/*
+ * Take the time from our last transmission of a notice to the server's
+ * ack.  Returns 1 if the notice had been retransmitted and the ack came
+ * back sooner after that than any round trip we have seen, so that it
+ * must have been for the first copy.
+ */
+int
+server_acked(long rtt,
+	     int retransmitted)
+{
+    struct serv_stat *s;
+
+    s = find_serv_stat(cur_serv);
+    if (!s)
+	return 0;
+    if (retransmitted)
+	return rtt < s->ack_min;
+    if (!s->ack_srtt || rtt < s->ack_min)
+	s->ack_min = rtt;
+    Z_RttSample(&s->ack_srtt, &s->ack_rttvar, rtt);
+    return 0;
+}
+
+/*
+ * The time, in msec, to wait after transmission number retries, no
+ * longer than rexmit_times[] would wait and just that until the server
+ * has acked something.
+ */
+long
+server_rto(int retries)
+{
+    struct serv_stat *s;
+    long max;
+
+    max = rexmit_times[retries] * 1000L;
+    s = find_serv_stat(cur_serv);
+    if (!s)
+	return max;
+    return Z_Rto(s->ack_srtt, s->ack_rttvar, REXMIT_MIN, max, retries);
+}
+
+/* Take the reply to a probe; returns 1 if that is what the notice was. */
+static int
+probe_reply(ZNotice_t *notice)
+{
+    struct serv_stat *s;
+    struct timeval now;
+    long rtt;
+
+    if ((notice->z_kind != SERVACK && notice->z_kind != SERVNAK) ||
+	strcmp(notice->z_opcode, HM_PING))
+	return 0;
+    /* A server may answer from another of its addresses, so go by the
+       UID.  A reply that comes after we have counted the probe lost is
+       still ours, but tells us nothing. */
+    for (s = serv_stats; s < serv_stats + nserv_stats; s++) {
+	if (ZCompareUID(&s->uid, &notice->z_uid))
+	    break;
+    }
+    if (s == serv_stats + nserv_stats)
+	return 0;
+    if (!s->outstanding)
+	return 1;
+
+    (void) gettimeofday(&now, (struct timezone *)0);
+    rtt = (now.tv_sec - s->sent.tv_sec) * 1000000L +
+	(now.tv_usec - s->sent.tv_usec);
+    if (rtt < 0)
+	rtt = 0;
+    if (s->replies++ == 0)
+	s->srtt = rtt;
+    else
+	s->srtt += (rtt - s->srtt) / 8;
+    s->loss -= s->loss / 8;
+    s->outstanding = 0;
+    s->backoff = 0;
+    if (hmdebug)
+	syslog(LOG_DEBUG, "Probe reply from %s: %ld usec (smoothed %ld)",
+	       s->name, rtt, s->srtt);
+    return 1;
+}
@@ -0,0 +1,216 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It contains the hostmanager's detailed statistics.
+ *
+ *      $Id$
+ *
+ *      Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *      For copying and distribution information, see the file
+ *      "mit-copyright.h".
+ */
+
+#include "zhm.h"
+
+#ifndef lint
+#ifndef SABER
+static const char rcsid_hm_stats_c[] = "$Id$";
+#endif /* SABER */
+#endif /* lint */
+
+/*
+ * For each local port that sends us notices we count its packets and
+ * bytes and time three things: how long its notices wait for our
+ * HMACK, how long the server takes to ack them after we last sent
+ * them, and how long they sit in our queue in all.  The same times go
+ * into histograms for the whole host.  A STAT request with the
+ * HM_GIMMEDETAIL opcode gets all of this back as "name=value" lines,
+ * which zstat -d prints as they are.  The reply is sent in fragments
+ * if it needs more than one packet.  The table holds STATS_MAXPORTS
+ * ports; a new port takes the place of the one heard from longest ago.
+ */
+#define STATS_MAXPORTS	64
+#define STATS_BUCKETS	7	/* histogram buckets, see bucket_usec */
+
+struct timing {
+    unsigned long count;
+    double total;		/* usec */
+    long max;			/* usec */
+};
+
+struct port_stat {
+    u_short port;
+    time_t last;		/* when we last heard from it */
+    unsigned long pkts;
+    unsigned long bytes;
+    struct timing hmack;
+    struct timing srvack;
+    struct timing queued;
+};
+
+/* Upper bounds of all but the last bucket. */
+static long bucket_usec[STATS_BUCKETS - 1] = {
+    100, 1000, 10000, 100000, 1000000, 10000000
+};
+
+static struct port_stat port_stats[STATS_MAXPORTS];
+static int nport_stats;
+static unsigned long hmack_hist[STATS_BUCKETS];
+static unsigned long srvack_hist[STATS_BUCKETS];
+static unsigned long queued_hist[STATS_BUCKETS];
+
+static struct port_stat *find_port_stat __P((u_short, int));
+static void add_timing __P((struct timing *, unsigned long *, long));
+static char *format_hist __P((char *, unsigned long *));
+static char *format_timing __P((char *, char *, struct timing *));
+
+static struct port_stat *
+find_port_stat(u_short port,
+	       int create)
+{
+    struct port_stat *p, *oldest = NULL;
+
+    for (p = port_stats; p < port_stats + nport_stats; p++) {
+	if (p->port == port)
+	    return p;
+	if (!oldest || p->last < oldest->last)
+	    oldest = p;
+    }
+    if (!create)
+	return NULL;
+    if (nport_stats < STATS_MAXPORTS)
+	p = &port_stats[nport_stats++];
+    else
+	p = oldest;
+    memset(p, 0, sizeof(struct port_stat));
+    p->port = port;
+    return p;
+}
+
+static void
+add_timing(struct timing *t,
+	   unsigned long *hist,
+	   long usec)
+{
+    int i;
+
+    if (usec < 0)
+	usec = 0;
+    t->count++;
+    t->total += usec;
+    if (usec > t->max)
+	t->max = usec;
+    for (i = 0; i < STATS_BUCKETS - 1 && usec >= bucket_usec[i]; i++)
+	;
+    hist[i]++;
+}
+
+/* A notice from a client on this host. */
+void
+stats_client_packet(u_short port,
+		    int len)
+{
+    struct port_stat *p;
+
+    p = find_port_stat(port, 1);
+    p->last = time(NULL);
+    p->pkts++;
+    p->bytes += len;
+}
+
+/* We have sent the HMACK for a client's notice, usec after it came. */
+void
+stats_hmack(u_short port,
+	    long usec)
+{
+    struct port_stat *p;
+
+    p = find_port_stat(port, 0);
+    if (!p)
+	return;
+    add_timing(&p->hmack, hmack_hist, usec);
+}
+
+/* The server has acked a client's notice, ack_usec after we last sent
+ * it and queued_usec after it came. */
+void
+stats_server_ack(u_short port,
+		 long ack_usec,
+		 long queued_usec)
+{
+    struct port_stat *p;
+
+    p = find_port_stat(port, 0);
+    if (!p)
+	return;
+    add_timing(&p->srvack, srvack_hist, ack_usec);
+    add_timing(&p->queued, queued_hist, queued_usec);
+}
+
+static char *
+format_hist(char *cp,
+	    unsigned long *hist)
+{
+    int i;
+
+    for (i = 0; i < STATS_BUCKETS; i++)
+	cp += sprintf(cp, "%s%lu", i ? "," : "", hist[i]);
+    return cp;
+}
+
+static char *
+format_timing(char *cp,
+	      char *name,
+	      struct timing *t)
+{
+    return cp + sprintf(cp, " %s=%lu %s_avg_us=%ld %s_max_us=%ld",
+			name, t->count, name,
+			t->count ? (long) (t->total / t->count) : 0L,
+			name, t->max);
+}
+
+/*
+ * Fill in list with the lines of a detailed stats reply, each from
+ * malloc(); returns how many there are, at most max.
+ */
+int
+stats_detail(char **list,
+	     int max)
+{
+    struct port_stat *p;
+    char buf[512], *cp;
+    time_t now = time(NULL);
+    int i, n = 0;
+
+    if (max < 4)
+	return 0;
+
+    cp = buf + sprintf(buf, "buckets_us=");
+    for (i = 0; i < STATS_BUCKETS - 1; i++)
+	cp += sprintf(cp, "%s%ld", i ? "," : "", bucket_usec[i]);
+    list[n++] = strdup(buf);
+
+    (void) format_hist(buf + sprintf(buf, "hmack_hist="), hmack_hist);
+    list[n++] = strdup(buf);
+    (void) format_hist(buf + sprintf(buf, "srvack_hist="), srvack_hist);
+    list[n++] = strdup(buf);
+    (void) format_hist(buf + sprintf(buf, "queue_hist="), queued_hist);
+    list[n++] = strdup(buf);
+
+    for (p = port_stats; p < port_stats + nport_stats && n < max; p++) {
+	cp = buf + sprintf(buf, "port=%u pkts=%lu bytes=%lu idle_s=%ld",
+			   ntohs(p->port), p->pkts, p->bytes,
+			   (long) (now - p->last));
+	cp = format_timing(cp, "hmack", &p->hmack);
+	cp = format_timing(cp, "srvack", &p->srvack);
+	cp = format_timing(cp, "queue", &p->queued);
+	list[n++] = strdup(buf);
+    }
+
+    for (i = 0; i < n; i++) {
+	if (!list[i]) {
+	    while (n--)
+		free(list[n]);
+	    return 0;
+	}
+    }
+    return n;
+}
@@ -0,0 +1,1348 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It is one of the source files comprising zwgc, the Zephyr WindowGram
+ * client.
+ *
+ *      $Id$
+ *
+ *      Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *      For copying and distribution information, see the file
+ *      "mit-copyright.h".
+ */
+
+#include <sysdep.h>
+
+#if (!defined(lint) && !defined(SABER))
+static const char rcsid_bytecode_c[] = "$Id$";
+#endif
+
+#include <zephyr/mit-copyright.h>
+
+/****************************************************************************/
+/*                                                                          */
+/*        Module containing code to compile a program to bytecode and       */
+/*                              to run it:                                  */
+/*                                                                          */
+/****************************************************************************/
+
+#include <zephyr/zephyr.h>
+#include "new_memory.h"
+#include "node.h"
+#include "bytecode.h"
+#include "exec.h"
+#include "substitute.h"
+#include "port.h"
+#include "buffer.h"
+#include "regexp.h"
+#include "formatter.h"
+#include "text_operations.h"
+#include "variables.h"
+#include "string_dictionary_aux.h"
+#include "int_dictionary.h"
+
+/*
+ * The program is turned into a list of instructions for a stack
+ * machine whose values are strings.  Each value on the stack is either
+ * owned, in which case it is on the heap & is freed when popped, or
+ * borrowed from a constant or a variable, in which case it must not be
+ * changed or freed.  Borrowing a variable's value is only safe while
+ * nothing can set that variable, so statements that may set variables
+ * before they are done with their values (text operations, get, and
+ * anything that uses a port) copy every variable they use instead.
+ *
+ * Non-number variables are looked up once, when compiling, and refered
+ * to thereafter by the address of their value.  Constants are kept
+ * once each in a dictionary of the code's own.  The constant strings
+ * given to substitute are broken up while compiling into the text and
+ * variables they are made of.  Sums are done all at once rather than
+ * two strings at a time.  Constant regular expressions are compiled
+ * along with the program.  A case statement whose arms match only
+ * constants finds the arm to run by looking the value up in a table.
+ *
+ * Every statement starts and ends with the stack empty, so break and
+ * exit are just jumps.
+ */
+
+#define  OP_CONST        0     /* push s */
+#define  OP_VAR          1     /* push *var */
+#define  OP_VARCOPY      2     /* push copy of *var */
+#define  OP_NUMVAR       3     /* push copy of number variable s */
+#define  OP_BUFFER       4
+#define  OP_CONCAT       5     /* pop n, push them concatenated */
+
+#define  OP_NOT          6
+#define  OP_SUBSTITUTE   7
+#define  OP_PROTECT      8
+#define  OP_VERBATIM     9
+#define  OP_STYLESTRIP   10
+#define  OP_GETENV       11
+#define  OP_UPCASE       12
+#define  OP_DOWNCASE     13
+#define  OP_ZVAR         14
+#define  OP_GET          15
+
+#define  OP_AND          16
+#define  OP_OR           17
+#define  OP_EQ           18
+#define  OP_NEQ          19
+#define  OP_REGEQ        20
+#define  OP_REGNEQ       21
+
+#define  OP_LANY         22    /* these store what is left of their */
+#define  OP_RANY         23    /* first operand in *var or in number */
+#define  OP_LBREAK       24    /* variable s if either is set */
+#define  OP_RBREAK       25
+#define  OP_LSPAN        26
+#define  OP_RSPAN        27
+
+#define  OP_SET          28    /* pop into *var or number variable s */
+#define  OP_FIELD        29    /* next field into *var or variable s */
+#define  OP_FIELDS_DONE  30
+
+#define  OP_PRINT        31    /* pop n */
+#define  OP_CLEARBUF     32
+#define  OP_APPENDPORT   33
+#define  OP_EXECPORT     34    /* pop name & n arguments */
+#define  OP_INPUTPORT    35
+#define  OP_OUTPUTPORT   36
+#define  OP_PUT          37    /* pop n (buffer if n<0) & name if !var */
+#define  OP_CLOSEINPUT   38
+#define  OP_CLOSEOUTPUT  39
+#define  OP_CLOSEPORT    40
+#define  OP_EXEC         41    /* pop n */
+
+#define  OP_JUMP         42    /* to n */
+#define  OP_JUMPF        43    /* pop, to n if false */
+#define  OP_CASEEQ       44    /* pop, if equal to top pop it & to n */
+#define  OP_POP          45
+#define  OP_HALT         46
+
+#define  OP_REGMATCH     47    /* =~ re, or !~ if n */
+#define  OP_CASETABLE    48    /* pop, to its arm in table or to n */
+
+typedef struct _Instr {
+    int opcode;
+    int n;                      /* count or jump target */
+    string s;                   /* constant or variable name */
+    string *var;                /* variable's value */
+    ed_regexp *re;
+    int_dictionary table;       /* case arms by the values they match */
+} Instr;
+
+typedef struct _Value {
+    string s;
+    int owned;
+} Value;
+
+struct _Bytecode {
+    Instr *code;
+    int length;
+    int size;
+    Value *stack;
+    string_dictionary constants;
+};
+
+/*
+ * State kept while compiling:
+ */
+
+static Bytecode *output;        /* what we are compiling into */
+static int depth;               /* of the stack at this point */
+static int max_depth;
+static int in_loop;
+static int breaks;              /* jumps to patch at end of the loop */
+
+#define  string_to_bool(str)      (!strcasecmp(str,"true"))
+#define  bool_to_string(bool)     ((bool) ? "TRUE" : "FALSE")
+
+static void compile_expr(Node *, int);
+static void compile_statements(Node *);
+
+/****************************************************************************/
+/*                                                                          */
+/*                         Compiling expressions:                           */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ *  Internal Routine:
+ *
+ *    Instr *emit(int opcode; int stack_change)
+ *        Modifies: output, depth, max_depth
+ *        Effects: Adds an instruction with opcode opcode & no operands
+ *                 to the end of output, noting that it changes the
+ *                 depth of the stack by stack_change.  Returns it; the
+ *                 pointer is good until the next emit call.
+ */
+
+static Instr *
+emit(int opcode,
+     int stack_change)
+{
+    Instr *i;
+
+    if (output->length == output->size) {
+	output->size *= 2;
+	output->code = (Instr *)realloc(output->code,
+					output->size*sizeof(Instr));
+    }
+
+    i = &output->code[output->length];
+    i->opcode = opcode;
+    i->n = 0;
+    i->s = NULL;
+    i->var = NULL;
+    i->re = NULL;
+    i->table = NULL;
+
+    depth += stack_change;
+    if (depth > max_depth)
+      max_depth = depth;
+
+    output->length++;
+    return(i);
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    string intern(string s)
+ *        Effects: Returns a string equal to s that lasts as long as
+ *                 output does, the same one every time for the same s.
+ */
+
+static string
+intern(string s)
+{
+    string_dictionary_binding *binding;
+    int exists;
+
+    binding = string_dictionary_Define(output->constants, s, &exists);
+    if (!exists)
+      binding->value = NULL;
+
+    return(binding->key);
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    void emit_variable(int opcode; string name; int stack_change)
+ *        Effects: Emits an instruction with opcode opcode whose
+ *                 variable operand is the variable named name.
+ */
+
+static void
+emit_variable(int opcode,
+	      string name,
+	      int stack_change)
+{
+    Instr *i = emit(opcode, stack_change);
+
+    if (!(i->var = var_get_variable_slot(name)))
+      i->s = intern(name);
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    void emit_reference(string name; int copy)
+ *        Effects: Emits an instruction to push the value of the
+ *                 variable named name, copying it if copy is true.
+ */
+
+static void
+emit_reference(string name,
+	       int copy)
+{
+    string *var = var_get_variable_slot(name);
+    Instr *i;
+
+    if (!var) {
+	i = emit(OP_NUMVAR, 1);
+	i->s = intern(name);
+    } else {
+	i = emit(copy ? OP_VARCOPY : OP_VAR, 1);
+	i->var = var;
+    }
+}
+
+static void
+emit_constant(string s)
+{
+    emit(OP_CONST, 1)->s = intern(s);
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    int has_side_effects(Node *expr)
+ *        Effects: Returns true iff evaluating the list of expressions
+ *                 expr might set a variable.
+ */
+
+static int
+has_side_effects(Node *expr)
+{
+    for (; expr; expr=expr->next) {
+	switch (expr->opcode) {
+	  case STRING_CONSTANT_OPCODE:
+	  case VARREF_OPCODE:
+	  case BUFFER_OPCODE:
+	    break;
+
+	  case GET_OPCODE:
+	  case LANY_OPCODE:    case RANY_OPCODE:
+	  case LBREAK_OPCODE:  case RBREAK_OPCODE:
+	  case LSPAN_OPCODE:   case RSPAN_OPCODE:
+	    return(1);
+
+	  case PLUS_OPCODE:
+	  case AND_OPCODE:
+	  case OR_OPCODE:
+	  case EQ_OPCODE:
+	  case NEQ_OPCODE:
+	  case REGEQ_OPCODE:
+	  case REGNEQ_OPCODE:
+	    if (has_side_effects(expr->d.nodes.second))
+	      return(1);
+	    /* fall through */
+
+	  default:
+	    if (has_side_effects(expr->d.nodes.first))
+	      return(1);
+	}
+    }
+
+    return(0);
+}
+
+/*
+ * Compiling the constant argument of substitute: the text between
+ * variable references is gathered up in pending.
+ */
+
+static string pending;
+static int pieces;
+static int pieces_copy;
+
+static void
+flush_pending(void)
+{
+    if (*pending) {
+	emit_constant(pending);
+	pieces++;
+	free(pending);
+	pending = string_Copy("");
+    }
+}
+
+/*ARGSUSED*/
+static void
+substitute_literal(char *text,
+		   int length,
+		   void *arg)
+{
+    string temp = string_CreateFromData(text, length);
+
+    pending = string_Concat2(pending, temp);
+    free(temp);
+}
+
+/*ARGSUSED*/
+static void
+substitute_variable(string name,
+		    void *arg)
+{
+    flush_pending();
+    emit_reference(name, pieces_copy);
+    pieces++;
+    free(name);
+}
+
+static void
+compile_substitute(string text,
+		   int copy)
+{
+    pending = string_Copy("");
+    pieces = 0;
+    pieces_copy = copy;
+
+    substitute_parse(text, substitute_literal, substitute_variable, NULL);
+    flush_pending();
+    free(pending);
+
+    if (!pieces)
+      emit_constant("");
+    else if (pieces > 1)
+      emit(OP_CONCAT, 1-pieces)->n = pieces;
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    int compile_sum(Node *expr; int copy)
+ *        Effects: Compiles code to push the values of the operands of
+ *                 the sum expr, in order, & returns how many there are.
+ */
+
+static int
+compile_sum(Node *expr,
+	    int copy)
+{
+    if (expr->opcode != PLUS_OPCODE) {
+	compile_expr(expr, copy);
+	return(1);
+    }
+
+    return(compile_sum(expr->d.nodes.first, copy) +
+	   compile_sum(expr->d.nodes.second, copy));
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    void compile_expr(Node *expr; int copy)
+ *        Requires: expr is a proper expression (NOT NULL).
+ *        Effects: Compiles code to push the value of expr.  If copy is
+ *                 true, the values of variables are copied rather than
+ *                 borrowed.
+ */
+
+static void
+compile_expr(Node *expr,
+	     int copy)
+{
+    int opcode = expr->opcode;
+    int n;
+    ed_regexp *re;
+    Instr *i;
+
+    switch (opcode) {
+      case STRING_CONSTANT_OPCODE:
+	emit_constant(expr->d.string_constant);
+	return;
+
+      case VARREF_OPCODE:
+	emit_reference(expr->d.string_constant, copy);
+	return;
+
+      case BUFFER_OPCODE:
+	(void) emit(OP_BUFFER, 1);
+	return;
+
+      case PLUS_OPCODE:
+	n = compile_sum(expr, copy);
+	emit(OP_CONCAT, 1-n)->n = n;
+	return;
+
+      case SUBSTITUTE_OPCODE:
+	if (expr->d.nodes.first->opcode == STRING_CONSTANT_OPCODE) {
+	    compile_substitute(expr->d.nodes.first->d.string_constant, copy);
+	    return;
+	}
+	/* fall through */
+
+      case NOT_OPCODE:
+      case PROTECT_OPCODE:
+      case VERBATIM_OPCODE:
+      case STYLESTRIP_OPCODE:
+      case GETENV_OPCODE:
+      case UPCASE_OPCODE:
+      case DOWNCASE_OPCODE:
+      case ZVAR_OPCODE:
+      case GET_OPCODE:
+	compile_expr(expr->d.nodes.first, copy);
+	switch (opcode) {
+	  case NOT_OPCODE:        (void) emit(OP_NOT, 0); break;
+	  case SUBSTITUTE_OPCODE: (void) emit(OP_SUBSTITUTE, 0); break;
+	  case PROTECT_OPCODE:    (void) emit(OP_PROTECT, 0); break;
+	  case VERBATIM_OPCODE:   (void) emit(OP_VERBATIM, 0); break;
+	  case STYLESTRIP_OPCODE: (void) emit(OP_STYLESTRIP, 0); break;
+	  case GETENV_OPCODE:     (void) emit(OP_GETENV, 0); break;
+	  case UPCASE_OPCODE:     (void) emit(OP_UPCASE, 0); break;
+	  case DOWNCASE_OPCODE:   (void) emit(OP_DOWNCASE, 0); break;
+	  case ZVAR_OPCODE:       (void) emit(OP_ZVAR, 0); break;
+	  case GET_OPCODE:        (void) emit(OP_GET, 0); break;
+	}
+	return;
+
+      case REGEQ_OPCODE:
+      case REGNEQ_OPCODE:
+	if (expr->d.nodes.second->opcode == STRING_CONSTANT_OPCODE &&
+	    (re = ed_regexp_compile(expr->d.nodes.second->d.string_constant))) {
+	    compile_expr(expr->d.nodes.first, copy);
+	    i = emit(OP_REGMATCH, 0);
+	    i->re = re;
+	    i->n = (opcode == REGNEQ_OPCODE);
+	    return;
+	}
+	/* invalid ones are left to complain each time, as before */
+	/* fall through */
+
+      case AND_OPCODE:
+      case OR_OPCODE:
+      case EQ_OPCODE:
+      case NEQ_OPCODE:
+	compile_expr(expr->d.nodes.first, copy);
+	compile_expr(expr->d.nodes.second, copy);
+	switch (opcode) {
+	  case AND_OPCODE:    (void) emit(OP_AND, -1); break;
+	  case OR_OPCODE:     (void) emit(OP_OR, -1); break;
+	  case EQ_OPCODE:     (void) emit(OP_EQ, -1); break;
+	  case NEQ_OPCODE:    (void) emit(OP_NEQ, -1); break;
+	  case REGEQ_OPCODE:  (void) emit(OP_REGEQ, -1); break;
+	  case REGNEQ_OPCODE: (void) emit(OP_REGNEQ, -1); break;
+	}
+	return;
+
+      case LANY_OPCODE:    case RANY_OPCODE:
+      case LBREAK_OPCODE:  case RBREAK_OPCODE:
+      case LSPAN_OPCODE:   case RSPAN_OPCODE:
+	compile_expr(expr->d.nodes.first, copy);
+	compile_expr(expr->d.nodes.second, copy);
+	if (expr->d.nodes.first->opcode == VARREF_OPCODE)
+	  emit_variable(OP_LANY + opcode - LANY_OPCODE,
+			expr->d.nodes.first->d.string_constant, -1);
+	else
+	  (void) emit(OP_LANY + opcode - LANY_OPCODE, -1);
+	return;
+    }
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    int compile_exprlist(Node *exprlist; int copy)
+ *        Effects: Compiles code to push the values of the expressions
+ *                 on the list exprlist, in order, & returns how many
+ *                 there are.
+ */
+
+static int
+compile_exprlist(Node *exprlist,
+		 int copy)
+{
+    int n = 0;
+
+    for (; exprlist; exprlist=exprlist->next, n++)
+      compile_expr(exprlist, copy);
+
+    return(n);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                          Compiling statements:                           */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ * Jumps whose targets are not known yet are kept on chains linked
+ * through their targets, ending with -1.
+ */
+
+static int
+emit_jump(int opcode,
+	  int chain)
+{
+    Instr *i = emit(opcode, opcode == OP_JUMP ? 0 : -1);
+
+    i->n = chain;
+    return(i - output->code);
+}
+
+static void
+patch_jumps(int chain,
+	    int target)
+{
+    int next;
+
+    for (; chain != -1; chain = next) {
+	next = output->code[chain].n;
+	output->code[chain].n = target;
+    }
+}
+
+static void
+compile_if(Node *node)
+{
+    Node *conds;
+    int next, end = -1;
+
+    for (conds=node->d.nodes.first; conds; conds=conds->next) {
+	next = -1;
+	if (conds->d.nodes.first) {
+	    compile_expr(conds->d.nodes.first,
+			 has_side_effects(conds->d.nodes.first));
+	    next = emit_jump(OP_JUMPF, -1);
+	}
+	compile_statements(conds->d.nodes.second);
+	end = emit_jump(OP_JUMP, end);
+	patch_jumps(next, output->length);
+    }
+
+    patch_jumps(end, output->length);
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    int constant_arms(Node *matchlist)
+ *        Effects: Returns the number of values the arms of a case
+ *                 statement with matchlist matchlist match, or 0 if
+ *                 any of them that can be reached are not constants.
+ */
+
+static int
+constant_arms(Node *matchlist)
+{
+    Node *cond;
+    int n = 0;
+
+    for (; matchlist && matchlist->d.nodes.first; matchlist=matchlist->next) {
+	for (cond=matchlist->d.nodes.first; cond; cond=cond->next, n++)
+	  if (cond->opcode != STRING_CONSTANT_OPCODE)
+	    return(0);
+    }
+
+    return(n);
+}
+
+/*
+ * When every arm matches constants, the arm to run is looked up in a
+ * table; values matched by an earlier arm are left out of later ones.
+ */
+
+static void
+compile_case_table(Node *node,
+		   int n)
+{
+    Node *match, *cond;
+    int lookup, end = -1;
+    int_dictionary table;
+    int_dictionary_binding *binding;
+    string value;
+    int exists;
+
+    compile_expr(node->d.nodes.first, has_side_effects(node->d.nodes.first));
+    (void) emit(OP_DOWNCASE, 0);
+    lookup = output->length;
+    table = emit(OP_CASETABLE, -1)->table = int_dictionary_Create(2*n+1);
+
+    for (match=node->d.nodes.second; match; match=match->next) {
+	if (!match->d.nodes.first)  /* default case */
+	  break;
+	for (cond=match->d.nodes.first; cond; cond=cond->next) {
+	    value = string_Downcase(string_Copy(cond->d.string_constant));
+	    binding = int_dictionary_Define(table, value, &exists);
+	    if (!exists)
+	      binding->value = output->length;
+	    free(value);
+	}
+	compile_statements(match->d.nodes.second);
+	end = emit_jump(OP_JUMP, end);
+    }
+
+    output->code[lookup].n = output->length;
+    if (match)
+      compile_statements(match->d.nodes.second);
+    patch_jumps(end, output->length);
+}
+
+/*
+ * The value being matched stays on the stack until an arm is chosen.
+ */
+
+static void
+compile_case(Node *node)
+{
+    Node *match, *cond;
+    int body, next, end = -1;
+    int n;
+
+    if ((n = constant_arms(node->d.nodes.second))) {
+	compile_case_table(node, n);
+	return;
+    }
+
+    compile_expr(node->d.nodes.first, has_side_effects(node->d.nodes.first));
+    (void) emit(OP_DOWNCASE, 0);
+
+    for (match=node->d.nodes.second; match; match=match->next) {
+	if (!match->d.nodes.first) {  /* default case */
+	    (void) emit(OP_POP, -1);
+	    compile_statements(match->d.nodes.second);
+	    patch_jumps(end, output->length);
+	    return;
+	}
+
+	body = -1;
+	for (cond=match->d.nodes.first; cond; cond=cond->next) {
+	    compile_expr(cond, has_side_effects(cond));
+	    body = emit_jump(OP_CASEEQ, body);
+	}
+	next = emit_jump(OP_JUMP, -1);
+
+	patch_jumps(body, output->length);
+	depth--;
+	compile_statements(match->d.nodes.second);
+	end = emit_jump(OP_JUMP, end);
+	depth++;
+	patch_jumps(next, output->length);
+    }
+
+    (void) emit(OP_POP, -1);
+    patch_jumps(end, output->length);
+}
+
+static void
+compile_while(Node *node)
+{
+    int top = output->length;
+    int end;
+    int outer_in_loop = in_loop;
+    int outer_breaks = breaks;
+
+    compile_expr(node->d.nodes.first, has_side_effects(node->d.nodes.first));
+    end = emit_jump(OP_JUMPF, -1);
+
+    in_loop = 1;
+    breaks = -1;
+    compile_statements(node->d.nodes.second);
+    emit(OP_JUMP, 0)->n = top;
+
+    patch_jumps(end, output->length);
+    patch_jumps(breaks, output->length);
+    in_loop = outer_in_loop;
+    breaks = outer_breaks;
+}
+
+static void
+compile_statement(Node *node)
+{
+    Node *args;
+    int copy, n;
+    Instr *i;
+
+    switch (node->opcode) {
+      case NOOP_OPCODE:
+	return;
+
+      case SET_OPCODE:
+	compile_expr(node->d.nodes.second,
+		     has_side_effects(node->d.nodes.second));
+	emit_variable(OP_SET, node->d.nodes.first->d.string_constant, -1);
+	return;
+
+      case FIELDS_OPCODE:
+	for (args=node->d.nodes.first; args; args=args->next)
+	  emit_variable(OP_FIELD, args->d.string_constant, 0);
+	(void) emit(OP_FIELDS_DONE, 0);
+	return;
+
+      case PRINT_OPCODE:
+	n = compile_exprlist(node->d.nodes.first,
+			     has_side_effects(node->d.nodes.first));
+	emit(OP_PRINT, -n)->n = n;
+	return;
+
+      case CLEARBUF_OPCODE:
+	(void) emit(OP_CLEARBUF, 0);
+	return;
+
+      case APPENDPORT_OPCODE:
+      case INPUTPORT_OPCODE:
+      case OUTPUTPORT_OPCODE:
+	compile_expr(node->d.nodes.first, 1);
+	compile_expr(node->d.nodes.second, 1);
+	(void) emit(node->opcode == APPENDPORT_OPCODE ? OP_APPENDPORT :
+		    node->opcode == INPUTPORT_OPCODE ? OP_INPUTPORT :
+		    OP_OUTPUTPORT, -2);
+	return;
+
+      case EXECPORT_OPCODE:
+	compile_expr(node->d.nodes.first, 1);
+	n = compile_exprlist(node->d.nodes.second, 1);
+	emit(OP_EXECPORT, -n-1)->n = n;
+	return;
+
+      case PUT_OPCODE:
+	/*
+	 * Values a port is given must survive it setting $error:
+	 */
+	n = node->d.nodes.second ? compile_exprlist(node->d.nodes.second, 1)
+	  : -1;
+	if (node->d.nodes.first) {
+	    compile_expr(node->d.nodes.first, 1);
+	    i = emit(OP_PUT, n < 0 ? -1 : -n-1);
+	} else {
+	    i = emit(OP_PUT, n < 0 ? 0 : -n);
+	    i->var = var_get_variable_slot("output_driver");
+	}
+	i->n = n;
+	return;
+
+      case CLOSEINPUT_OPCODE:
+      case CLOSEOUTPUT_OPCODE:
+      case CLOSEPORT_OPCODE:
+	compile_expr(node->d.nodes.first, 1);
+	(void) emit(node->opcode == CLOSEINPUT_OPCODE ? OP_CLOSEINPUT :
+		    node->opcode == CLOSEOUTPUT_OPCODE ? OP_CLOSEOUTPUT :
+		    OP_CLOSEPORT, -1);
+	return;
+
+      case EXEC_OPCODE:
+	copy = has_side_effects(node->d.nodes.first);
+	n = compile_exprlist(node->d.nodes.first, copy);
+	emit(OP_EXEC, -n)->n = n;
+	return;
+
+      case IF_STMT_OPCODE:
+	compile_if(node);
+	return;
+
+      case CASE_OPCODE:
+	compile_case(node);
+	return;
+
+      case WHILE_OPCODE:
+	compile_while(node);
+	return;
+
+      case BREAK_OPCODE:
+	/*
+	 * A break outside of any loop ends the program:
+	 */
+	if (in_loop)
+	  breaks = emit_jump(OP_JUMP, breaks);
+	else
+	  (void) emit(OP_HALT, 0);
+	return;
+
+      case EXIT_OPCODE:
+	(void) emit(OP_HALT, 0);
+	return;
+    }
+}
+
+static void
+compile_statements(Node *node)
+{
+    for (; node; node=node->next)
+      compile_statement(node);
+}
+
+Bytecode *
+bytecode_compile(Node *program)
+{
+    Bytecode *code;
+
+    code = (Bytecode *)malloc(sizeof(Bytecode));
+    code->size = 64;
+    code->length = 0;
+    code->code = (Instr *)malloc(code->size*sizeof(Instr));
+    code->constants = string_dictionary_Create(101);
+
+    output = code;
+    depth = max_depth = 0;
+    in_loop = 0;
+    breaks = -1;
+
+    compile_statements(program);
+    (void) emit(OP_HALT, 0);
+
+    code->stack = (Value *)malloc((max_depth+1)*sizeof(Value));
+    output = NULL;
+
+    return(code);
+}
+
+void
+bytecode_free(Bytecode *code)
+{
+    int i;
+
+    for (i=0; i<code->length; i++) {
+	if (code->code[i].re)
+	  ed_regexp_free(code->code[i].re);
+	if (code->code[i].table)
+	  int_dictionary_Destroy(code->code[i].table);
+    }
+
+    string_dictionary_Destroy(code->constants);
+    free(code->code);
+    free(code->stack);
+    free(code);
+}
+
+/****************************************************************************/
+/*                                                                          */
+/*                           Running the code:                              */
+/*                                                                          */
+/****************************************************************************/
+
+/*
+ *  Internal Routine:
+ *
+ *    string own(Value *v)
+ *        Modifies: *v
+ *        Effects: Makes v own its string, copying it if need be, and
+ *                 returns the string.
+ */
+
+static string
+own(Value *v)
+{
+    if (!v->owned) {
+	v->s = string_Copy(v->s);
+	v->owned = 1;
+    }
+
+    return(v->s);
+}
+
+#define  drop(v)        { if ((v)->owned) free((v)->s); }
+
+/*
+ *  Internal Routine:
+ *
+ *    string join(Value *v; int n; string separator)
+ *        Effects: Pops the n values starting at v & returns them
+ *                 joined with separator between them.  The returned
+ *                 string is on the heap and must be freed eventually.
+ */
+
+static string
+join(Value *v,
+     int n,
+     string separator)
+{
+    int i, length = 0, sep_length = strlen(separator);
+    string result;
+    char *p;
+
+    for (i=0; i<n; i++)
+      length += strlen(v[i].s);
+    if (n > 1)
+      length += sep_length * (n-1);
+
+    p = result = (string)malloc(length+1);
+    for (i=0; i<n; i++) {
+	if (i) {
+	    memcpy(p, separator, sep_length);
+	    p += sep_length;
+	}
+	length = strlen(v[i].s);
+	memcpy(p, v[i].s, length);
+	p += length;
+	drop(&v[i]);
+    }
+    *p = '\0';
+
+    return(result);
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    char **args(Value *v; int n)
+ *        Effects: Pops the n values starting at v & returns them as a
+ *                 NULL-terminated argument vector, to be freed with
+ *                 free_args.
+ */
+
+static char **
+args(Value *v,
+     int n)
+{
+    char **argv = (char **)malloc((n+1)*sizeof(char *));
+    int i;
+
+    for (i=0; i<n; i++)
+      argv[i] = own(&v[i]);
+    argv[n] = NULL;
+
+    return(argv);
+}
+
+static void
+free_args(char **argv)
+{
+    char **p;
+
+    for (p=argv; *p; p++)
+      free(*p);
+
+    free(argv);
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    void store(Instr *i; string value)
+ *        Requires: value is on the heap
+ *        Effects: Sets the variable i refers to, if any, to value.
+ *                 Value is freed if it is not kept.
+ */
+
+static void
+store(Instr *i,
+      string value)
+{
+    if (i->var) {
+	free(*i->var);
+	*i->var = value;
+    } else if (i->s)
+      var_set_variable_then_free_value(i->s, value);
+    else
+      free(value);
+}
+
+void
+bytecode_run(Bytecode *code)
+{
+    Instr *pc = code->code, *i;
+    Value *sp = code->stack;
+    string result, text;
+    int bool_result = 0;
+
+    for (;;) {
+	i = pc++;
+
+	switch (i->opcode) {
+	  case OP_CONST:
+	    sp->s = i->s;
+	    sp->owned = 0;
+	    sp++;
+	    break;
+
+	  case OP_VAR:
+	    sp->s = *i->var;
+	    sp->owned = 0;
+	    sp++;
+	    break;
+
+	  case OP_VARCOPY:
+	    sp->s = string_Copy(*i->var);
+	    sp->owned = 1;
+	    sp++;
+	    break;
+
+	  case OP_NUMVAR:
+	    sp->s = string_Copy(var_get_variable(i->s));
+	    sp->owned = 1;
+	    sp++;
+	    break;
+
+	  case OP_BUFFER:
+	    sp->s = string_Copy(buffer_to_string());
+	    sp->owned = 1;
+	    sp++;
+	    break;
+
+	  case OP_CONCAT:
+	    sp -= i->n;
+	    sp->s = join(sp, i->n, "");
+	    sp->owned = 1;
+	    sp++;
+	    break;
+
+	    /*
+	     * Unary operators work on the top of the stack:
+	     */
+	  case OP_NOT:
+	    result = bool_to_string(!string_to_bool(sp[-1].s));
+	    drop(&sp[-1]);
+	    sp[-1].s = result;
+	    sp[-1].owned = 0;
+	    break;
+
+	  case OP_SUBSTITUTE:
+	  case OP_PROTECT:
+	  case OP_GETENV:
+	  case OP_ZVAR:
+	  case OP_GET:
+	    switch (i->opcode) {
+	      case OP_SUBSTITUTE:
+		result = substitute(var_get_variable, sp[-1].s);
+		break;
+
+	      case OP_PROTECT:
+		result = protect(sp[-1].s);
+		break;
+
+	      case OP_GETENV:
+		result = getenv(sp[-1].s);
+		result = string_Copy(result ? result : "");
+		break;
+
+	      case OP_ZVAR:
+		result = ZGetVariable(sp[-1].s);
+		result = string_Copy(result ? result : "");
+		break;
+
+	      case OP_GET:
+		result = read_from_port(sp[-1].s);
+		break;
+
+	      default:
+		abort();
+	    }
+	    drop(&sp[-1]);
+	    sp[-1].s = result;
+	    sp[-1].owned = 1;
+	    break;
+
+	  case OP_REGMATCH:
+	    bool_result = ed_regexp_match_compiled_p(sp[-1].s, i->re);
+	    if (i->n)
+	      bool_result = !bool_result;
+	    drop(&sp[-1]);
+	    sp[-1].s = bool_to_string(bool_result);
+	    sp[-1].owned = 0;
+	    break;
+
+	  case OP_VERBATIM:
+	    sp[-1].s = verbatim(own(&sp[-1]), 0);
+	    break;
+
+	  case OP_STYLESTRIP:
+	    sp[-1].s = stylestrip(own(&sp[-1]));
+	    break;
+
+	  case OP_UPCASE:
+	    (void) string_Upcase(own(&sp[-1]));
+	    break;
+
+	  case OP_DOWNCASE:
+	    (void) string_Downcase(own(&sp[-1]));
+	    break;
+
+	    /*
+	     * Binary operators:
+	     */
+	  case OP_AND:
+	  case OP_OR:
+	  case OP_EQ:
+	  case OP_NEQ:
+	  case OP_REGEQ:
+	  case OP_REGNEQ:
+	    sp--;
+	    switch (i->opcode) {
+	      case OP_AND:
+		bool_result = string_to_bool(sp[-1].s) && string_to_bool(sp->s);
+		break;
+
+	      case OP_OR:
+		bool_result = string_to_bool(sp[-1].s) || string_to_bool(sp->s);
+		break;
+
+	      case OP_EQ:
+		bool_result = string_Eq(sp[-1].s, sp->s);
+		break;
+
+	      case OP_NEQ:
+		bool_result = string_Neq(sp[-1].s, sp->s);
+		break;
+
+	      case OP_REGEQ:
+		bool_result = ed_regexp_match_p(sp[-1].s, sp->s);
+		break;
+
+	      case OP_REGNEQ:
+		bool_result = !ed_regexp_match_p(sp[-1].s, sp->s);
+		break;
+
+	      default:
+		abort();
+	    }
+	    drop(sp);
+	    drop(&sp[-1]);
+	    sp[-1].s = bool_to_string(bool_result);
+	    sp[-1].owned = 0;
+	    break;
+
+	    /*
+	     * Text-manipulation operators:
+	     */
+	  case OP_LANY:   case OP_RANY:
+	  case OP_LBREAK: case OP_RBREAK:
+	  case OP_LSPAN:  case OP_RSPAN:
+	    sp--;
+	    text = own(&sp[-1]);
+	    switch (i->opcode) {
+	      case OP_LANY:
+		result = lany(&text, sp->s);
+		break;
+
+	      case OP_RANY:
+		result = rany(&text, sp->s);
+		break;
+
+	      case OP_LBREAK:
+		result = lbreak(&text, string_to_character_class(sp->s));
+		break;
+
+	      case OP_RBREAK:
+		result = rbreak(&text, string_to_character_class(sp->s));
+		break;
+
+	      case OP_LSPAN:
+		result = lspan(&text, string_to_character_class(sp->s));
+		break;
+
+	      case OP_RSPAN:
+		result = rspan(&text, string_to_character_class(sp->s));
+		break;
+
+	      default:
+		abort();
+	    }
+	    store(i, text);
+	    drop(sp);
+	    sp[-1].s = result;
+	    break;
+
+	    /*
+	     * Statements:
+	     */
+	  case OP_SET:
+	    sp--;
+	    store(i, own(sp));
+	    break;
+
+	  case OP_FIELD:
+	    store(i, exec_next_field());
+	    break;
+
+	  case OP_FIELDS_DONE:
+	    exec_fields_done();
+	    break;
+
+	  case OP_PRINT:
+	    sp -= i->n;
+	    text = join(sp, i->n, " ");
+	    append_buffer(text);
+	    free(text);
+	    break;
+
+	  case OP_CLEARBUF:
+	    clear_buffer();
+	    break;
+
+	  case OP_APPENDPORT:
+	  case OP_INPUTPORT:
+	  case OP_OUTPUTPORT:
+	    sp -= 2;
+	    if (i->opcode == OP_APPENDPORT)
+	      create_file_append_port(sp[0].s, sp[1].s);
+	    else if (i->opcode == OP_INPUTPORT)
+	      create_file_input_port(sp[0].s, sp[1].s);
+	    else
+	      create_file_output_port(sp[0].s, sp[1].s);
+	    drop(&sp[0]);
+	    drop(&sp[1]);
+	    break;
+
+	  case OP_EXECPORT:
+	    {
+		char **argv;
+
+		sp -= i->n+1;
+		argv = args(sp+1, i->n);
+		create_subprocess_port(sp->s, argv);
+		drop(sp);
+		free_args(argv);
+	    }
+	    break;
+
+	  case OP_PUT:
+	    {
+		string name;
+		Value *name_value = NULL;
+
+		if (!i->var)
+		  name_value = --sp;
+		if (i->n < 0)
+		  text = string_Copy(buffer_to_string());
+		else {
+		    sp -= i->n;
+		    text = join(sp, i->n, " ");
+		}
+		name = name_value ? name_value->s : *i->var;
+
+		write_on_port(name, text, strlen(text));
+		free(text);
+		if (name_value)
+		  drop(name_value);
+	    }
+	    break;
+
+	  case OP_CLOSEINPUT:
+	  case OP_CLOSEOUTPUT:
+	  case OP_CLOSEPORT:
+	    sp--;
+	    if (i->opcode != OP_CLOSEOUTPUT)
+	      close_port_input(sp->s);
+	    if (i->opcode != OP_CLOSEINPUT)
+	      close_port_output(sp->s);
+	    drop(sp);
+	    break;
+
+	  case OP_EXEC:
+	    {
+		char **argv;
+
+		sp -= i->n;
+		argv = args(sp, i->n);
+		exec_command(argv);
+		free_args(argv);
+	    }
+	    break;
+
+	    /*
+	     * Control flow:
+	     */
+	  case OP_JUMP:
+	    pc = code->code + i->n;
+	    break;
+
+	  case OP_JUMPF:
+	    sp--;
+	    if (!string_to_bool(sp->s))
+	      pc = code->code + i->n;
+	    drop(sp);
+	    break;
+
+	  case OP_CASEEQ:
+	    sp--;
+	    bool_result = string_Eq(sp[-1].s, string_Downcase(own(sp)));
+	    drop(sp);
+	    if (bool_result) {
+		sp--;
+		drop(sp);
+		pc = code->code + i->n;
+	    }
+	    break;
+
+	  case OP_CASETABLE:
+	    {
+		int_dictionary_binding *binding;
+
+		sp--;
+		binding = int_dictionary_Lookup(i->table, sp->s);
+		pc = code->code + (binding ? binding->value : i->n);
+		drop(sp);
+	    }
+	    break;
+
+	  case OP_POP:
+	    sp--;
+	    drop(sp);
+	    break;
+
+	  case OP_HALT:
+	    return;
+	}
+    }
+}
@@ -0,0 +1,53 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It is one of the source files comprising zwgc, the Zephyr WindowGram
+ * client.
+ *
+ *      $Id$
+ *
+ *      Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *      For copying and distribution information, see the file
+ *      "mit-copyright.h".
+ */
+
+#include <zephyr/mit-copyright.h>
+
+#ifndef bytecode_MODULE
+#define bytecode_MODULE
+
+#include "node.h"
+
+typedef struct _Bytecode Bytecode;
+
+/*
+ *    Bytecode *bytecode_compile(Node *program)
+ *        Requires: program is a proper program (see node.c),
+ *                  var_clear_all_variables has been called
+ *        Effects: Compiles program into code for a small stack
+ *                 machine and returns it.  Variables are looked up
+ *                 once, here, rather than on every reference.  The
+ *                 returned code does not refer to program, stays good
+ *                 until the next var_clear_all_variables call, and must
+ *                 be freed eventually using bytecode_free.
+ */
+
+extern Bytecode *bytecode_compile(Node *);
+
+/*
+ *    void bytecode_free(Bytecode *code)
+ *        Modifies: code
+ *        Effects: Frees code, which should never be referenced again.
+ */
+
+extern void bytecode_free(Bytecode *);
+
+/*
+ *    void bytecode_run(Bytecode *code)
+ *        Requires: code came from bytecode_compile, we are called from
+ *                  exec_process_packet
+ *        Effects: Runs code, which does exactly what walking the
+ *                 program it was compiled from would.
+ */
+
+extern void bytecode_run(Bytecode *);
+
+#endif
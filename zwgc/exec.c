@@ -333,11 +333,16 @@ exec_if(Node *node)
     return(NOBREAK);
 }
 
-static int
-exec_exec(Node *node)
+/*
+ *    void exec_command(char **argv)
+ *        Effects: Starts the program argv[0] with arguments argv in the
+ *                 background.  Argv is not freed.
+ */
+
+void
+exec_command(char **argv)
 {
     int pid;
-    char **argv = eval_exprlist_to_args(node->d.nodes.first);
 
     pid = fork();
     if (pid == -1) {
@@ -349,7 +354,14 @@ exec_exec(Node *node)
 	perror("");
 	_exit(errno);
     }
-    
+}
+
+static int
+exec_exec(Node *node)
+{
+    char **argv = eval_exprlist_to_args(node->d.nodes.first);
+
+    exec_command(argv);
     free_args(argv);
     return(NOBREAK);
 }
@@ -436,24 +448,51 @@ static char *notice_fields;
 static int notice_fields_length = 0;
 static int number_of_fields = 0;
 
+/*
+ *    string exec_next_field()
+ *        Effects: Returns the next field of the notice being processed
+ *                 that a fields statement has not yet taken, or "" if
+ *                 there are none left.  The returned string is on the
+ *                 heap and must be freed eventually.
+ */
+
+string
+exec_next_field(void)
+{
+    if (number_of_fields)
+      number_of_fields--;
+
+    return(get_next_field(&notice_fields, &notice_fields_length));
+}
+
+/*
+ *    void exec_fields_done()
+ *        Modifies: $number_of_fields
+ *        Effects: Sets $number_of_fields to the number of fields not
+ *                 yet taken by a fields statement.
+ */
+
+void
+exec_fields_done(void)
+{
+    var_set_variable_to_number("number_of_fields", number_of_fields);
+}
+
 static int
 exec_fields(Node *node)
 {
-    for (node=node->d.nodes.first; node; node=node->next) {
-	var_set_variable_then_free_value(node->d.string_constant,
-				 get_next_field(&notice_fields,
-						&notice_fields_length));
-	if (number_of_fields)
-	  number_of_fields--;
-    }
+    for (node=node->d.nodes.first; node; node=node->next)
+      var_set_variable_then_free_value(node->d.string_constant,
+				       exec_next_field());
     
-    var_set_variable_to_number("number_of_fields", number_of_fields);
+    exec_fields_done();
 
     return(NOBREAK);
 }
 
 void
 exec_process_packet(Node *program,
+		    Bytecode *code,
 		    ZNotice_t *notice)
 {
 #ifdef CMU_ZWGCPLUS
@@ -472,7 +511,10 @@ exec_process_packet(Node *program,
     var_set_variable_to_number("number_of_fields", number_of_fields);
 
     clear_buffer();
-    (void)exec_subtree(program);
+    if (code)
+      bytecode_run(code);
+    else
+      (void)exec_subtree(program);
 
 #ifdef CMU_ZWGCPLUS
     plus_queue_notice(notice);
@@ -17,6 +17,44 @@
 #ifndef exec_MODULE
 #define exec_MODULE
 
-extern void exec_process_packet(Node *, ZNotice_t *);
+#include "bytecode.h"
+
+/*
+ *    void exec_process_packet(Node *program; Bytecode *code;
+ *                             ZNotice_t *notice)
+ *        Effects: Runs the description language program on notice.
+ *                 If code is not NULL, it must be program as compiled
+ *                 by bytecode_compile and it is run instead of walking
+ *                 program itself.
+ */
+
+extern void exec_process_packet(Node *, Bytecode *, ZNotice_t *);
+
+/*
+ *    string exec_next_field()
+ *        Effects: Returns the next field of the notice being processed
+ *                 that a fields statement has not yet taken, or "" if
+ *                 there are none left.  The returned string is on the
+ *                 heap and must be freed eventually.
+ */
+
+extern string exec_next_field(void);
+
+/*
+ *    void exec_fields_done()
+ *        Modifies: $number_of_fields
+ *        Effects: Sets $number_of_fields to the number of fields not
+ *                 yet taken by a fields statement.
+ */
+
+extern void exec_fields_done(void);
+
+/*
+ *    void exec_command(char **argv)
+ *        Effects: Starts the program argv[0] with arguments argv in the
+ *                 background.  Argv is not freed.
+ */
+
+extern void exec_command(char **);
 
 #endif
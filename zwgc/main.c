@@ -116,6 +116,13 @@ ares_channel achannel;
 
 static struct _Node *program = NULL;
 
+/*
+ * bytecode - this holds program compiled by bytecode_compile, which is
+ *            what is actually run on each notice.
+ */
+
+static Bytecode *bytecode = NULL;
+
 /*
  * <<<>>>
  */
@@ -171,11 +178,19 @@ read_in_description_file(void)
 
     sprintf(defdesc, "%s/zephyr/%s", DATADIR, DEFDESC);
     input_file = locate_file(description_filename_override, USRDESC, defdesc);
+    if (bytecode) {
+	bytecode_free(bytecode);
+	bytecode = NULL;
+    }
+
     if (input_file)
       program = parse_file(input_file);
     else
       program = NULL;
 
+    if (program)
+      bytecode = bytecode_compile(program);
+
     fake_startup_packet();
 }
 
@@ -582,7 +597,7 @@ process_notice(ZNotice_t *notice,
         goto cleanup;
     }
 
-    exec_process_packet(program, notice);
+    exec_process_packet(program, bytecode, notice);
   cleanup:
     return;
 }
@@ -18,29 +18,109 @@
 static const char rcsid_regexp_c[] = "$Id$";
 #endif
 
+#include "new_memory.h"
 #include "regexp.h"
 
-int
-ed_regexp_match_p(string test_string,
-		  string pattern)
+struct _ed_regexp {
+    regex_t re;
+    string pattern;
+};
+
+/*
+ * The patterns ed_regexp_match_p is given are mostly the same few over
+ * and over, so the last REGEXP_CACHE_SIZE of them are kept compiled.
+ * When a new one comes along, it replaces the one used longest ago.
+ */
+
+#define  REGEXP_CACHE_SIZE   64
+
+static struct {
+    ed_regexp *re;                   /* NULL if this entry is unused */
+    unsigned long last_used;
+} cache[REGEXP_CACHE_SIZE];
+
+static unsigned long cache_clock = 0;
+
+static ed_regexp *
+compile(string pattern,
+	int report_errors)
 {
-    regex_t RE;
+    ed_regexp *re;
     int retval;
     char errbuf[512];
 
-    retval = regcomp(&RE, pattern, REG_NOSUB);
+    re = (ed_regexp *)malloc(sizeof(ed_regexp));
+    retval = regcomp(&re->re, pattern, REG_NOSUB);
     if (retval != 0) {
-	regerror(retval, &RE, errbuf, sizeof(errbuf));
-	fprintf(stderr,"%s in regcomp %s\n",errbuf,pattern);
-	return(0);
+	if (report_errors) {
+	    regerror(retval, &re->re, errbuf, sizeof(errbuf));
+	    fprintf(stderr,"%s in regcomp %s\n",errbuf,pattern);
+	}
+	free(re);
+	return(NULL);
     }
-    retval = regexec(&RE, test_string, 0, NULL, 0);
+    re->pattern = string_Copy(pattern);
+
+    return(re);
+}
+
+ed_regexp *
+ed_regexp_compile(string pattern)
+{
+    return(compile(pattern, 0));
+}
+
+void
+ed_regexp_free(ed_regexp *re)
+{
+    regfree(&re->re);
+    free(re->pattern);
+    free(re);
+}
+
+int
+ed_regexp_match_compiled_p(string test_string,
+			   ed_regexp *re)
+{
+    int retval;
+    char errbuf[512];
+
+    retval = regexec(&re->re, test_string, 0, NULL, 0);
     if (retval != 0 && retval != REG_NOMATCH) {
-	regerror(retval, &RE, errbuf, sizeof(errbuf));
-	fprintf(stderr,"%s in regexec %s\n",errbuf,pattern);
-	regfree(&RE);
+	regerror(retval, &re->re, errbuf, sizeof(errbuf));
+	fprintf(stderr,"%s in regexec %s\n",errbuf,re->pattern);
 	return(0);
     }
-    regfree(&RE);
     return(retval == 0 ? 1 : 0);
 }
+
+int
+ed_regexp_match_p(string test_string,
+		  string pattern)
+{
+    ed_regexp *re;
+    int i, oldest = 0;
+
+    for (i=0; i<REGEXP_CACHE_SIZE; i++) {
+	if (!cache[i].re) {
+	    oldest = i;
+	    break;
+	}
+	if (string_Eq(cache[i].re->pattern, pattern))
+	  break;
+	if (cache[i].last_used < cache[oldest].last_used)
+	  oldest = i;
+    }
+
+    if (i == REGEXP_CACHE_SIZE || !cache[i].re) {
+	if (!(re = compile(pattern, 1)))
+	  return(0);
+	i = oldest;
+	if (cache[i].re)
+	  ed_regexp_free(cache[i].re);
+	cache[i].re = re;
+    }
+    cache[i].last_used = ++cache_clock;
+
+    return(ed_regexp_match_compiled_p(test_string, cache[i].re));
+}
@@ -19,6 +19,43 @@
 
 #include "new_string.h"
 
+typedef struct _ed_regexp ed_regexp;
+
+/*
+ *    int ed_regexp_match_p(string test_string, string pattern)
+ *        Effects: Returns true iff test_string matches the regular
+ *                 expression pattern.  If pattern is not a valid
+ *                 regular expression, a message is printed on stderr
+ *                 and false is returned.  The last few patterns used
+ *                 are kept compiled.
+ */
+
 extern int ed_regexp_match_p(string, string);
 
+/*
+ *    ed_regexp *ed_regexp_compile(string pattern)
+ *        Effects: Returns pattern compiled for ed_regexp_match_compiled_p,
+ *                 or NULL if it is not a valid regular expression.
+ *                 The result must be freed eventually using
+ *                 ed_regexp_free.
+ */
+
+extern ed_regexp *ed_regexp_compile(string);
+
+/*
+ *    int ed_regexp_match_compiled_p(string test_string, ed_regexp *re)
+ *        Effects: Like ed_regexp_match_p, but with a pattern compiled
+ *                 by ed_regexp_compile.
+ */
+
+extern int ed_regexp_match_compiled_p(string, ed_regexp *);
+
+/*
+ *    void ed_regexp_free(ed_regexp *re)
+ *        Modifies: re
+ *        Effects: Frees re, which should never be referenced again.
+ */
+
+extern void ed_regexp_free(ed_regexp *);
+
 #endif
@@ -25,22 +25,21 @@ static const char rcsid_substitute_c[] = "$Id$";
 /*
  *  Internal Routine:
  *
- *    string eat_dollar_sign_stuff(string (*lookup)(string); string *text_ptr)
- *        Modifies: *text_ptr
- *        Effects: This routine deals with handling the stuff after a '$'
- *                 for substitute.  If *text_ptr starts with a valid
- *                 variable reference (minus the leading '$'), we look up
- *                 the variable using lookup and return its value.
- *                 *text_ptr is also advanced past the variable reference.
- *                 If a '$' starts *text_ptr, *text_ptr is advanced past it &
- *                 "$" returned.  (This handles "$$" -> "$")  Otherwise,
- *                 "$" is returned and *text_ptr is not advanced.
- *                 The returned string must not be freed.
+ *    int scan_variable_reference(string *text_ptr; char **name_ptr)
+ *        Modifies: *text_ptr, *name_ptr
+ *        Effects: If *text_ptr starts with a valid variable reference
+ *                 (minus the leading '$'), *name_ptr is set to the
+ *                 start of the variable's name in it, *text_ptr is
+ *                 advanced past the reference, and the length of the
+ *                 name is returned.  Only the first
+ *                 MAX_IDENTIFIER_LENGTH characters count.  Otherwise,
+ *                 0 is returned and *text_ptr is not advanced.  "$$"
+ *                 is not handled here.
  */
 
-static string
-eat_dollar_sign_stuff(string (*lookup)(string),
-		      string *text_ptr)                 /* Input/Output parameter */
+static int
+scan_variable_reference(string *text_ptr,       /* Input/Output parameter */
+			char **name_ptr)
 {
     char c;
     char closing_brace = 0;
@@ -48,14 +47,7 @@ eat_dollar_sign_stuff(string (*lookup)(string),
     char *variable_name_start;
     int variable_name_length;
 
-    /*
-     * Handle "$$" -> "$" translation:
-     */
     c = *p;
-    if (c=='$') {
-	*text_ptr = p+1;
-	return("$");
-    }
 
     /*
      * If opening brace present (i.e., '(' or '{'), skip it and save away
@@ -82,28 +74,72 @@ eat_dollar_sign_stuff(string (*lookup)(string),
     /*
      * If there was an opening brace, there had better be a comparable
      * closing brace.  If so, skip it.  If not, we have an invalid variable
-     * reference so return '$' without advancing *text_ptr.
+     * reference.
      */
     if (closing_brace) {
 	if (c==closing_brace)
 	  c = *++p;
 	else
-	  return("$");
+	  return(0);
     }
 
     /*
      * Zero length variable names are not valid:
      */
     if (!variable_name_length)
-      return("$");
+      return(0);
 
     /*
-     * We have a valid variable reference.  Advance past it then lookup
-     * its value and return it:
+     * We have a valid variable reference.  Advance past it:
      */
     *text_ptr = p;
+    *name_ptr = variable_name_start;
     if (variable_name_length > MAX_IDENTIFIER_LENGTH)
       variable_name_length = MAX_IDENTIFIER_LENGTH;
+    return(variable_name_length);
+}
+
+/*
+ *  Internal Routine:
+ *
+ *    string eat_dollar_sign_stuff(string (*lookup)(string); string *text_ptr)
+ *        Modifies: *text_ptr
+ *        Effects: This routine deals with handling the stuff after a '$'
+ *                 for substitute.  If *text_ptr starts with a valid
+ *                 variable reference (minus the leading '$'), we look up
+ *                 the variable using lookup and return its value.
+ *                 *text_ptr is also advanced past the variable reference.
+ *                 If a '$' starts *text_ptr, *text_ptr is advanced past it &
+ *                 "$" returned.  (This handles "$$" -> "$")  Otherwise,
+ *                 "$" is returned and *text_ptr is not advanced.
+ *                 The returned string must not be freed.
+ */
+
+static string
+eat_dollar_sign_stuff(string (*lookup)(string),
+		      string *text_ptr)                 /* Input/Output parameter */
+{
+    char *variable_name_start;
+    int variable_name_length;
+    char *p;
+
+    /*
+     * Handle "$$" -> "$" translation:
+     */
+    if (**text_ptr=='$') {
+	(*text_ptr)++;
+	return("$");
+    }
+
+    variable_name_length = scan_variable_reference(text_ptr,
+						   &variable_name_start);
+    if (!variable_name_length)
+      return("$");
+
+    /*
+     * We have a valid variable reference.  Lookup its value and
+     * return it:
+     */
     variable_name_start = string_CreateFromData(variable_name_start,
 						variable_name_length);
     p = lookup(variable_name_start);
@@ -167,3 +203,45 @@ substitute(string (*lookup)(string),
 	result_so_far = string_Concat2(result_so_far, p);
     }
 }
+
+/*
+ *    void substitute_parse(string text;
+ *                          void (*literal)(char *, int, void *);
+ *                          void (*variable)(string, void *); void *arg)
+ *        Effects: Breaks text up the way substitute does, calling
+ *                 literal with each run of text to be copied as it
+ *                 is and its length, and variable with the name of
+ *                 each variable whose value is to be put in its place,
+ *                 in order.  Arg is passed along to both.  The names
+ *                 passed to variable are on the heap & must be freed
+ *                 by it eventually.
+ */
+
+void
+substitute_parse(string text,
+		 void (*literal)(char *, int, void *),
+		 void (*variable)(string, void *),
+		 void *arg)
+{
+    char *p, *name;
+    int length;
+
+    for (;;) {
+	for (p=text; *p && (*p)!='$'; p++) ;
+	if (text != p) {
+	    literal(text, p-text, arg);
+	    text = p;
+	}
+	if (!*text)
+	  return;
+
+	text++;
+	if (*text=='$') {
+	    text++;
+	    literal("$", 1, arg);
+	} else if ((length = scan_variable_reference(&text, &name)))
+	  variable(string_CreateFromData(name, length), arg);
+	else
+	  literal("$", 1, arg);
+    }
+}
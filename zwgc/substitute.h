@@ -42,4 +42,20 @@
 
 extern string substitute(string (*)(string), string);
 
+/*
+ *    void substitute_parse(string text;
+ *                          void (*literal)(char *, int, void *);
+ *                          void (*variable)(string, void *); void *arg)
+ *        Effects: Breaks text up the way substitute does, calling
+ *                 literal with each run of text to be copied as it
+ *                 is and its length, and variable with the name of
+ *                 each variable whose value is to be put in its place,
+ *                 in order.  Arg is passed along to both.  The names
+ *                 passed to variable are on the heap & must be freed
+ *                 by it eventually.
+ */
+
+extern void substitute_parse(string, void (*)(char *, int, void *),
+			     void (*)(string, void *), void *);
+
 #endif
@@ -0,0 +1,337 @@
+/* This file is part of the Project Athena Zephyr Notification System.
+ * It contains the zwgc unit tests.
+ *
+ *      $Id$
+ *
+ *      Copyright (c) 2026 by the Massachusetts Institute of Technology.
+ *      For copying and distribution information, see the file
+ *      "mit-copyright.h".
+ */
+
+#include <sysdep.h>
+#include <zephyr/mit-copyright.h>
+#include <zephyr/zephyr.h>
+
+#include "new_memory.h"
+#include "parser.h"
+#include "node.h"
+#include "exec.h"
+#include "bytecode.h"
+#include "notice.h"
+#include "port.h"
+#include "buffer.h"
+#include "variables.h"
+#include "main.h"
+
+#define TEST(EXP) \
+    do { \
+        printf("%s:%d: %s: ", __FILE__, __LINE__, #EXP); \
+        fflush(stdout); \
+        if (EXP) {        \
+            puts("PASS"); \
+        } else {          \
+            puts("FAIL"); \
+            failures++; \
+        } \
+        fflush(stdout); \
+    } while (0)
+
+#define P1(fmt, x)                               \
+    do { \
+        printf("%s:%d: " fmt "\n", __FILE__, __LINE__, x); \
+        fflush(stdout); \
+    } while (0)
+
+int failures = 0;
+
+/* What main.c would otherwise provide. */
+char *progname = "test_zwgc";
+char *subscriptions_filename_override = NULL;
+char *location_override = NULL;
+#ifdef HAVE_ARES
+ares_channel achannel;
+#endif
+
+void
+usage(void)
+{
+    abort();
+}
+
+/*
+ * A program exercising everything the description language has, to be
+ * run over the notices below along with the stock zwgc.desc.
+ */
+static char *test_desc = "\
+# every statement and expression\n\
+set seen = $seen + \"<\" + $class + \">\"\n\
+if ($class == \"t_break\") then\n\
+  print \"before\"\n\
+  break\n\
+  print \"after\"\n\
+elseif ($class == \"t_exit\") then\n\
+  print \"exiting\"\n\
+  exit\n\
+else\n\
+  noop\n\
+endif\n\
+case $class\n\
+match \"T_Loop\", \"t_loop2\"\n\
+  set i = \"\"\n\
+  set out = \"\"\n\
+  while ($i != \"xxxxx\") do\n\
+    set i = $i + \"x\"\n\
+    case $i\n\
+    match \"XXX\"\n\
+      break\n\
+    default\n\
+      set out = $out + \"[\" + $i + \"]\"\n\
+    endcase\n\
+  endwhile\n\
+  print \"loop\" $i $out\n\
+match \"t_text\"\n\
+  fields a b c d\n\
+  set w = $a\n\
+  set first = lbreak($w, \" \")\n\
+  set sp = lspan($w, \" \")\n\
+  set last = rbreak($w, \" \")\n\
+  set sp2 = rspan($w, \" \")\n\
+  set l3 = lany($b, \"abc\")\n\
+  set r2 = rany($b, \"ab\")\n\
+  set n1 = lany($1, \"xy\")\n\
+  set e = lany(\"constant\", \"con\")\n\
+  print $first \"|\" $sp \"|\" $w \"|\" $last \"|\" $sp2 \"|\" $l3 \"|\"\n\
+  print $r2 \"|\" $b \"|\" $n1 \"|\" $1 \"|\" $c \"|\" $d \"|\" $e\n\
+  print $number_of_fields\n\
+match \"t_subst\"\n\
+  set v = \"V\"\n\
+  set 7 = \"seven\"\n\
+  set format = \"$v+$1\"\n\
+  show\n\
+$v ${v}x $(v)y $$v $( v $ $vv ${} $0 $1 $2 $7 $01 $999 $\n\
+  endshow\n\
+  print substitute($format) substitute(\"$v-\" + \"$v\") substitute(\"\")\n\
+  print \"$v\" substitute(\"plain\")\n\
+match \"t_ops\"\n\
+  print upcase($class) downcase(\"AbC\") protect(\"@b(x)\")\n\
+  print verbatim(\"@b(y)\") stylestrip(\"@b(z)\")\n\
+  print getenv(\"TEST_ZWGC\") zvar(\"nonexistent\") (\"a\" == \"a\")\n\
+  print (\"a\" != \"a\") (\"abc\" =~ \"^a.c$\") (\"abc\" !~ \"b\")\n\
+  print (\"true\" and \"TRUE\") (\"true\" or \"no\") (! \"true\") !(\"x\")\n\
+  print buffer()\n\
+  put \"test\"\n\
+  clearbuf\n\
+  print \"after clear\" buffer()\n\
+  set x = \"self\"\n\
+  set x = $x + $x\n\
+  set y = lany($x, \"s\") + $x\n\
+  set z = $x + lany($x, \"e\")\n\
+  print $x $y $z\n\
+  set pat = \"^s.*f$\"\n\
+  print ($y =~ $pat) ($y !~ $pat) (\"abc\" =~ \"[\") ($class =~ \"^T_\")\n\
+  case $x\n\
+  match $pat\n\
+    print \"no\"\n\
+  match \"LFSELF\", $y\n\
+    print \"yes\"\n\
+  endcase\n\
+  case \"dup\"\n\
+  match \"DUP\"\n\
+    print \"first\"\n\
+  match \"dup\"\n\
+    print \"second\"\n\
+  default\n\
+    print \"neither\"\n\
+  endcase\n\
+default\n\
+  print \"default\" $class $instance $message $seen\n\
+endcase\n\
+print \"end\" $number_of_fields\n\
+put\n\
+put \"test\" \"explicit\" \"args\"\n\
+put \"test\"\n\
+put \"nosuchport\" \"x\"\n\
+print $error\n\
+set error = \"\"\n\
+closeport \"nosuchport\"\n\
+print $error\n\
+put\n\
+";
+
+struct test_notice {
+    char *class;
+    char *inst;
+    char *opcode;
+    char *sender;
+    char *recipient;
+    int auth;
+    char *message;
+    int message_len;
+};
+
+#define M(s)	s, sizeof(s)
+
+static struct test_notice corpus[] = {
+    { "MESSAGE", "personal", "", "alice@TEST.REALM", "bob", ZAUTH_YES,
+      M("Alice Q. Hacker\0hello there\n") },
+    { "message", "urgent", "", "alice", "bob", ZAUTH_NO,
+      M("From: Alice\0help!") },
+    { "message", "white-magic", "", "carol", "", ZAUTH_YES,
+      M("just one field") },
+    { "message", "white-magic", "", "carol", "", ZAUTH_FAILED,
+      M("signature ends in newline\n\0body") },
+    { "message", "personal", "PING", "dave", "bob", ZAUTH_YES, M("") },
+    { "login", "alice@TEST.REALM", "USER_LOGIN", "alice", "", ZAUTH_YES,
+      M("host.test\0Mon Jan  1 00:00:00 2026\0pts/1") },
+    { "login", "alice@TEST.REALM", "USER_LOGOUT", "alice", "", ZAUTH_YES,
+      M("host.test\0Mon Jan  1 00:00:00 2026\0pts/1") },
+    { "login", "alice@TEST.REALM", "odd", "alice", "", ZAUTH_NO, M("") },
+    { "FILSYS", "fs", "SHUTDOWN", "root", "", ZAUTH_YES,
+      M("server\0maintenance\0back soon") },
+    { "filsys", "fs", "mount", "root", "", ZAUTH_YES, M("mounted") },
+    { "mail", "POPRET", "", "pop", "bob", ZAUTH_YES,
+      M("alice\0bob\0lunch?") },
+    { "mail", "other", "", "pop", "bob", ZAUTH_YES, M("po1\0new mail") },
+    { "syslog", "host", "err", "root", "", ZAUTH_YES, M("disk full") },
+    { "random", "inst", "", "eve", "", ZAUTH_NO, M("one") },
+    { "random", "inst", "", "eve", "", ZAUTH_NO, M("one\0two\0three") },
+    { "WG_CTL_CLASS", "USER_REREAD", "", "bob", "", ZAUTH_YES, M("") },
+    { "t_break", "", "", "tester", "", ZAUTH_YES, M("") },
+    { "t_exit", "", "", "tester", "", ZAUTH_YES, M("") },
+    { "t_loop", "", "", "tester", "", ZAUTH_YES, M("") },
+    { "T_LOOP2", "", "", "tester", "", ZAUTH_YES, M("") },
+    { "t_text", "", "", "tester", "", ZAUTH_YES,
+      M("  two words  \0abcab\0xyz\0") },
+    { "t_text", "", "", "tester", "", ZAUTH_YES, M("\0\0") },
+    { "t_subst", "", "", "tester", "", ZAUTH_YES, M("f1\0f2") },
+    { "t_ops", "", "", "tester", "", ZAUTH_YES, M("") },
+};
+
+#define NCORPUS		(sizeof(corpus)/sizeof(corpus[0]))
+
+static string output;
+
+static char *
+capture(string text)
+{
+    output = string_Concat2(output, text);
+    return(NULL);
+}
+
+/*
+ * Run program over the corpus from a clean start, walking the tree or,
+ * if compile is set, compiled; results[i] gets what notice i put out
+ * along with what was left in the buffer.
+ */
+static void
+run_corpus(Node *(*parse)(void),
+	   int compile,
+	   string *results)
+{
+    Node *program;
+    Bytecode *code = NULL;
+    ZNotice_t notice;
+    struct test_notice *t;
+    int i;
+
+    var_clear_all_variables();
+    init_ports();
+    create_port_from_output_proc("test", capture);
+    var_set_variable("output_driver", "test");
+    var_set_variable("user", "bob");
+
+    program = parse();
+    if (program && compile)
+	code = bytecode_compile(program);
+
+    for (i = 0; i < NCORPUS; i++) {
+	t = &corpus[i];
+	memset(&notice, 0, sizeof(notice));
+	notice.z_version = "ZEPH0.2";
+	notice.z_kind = ACKED;
+	notice.z_class = t->class;
+	notice.z_class_inst = t->inst;
+	notice.z_opcode = t->opcode;
+	notice.z_sender = t->sender;
+	notice.z_recipient = t->recipient;
+	notice.z_default_format = "";
+	notice.z_auth = t->auth;
+	notice.z_message = t->message;
+	notice.z_message_len = t->message_len;
+	notice.z_time.tv_sec = 1700000000 + i;
+	notice.z_sender_addr.s_addr = htonl(0x7f000001);
+
+	output = string_Copy("");
+	(void) decode_notice(&notice, "sender.test");
+	exec_process_packet(program, code, &notice);
+	results[i] = string_Concat2(output, "\n--- buffer ---\n");
+	results[i] = string_Concat2(results[i], buffer_to_string());
+    }
+
+    if (code)
+	bytecode_free(code);
+}
+
+static char *desc_file;
+
+static Node *
+parse_desc_file(void)
+{
+    FILE *f = fopen(desc_file, "r");
+
+    if (!f) {
+	perror(desc_file);
+	return(NULL);
+    }
+    return(parse_file(f));
+}
+
+static Node *
+parse_test_desc(void)
+{
+    FILE *f = tmpfile();
+
+    fputs(test_desc, f);
+    rewind(f);
+    return(parse_file(f));
+}
+
+static void
+test_compat(char *name,
+	    Node *(*parse)(void))
+{
+    string walked[NCORPUS], compiled[NCORPUS];
+    int i, same = 0, nonempty = 0;
+
+    P1("comparing both engines on %s", name);
+    run_corpus(parse, 0, walked);
+    run_corpus(parse, 1, compiled);
+
+    for (i = 0; i < NCORPUS; i++) {
+	if (string_Eq(walked[i], compiled[i]))
+	    same++;
+	else
+	    printf("notice %d (%s): tree walk gave\n%s\ncompiled gave\n%s\n",
+		   i, corpus[i].class, walked[i], compiled[i]);
+	if (*walked[i] != '\n')
+	    nonempty++;
+	free(walked[i]);
+	free(compiled[i]);
+    }
+    TEST(same == NCORPUS);
+    TEST(nonempty > 0);
+}
+
+int
+main(int argc,
+     char **argv)
+{
+    desc_file = argc > 1 ? argv[1] : "zwgc.desc";
+    setenv("TEST_ZWGC", "from the environment", 1);
+
+    test_compat(desc_file, parse_desc_file);
+    test_compat("built-in test program", parse_test_desc);
+
+    printf("%d failures\n", failures);
+    exit(failures ? 1 : 0);
+}
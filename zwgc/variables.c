@@ -217,6 +217,34 @@ var_set_variable_then_free_value(string name,
     binding->value = value;
 }
 
+/*
+ *    string *var_get_variable_slot(string name)
+ *        Requires: var_clear_all_variables has been called
+ *        Effects: If name is a number variable, returns NULL.
+ *                 Otherwise, returns the address of the place where
+ *                 the value of the description language variable named
+ *                 name is kept, creating it with the value "" if need
+ *                 be.  The address stays good until the next
+ *                 var_clear_all_variables call.
+ */
+
+string *
+var_get_variable_slot(string name)
+{
+    string_dictionary_binding *binding;
+    int exists;
+
+    if (is_number_variable(name))
+      return(NULL);
+
+    binding = string_dictionary_Define(non_number_variable_dict, name,
+				       &exists);
+    if (!exists)
+      binding->value = string_Copy("");
+
+    return(&binding->value);
+}
+
 /*
  *    void var_set_number_variables_to_fields(char *data, int length)
  *        Requires: var_clear_all_variables has been called
@@ -77,6 +77,21 @@ extern void var_set_variable_to_number(string, int);
 
 extern void var_set_variable_then_free_value(string, string);
 
+/*
+ *    string *var_get_variable_slot(string name)
+ *        Requires: var_clear_all_variables has been called
+ *        Effects: If name is a number variable, returns NULL.
+ *                 Otherwise, returns the address of the place where
+ *                 the value of the description language variable named
+ *                 name is kept, creating it with the value "" if need
+ *                 be.  The value there is always on the heap; it may be
+ *                 read and may be replaced by freeing it and storing
+ *                 another string from the heap.  The address stays good
+ *                 until the next var_clear_all_variables call.
+ */
+
+extern string *var_get_variable_slot(string);
+
 /*
  *    void var_set_number_variables_to_fields(char *data, int length)
  *        Requires: var_clear_all_variables has been called